@@ -0,0 +1,570 @@
+#include "provided.h"
+#include "IndexedHeap.h"
+#include "MappedFile.h"
+#include "Logger.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+using namespace std;
+
+// Contraction hierarchy: nodes are removed ("contracted") one at a time in
+// order of importance, and whenever removing node v would lengthen a shortest
+// path u -> v -> w, a shortcut arc u -> w is added in its place.  A query then
+// runs Dijkstra forward from the source and backward from the target, each
+// only climbing towards more important nodes, and the two meet at the top of
+// the shortest path.  Shortcuts remember the two arcs they replace, so the
+// path is unpacked back into the map's own street edges.
+
+namespace
+{
+    const uint32_t NO_ARC = 0xffffffff;
+    const double INFINITE_DISTANCE = numeric_limits<double>::infinity();
+
+      // An original street edge, or a shortcut standing for two consecutive arcs
+    struct Arc
+    {
+        uint32_t from;
+        uint32_t to;
+        double   weight;        // miles
+        uint32_t first;         // arcs a shortcut replaces, NO_ARC for street edges
+        uint32_t second;
+        uint32_t edgeOffset;    // street edges: position within StreetMap::edgesFrom(from)
+        uint32_t pad;
+    };
+
+      // Entry in an upward adjacency list
+    struct UpArc
+    {
+        uint32_t node;          // the more important end
+        uint32_t arc;
+        double   weight;
+    };
+
+    const char CH_MAGIC[8] = { 'S', 'M', 'A', 'P', 'C', 'H', '\0', '\0' };
+    const uint32_t CH_BYTE_ORDER = 0x01020304;
+    const uint32_t CH_VERSION = 1;
+
+    struct ChHeader
+    {
+        char     magic[8];
+        uint32_t byteOrder;
+        uint32_t version;
+        uint32_t nodeCount;
+        uint32_t arcCount;
+        uint32_t forwardCount;
+        uint32_t backwardCount;
+        uint64_t mapFingerprint;
+        uint64_t checksum;
+    };
+
+      // Per-thread scratch for queries: distances, parent arcs and a heap for each direction,
+      // and the arcs of the path found while it is unpacked into edges
+    struct QueryContext
+    {
+        QueryContext() : m_generation(0) {}
+        void begin(unsigned int nodeCount)
+        {
+            if (m_stamp[0].size() < nodeCount) {
+                for (int side = 0; side < 2; side++) {
+                    m_stamp[side].resize(nodeCount, 0);
+                    m_dist[side].resize(nodeCount);
+                    m_parentArc[side].resize(nodeCount);
+                    m_heap[side].reserve(nodeCount);
+                }
+            }
+            m_generation++;
+            if (m_generation == 0) { //wrapped, old stamps could look current again
+                for (int side = 0; side < 2; side++)
+                    fill(m_stamp[side].begin(), m_stamp[side].end(), 0);
+                m_generation = 1;
+            }
+            m_heap[0].clear();
+            m_heap[1].clear();
+            m_upArcs.clear();
+        }
+        bool seen(int side, unsigned int node) const { return m_stamp[side][node] == m_generation; }
+        vector<unsigned int> m_stamp[2];
+        vector<double> m_dist[2];
+        vector<uint32_t> m_parentArc[2];
+        IndexedHeap m_heap[2];
+        vector<uint32_t> m_upArcs;          // source to meeting node, collected in reverse
+        vector<uint32_t> m_unpackStack;
+        unsigned int m_generation;
+    };
+}
+
+class ContractionHierarchyImpl
+{
+public:
+    ContractionHierarchyImpl(const StreetMap* sm);
+    ~ContractionHierarchyImpl();
+    void build();
+    bool save(string chFile) const;
+    bool load(string chFile);
+    bool isReady() const;
+    bool findPath(unsigned int source, unsigned int target,
+        vector<unsigned int>& nodes, vector<const StreetEdge*>& edges,
+        double& distance, unsigned int& nodesSettled) const;
+private:
+      // Working state while contracting
+    struct Builder;
+    void buildUpwardGraph(const vector<uint32_t>& rank);
+    void unpack(uint32_t arc, vector<uint32_t>& stack, vector<unsigned int>& nodes, vector<const StreetEdge*>& edges) const;
+
+    const StreetMap* m_sm;
+    vector<Arc> m_arcs;
+    vector<uint32_t> m_forwardOffsets;     // upward arcs leaving each node, CSR
+    vector<UpArc> m_forward;
+    vector<uint32_t> m_backwardOffsets;    // upward arcs entering each node, CSR
+    vector<UpArc> m_backward;
+    uint64_t m_fingerprint;
+    unsigned long long m_mapGeneration;  // the map as it was when built or loaded
+    unsigned int m_nodeCount;
+    bool m_ready;
+};
+
+struct ContractionHierarchyImpl::Builder
+{
+    Builder(const StreetMap* sm, vector<Arc>& arcs);
+    unsigned int contract(uint32_t v, bool apply);
+    void addShortcut(uint32_t u, uint32_t w, double weight, uint32_t first, uint32_t second);
+    void witnessSearch(uint32_t source, uint32_t skip, double bound);
+
+    static const unsigned int WITNESS_SETTLE_LIMIT = 500;
+    vector<Arc>& m_arcs;
+    vector<vector<uint32_t>> m_out;         // arc IDs leaving each node, contracted ends included
+    vector<vector<uint32_t>> m_in;          // arc IDs entering each node
+    vector<char> m_contracted;
+    //Witness search scratch
+    IndexedHeap m_heap;
+    vector<double> m_dist;
+    vector<unsigned int> m_stamp;
+    unsigned int m_generation;
+};
+
+ContractionHierarchyImpl::Builder::Builder(const StreetMap* sm, vector<Arc>& arcs)
+    : m_arcs(arcs), m_out(sm->nodeCount()), m_in(sm->nodeCount()), m_contracted(sm->nodeCount(), 0),
+      m_dist(sm->nodeCount()), m_stamp(sm->nodeCount(), 0), m_generation(0)
+{
+    m_heap.reserve(sm->nodeCount());
+    //One arc per street edge, keeping only the shortest of any parallel edges
+    for (unsigned int u = 0; u < sm->nodeCount(); u++) {
+        StreetEdgeRange range = sm->edgesFrom(u);
+        for (const StreetEdge* e = range.begin(); e != range.end(); e++) {
+            if (e->target == u)
+                continue;
+            uint32_t existing = NO_ARC;
+            for (size_t i = 0; i < m_out[u].size(); i++)
+                if (m_arcs[m_out[u][i]].to == e->target)
+                    existing = m_out[u][i];
+            if (existing != NO_ARC) {
+                if (e->length < m_arcs[existing].weight) {
+                    m_arcs[existing].weight = e->length;
+                    m_arcs[existing].edgeOffset = (uint32_t)(e - range.begin());
+                }
+                continue;
+            }
+            Arc arc = { u, e->target, e->length, NO_ARC, NO_ARC, (uint32_t)(e - range.begin()), 0 };
+            m_out[u].push_back((uint32_t)m_arcs.size());
+            m_in[e->target].push_back((uint32_t)m_arcs.size());
+            m_arcs.push_back(arc);
+        }
+    }
+}
+
+void ContractionHierarchyImpl::Builder::witnessSearch(uint32_t source, uint32_t skip, double bound)
+{
+    //Dijkstra among uncontracted nodes avoiding skip, stopped at bound or after a fixed number of settles.
+    //Stopping early can only miss a witness, which costs an unneeded shortcut, never a wrong answer.
+    m_generation++;
+    if (m_generation == 0) {
+        fill(m_stamp.begin(), m_stamp.end(), 0);
+        m_generation = 1;
+    }
+    m_heap.clear();
+    m_stamp[source] = m_generation;
+    m_dist[source] = 0;
+    m_heap.pushOrDecrease(source, 0);
+    unsigned int settled = 0;
+    while (!m_heap.empty() && m_heap.topKey() <= bound && settled < WITNESS_SETTLE_LIMIT) {
+        uint32_t u = m_heap.pop();
+        settled++;
+        for (size_t i = 0; i < m_out[u].size(); i++) {
+            const Arc& arc = m_arcs[m_out[u][i]];
+            if (arc.to == skip || m_contracted[arc.to])
+                continue;
+            double d = m_dist[u] + arc.weight;
+            if (m_stamp[arc.to] != m_generation || d < m_dist[arc.to]) {
+                m_stamp[arc.to] = m_generation;
+                m_dist[arc.to] = d;
+                m_heap.pushOrDecrease(arc.to, d);
+            }
+        }
+    }
+}
+
+void ContractionHierarchyImpl::Builder::addShortcut(uint32_t u, uint32_t w, double weight, uint32_t first, uint32_t second)
+{
+    for (size_t i = 0; i < m_out[u].size(); i++) { //An existing u -> w arc is shortened rather than duplicated
+        Arc& arc = m_arcs[m_out[u][i]];
+        if (arc.to == w) {
+            if (weight < arc.weight) {
+                arc.weight = weight;
+                arc.first = first;
+                arc.second = second;
+            }
+            return;
+        }
+    }
+    Arc arc = { u, w, weight, first, second, 0, 0 };
+    m_out[u].push_back((uint32_t)m_arcs.size());
+    m_in[w].push_back((uint32_t)m_arcs.size());
+    m_arcs.push_back(arc);
+}
+
+unsigned int ContractionHierarchyImpl::Builder::contract(uint32_t v, bool apply)
+{
+    //Returns the number of shortcuts contracting v needs; adds them too when apply is set
+    unsigned int shortcuts = 0;
+    for (size_t i = 0; i < m_in[v].size(); i++) {
+        uint32_t inArc = m_in[v][i];
+        uint32_t u = m_arcs[inArc].from;
+        if (m_contracted[u])
+            continue;
+        double inWeight = m_arcs[inArc].weight;
+        double bound = 0;
+        for (size_t j = 0; j < m_out[v].size(); j++) {
+            const Arc& out = m_arcs[m_out[v][j]];
+            if (!m_contracted[out.to] && out.to != u && inWeight + out.weight > bound)
+                bound = inWeight + out.weight;
+        }
+        if (bound == 0)
+            continue;
+        witnessSearch(u, v, bound);
+        for (size_t j = 0; j < m_out[v].size(); j++) {
+            uint32_t outArc = m_out[v][j];
+            uint32_t w = m_arcs[outArc].to;
+            if (m_contracted[w] || w == u)
+                continue;
+            double via = inWeight + m_arcs[outArc].weight;
+            if (m_stamp[w] == m_generation && m_dist[w] <= via)
+                continue; //a path avoiding v is no longer, no shortcut needed
+            shortcuts++;
+            if (apply)
+                addShortcut(u, w, via, inArc, outArc);
+        }
+    }
+    return shortcuts;
+}
+
+ContractionHierarchyImpl::ContractionHierarchyImpl(const StreetMap* sm)
+    : m_sm(sm), m_fingerprint(0), m_mapGeneration(0), m_nodeCount(0), m_ready(false)
+{
+}
+
+ContractionHierarchyImpl::~ContractionHierarchyImpl()
+{
+}
+
+void ContractionHierarchyImpl::build()
+{
+    unsigned int n = m_sm->nodeCount();
+    m_arcs.clear();
+    Builder builder(m_sm, m_arcs);
+
+    //Importance: shortcuts added minus arcs removed, plus contracted neighbours so the
+    //order spreads evenly over the map.  Priorities go stale as neighbours are
+    //contracted, so each popped node is re-evaluated before it is contracted (lazy updates).
+    vector<unsigned int> contractedNeighbours(n, 0);
+    auto priority = [&](uint32_t v) {
+        unsigned int removed = 0;
+        for (size_t i = 0; i < builder.m_in[v].size(); i++)
+            removed += !builder.m_contracted[m_arcs[builder.m_in[v][i]].from];
+        for (size_t i = 0; i < builder.m_out[v].size(); i++)
+            removed += !builder.m_contracted[m_arcs[builder.m_out[v][i]].to];
+        return (double)builder.contract(v, false) - removed + contractedNeighbours[v];
+    };
+    IndexedHeap queue;
+    queue.reserve(n);
+    for (uint32_t v = 0; v < n; v++)
+        queue.pushOrDecrease(v, priority(v));
+
+    vector<uint32_t> rank(n);
+    uint32_t order = 0;
+    while (!queue.empty()) {
+        uint32_t v = queue.pop();
+        double p = priority(v);
+        if (!queue.empty() && p > queue.topKey()) { //no longer the least important, requeue
+            queue.pushOrDecrease(v, p);
+            continue;
+        }
+        builder.contract(v, true);
+        builder.m_contracted[v] = 1;
+        rank[v] = order++;
+        for (size_t i = 0; i < builder.m_out[v].size(); i++)
+            contractedNeighbours[m_arcs[builder.m_out[v][i]].to]++;
+        for (size_t i = 0; i < builder.m_in[v].size(); i++)
+            contractedNeighbours[m_arcs[builder.m_in[v][i]].from]++;
+    }
+    buildUpwardGraph(rank);
+    m_nodeCount = n;
+    m_fingerprint = m_sm->graphFingerprint();
+    m_mapGeneration = m_sm->generation();
+    m_ready = true;
+}
+
+void ContractionHierarchyImpl::buildUpwardGraph(const vector<uint32_t>& rank)
+{
+    //Every arc points up from exactly one end: forward lists hold arcs leaving the
+    //lower end, backward lists arcs entering it.  Both are counting-sorted into CSR.
+    unsigned int n = (unsigned int)rank.size();
+    m_forwardOffsets.assign(n + 1, 0);
+    m_backwardOffsets.assign(n + 1, 0);
+    for (size_t a = 0; a < m_arcs.size(); a++) {
+        const Arc& arc = m_arcs[a];
+        if (rank[arc.to] > rank[arc.from])
+            m_forwardOffsets[arc.from + 1]++;
+        else
+            m_backwardOffsets[arc.to + 1]++;
+    }
+    for (unsigned int v = 0; v < n; v++) {
+        m_forwardOffsets[v + 1] += m_forwardOffsets[v];
+        m_backwardOffsets[v + 1] += m_backwardOffsets[v];
+    }
+    m_forward.resize(m_forwardOffsets[n]);
+    m_backward.resize(m_backwardOffsets[n]);
+    vector<uint32_t> nextForward(m_forwardOffsets.begin(), m_forwardOffsets.end() - 1);
+    vector<uint32_t> nextBackward(m_backwardOffsets.begin(), m_backwardOffsets.end() - 1);
+    for (size_t a = 0; a < m_arcs.size(); a++) {
+        const Arc& arc = m_arcs[a];
+        if (rank[arc.to] > rank[arc.from]) {
+            UpArc up = { arc.to, (uint32_t)a, arc.weight };
+            m_forward[nextForward[arc.from]++] = up;
+        }
+        else {
+            UpArc up = { arc.from, (uint32_t)a, arc.weight };
+            m_backward[nextBackward[arc.to]++] = up;
+        }
+    }
+}
+
+bool ContractionHierarchyImpl::isReady() const
+{
+    //Arcs hold edge offsets into the map's storage, so any reload since makes them stale
+    return m_ready && m_mapGeneration == m_sm->generation();
+}
+
+bool ContractionHierarchyImpl::findPath(unsigned int source, unsigned int target,
+    vector<unsigned int>& nodes, vector<const StreetEdge*>& edges,
+    double& distance, unsigned int& nodesSettled) const
+{
+    nodes.clear();
+    edges.clear();
+    distance = 0;
+    nodesSettled = 0;
+    if (!isReady() || source >= m_nodeCount || target >= m_nodeCount)
+        return false;
+    if (source == target)
+        return true;
+
+    thread_local QueryContext ctx; //one per thread, searches never nest
+    ctx.begin(m_nodeCount);
+    const uint32_t* offsets[2] = { m_forwardOffsets.data(), m_backwardOffsets.data() };
+    const UpArc* lists[2] = { m_forward.data(), m_backward.data() };
+    unsigned int origin[2] = { source, target };
+    for (int side = 0; side < 2; side++) {
+        ctx.m_stamp[side][origin[side]] = ctx.m_generation;
+        ctx.m_dist[side][origin[side]] = 0;
+        ctx.m_parentArc[side][origin[side]] = NO_ARC;
+        ctx.m_heap[side].pushOrDecrease(origin[side], 0);
+    }
+
+    //Alternate by smallest key; once neither heap can beat the best meeting point, it is optimal
+    double best = INFINITE_DISTANCE;
+    uint32_t meet = NO_ARC;
+    for (;;) {
+        double top[2];
+        for (int side = 0; side < 2; side++)
+            top[side] = ctx.m_heap[side].empty() ? INFINITE_DISTANCE : ctx.m_heap[side].topKey();
+        if (top[0] >= best && top[1] >= best)
+            break;
+        int side = top[0] <= top[1] ? 0 : 1;
+        uint32_t u = ctx.m_heap[side].pop();
+        nodesSettled++;
+        double du = ctx.m_dist[side][u];
+        if (ctx.seen(1 - side, u) && du + ctx.m_dist[1 - side][u] < best) {
+            best = du + ctx.m_dist[1 - side][u];
+            meet = u;
+        }
+        for (uint32_t i = offsets[side][u]; i < offsets[side][u + 1]; i++) {
+            const UpArc& up = lists[side][i];
+            double d = du + up.weight;
+            if (!ctx.seen(side, up.node) || d < ctx.m_dist[side][up.node]) {
+                ctx.m_stamp[side][up.node] = ctx.m_generation;
+                ctx.m_dist[side][up.node] = d;
+                ctx.m_parentArc[side][up.node] = up.arc;
+                ctx.m_heap[side].pushOrDecrease(up.node, d);
+            }
+        }
+    }
+    if (meet == NO_ARC)
+        return false;
+
+    //Arcs from the source up to the meeting node, then from there down to the target
+    for (uint32_t v = meet; ctx.m_parentArc[0][v] != NO_ARC; v = m_arcs[ctx.m_parentArc[0][v]].from)
+        ctx.m_upArcs.push_back(ctx.m_parentArc[0][v]);
+    for (size_t i = ctx.m_upArcs.size(); i > 0; i--)
+        unpack(ctx.m_upArcs[i - 1], ctx.m_unpackStack, nodes, edges);
+    for (uint32_t v = meet; ctx.m_parentArc[1][v] != NO_ARC; v = m_arcs[ctx.m_parentArc[1][v]].to)
+        unpack(ctx.m_parentArc[1][v], ctx.m_unpackStack, nodes, edges);
+    distance = best;
+    return true;
+}
+
+void ContractionHierarchyImpl::unpack(uint32_t arc, vector<uint32_t>& stack,
+    vector<unsigned int>& nodes, vector<const StreetEdge*>& edges) const
+{
+    //Depth-first, left to right, with an explicit stack; long shortcuts nest deeply.
+    //The stack is the caller's, so its capacity carries over from query to query
+    stack.assign(1, arc);
+    while (!stack.empty()) {
+        const Arc& a = m_arcs[stack.back()];
+        stack.pop_back();
+        if (a.first == NO_ARC) {
+            nodes.push_back(a.from);
+            edges.push_back(m_sm->edgesFrom(a.from).begin() + a.edgeOffset);
+        }
+        else {
+            stack.push_back(a.second);
+            stack.push_back(a.first);
+        }
+    }
+}
+
+bool ContractionHierarchyImpl::save(string chFile) const
+{
+    if (!m_ready)
+        return false;
+    ChHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CH_MAGIC, sizeof(header.magic));
+    header.byteOrder = CH_BYTE_ORDER;
+    header.version = CH_VERSION;
+    header.nodeCount = m_nodeCount;
+    header.arcCount = (uint32_t)m_arcs.size();
+    header.forwardCount = (uint32_t)m_forward.size();
+    header.backwardCount = (uint32_t)m_backward.size();
+    header.mapFingerprint = m_fingerprint;
+
+    //Sections follow the header in this order, each already a multiple of 8 bytes
+    string payload;
+    payload.append(reinterpret_cast<const char*>(m_arcs.data()), m_arcs.size() * sizeof(Arc));
+    payload.append(reinterpret_cast<const char*>(m_forward.data()), m_forward.size() * sizeof(UpArc));
+    payload.append(reinterpret_cast<const char*>(m_backward.data()), m_backward.size() * sizeof(UpArc));
+    payload.append(reinterpret_cast<const char*>(m_forwardOffsets.data()), m_forwardOffsets.size() * sizeof(uint32_t));
+    payload.append(reinterpret_cast<const char*>(m_backwardOffsets.data()), m_backwardOffsets.size() * sizeof(uint32_t));
+    header.checksum = checksumBytes(payload.data(), payload.size());
+
+    ofstream outfile(chFile, ios::binary | ios::trunc);
+    if (!outfile)
+    {
+        LOG_ERROR("Cannot open " << chFile << " for writing");
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(payload.data(), payload.size());
+    return (bool)outfile;
+}
+
+bool ContractionHierarchyImpl::load(string chFile)
+{
+    m_ready = false;
+    MappedFile file;
+    if (!file.open(chFile))
+    {
+        LOG_ERROR("Cannot open " << chFile);
+        return false;
+    }
+    ChHeader header;
+    if (file.size() < sizeof(header)) {
+        LOG_ERROR(chFile << " is too small to be a hierarchy");
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, CH_MAGIC, sizeof(header.magic)) != 0 || header.byteOrder != CH_BYTE_ORDER
+        || header.version != CH_VERSION) {
+        LOG_ERROR(chFile << " is not a version " << CH_VERSION << " hierarchy");
+        return false;
+    }
+    size_t offsetCount = header.nodeCount + (size_t)1;
+    size_t payloadBytes = header.arcCount * sizeof(Arc) + (header.forwardCount + (size_t)header.backwardCount) * sizeof(UpArc)
+        + 2 * offsetCount * sizeof(uint32_t);
+    const char* payload = file.data() + sizeof(header);
+    if (file.size() - sizeof(header) != payloadBytes || checksumBytes(payload, payloadBytes) != header.checksum) {
+        LOG_ERROR(chFile << " is truncated or corrupt");
+        return false;
+    }
+    if (header.nodeCount != m_sm->nodeCount() || header.mapFingerprint != m_sm->graphFingerprint()) {
+        LOG_ERROR(chFile << " was built from a different map");
+        return false;
+    }
+    //Copied out of the mapping; queries need the arrays for as long as the object lives
+    m_arcs.assign(reinterpret_cast<const Arc*>(payload), reinterpret_cast<const Arc*>(payload) + header.arcCount);
+    payload += header.arcCount * sizeof(Arc);
+    m_forward.assign(reinterpret_cast<const UpArc*>(payload), reinterpret_cast<const UpArc*>(payload) + header.forwardCount);
+    payload += header.forwardCount * sizeof(UpArc);
+    m_backward.assign(reinterpret_cast<const UpArc*>(payload), reinterpret_cast<const UpArc*>(payload) + header.backwardCount);
+    payload += header.backwardCount * sizeof(UpArc);
+    m_forwardOffsets.assign(reinterpret_cast<const uint32_t*>(payload), reinterpret_cast<const uint32_t*>(payload) + offsetCount);
+    payload += offsetCount * sizeof(uint32_t);
+    m_backwardOffsets.assign(reinterpret_cast<const uint32_t*>(payload), reinterpret_cast<const uint32_t*>(payload) + offsetCount);
+    m_nodeCount = header.nodeCount;
+    m_fingerprint = header.mapFingerprint;
+    m_mapGeneration = m_sm->generation();
+    m_ready = true;
+    return true;
+}
+
+//******************** ContractionHierarchy functions *************************
+
+// These functions simply delegate to ContractionHierarchyImpl's functions.
+
+ContractionHierarchy::ContractionHierarchy(const StreetMap* sm)
+{
+    m_impl = new ContractionHierarchyImpl(sm);
+}
+
+ContractionHierarchy::~ContractionHierarchy()
+{
+    delete m_impl;
+}
+
+void ContractionHierarchy::build()
+{
+    m_impl->build();
+}
+
+bool ContractionHierarchy::save(string chFile) const
+{
+    return m_impl->save(chFile);
+}
+
+bool ContractionHierarchy::load(string chFile)
+{
+    return m_impl->load(chFile);
+}
+
+bool ContractionHierarchy::isReady() const
+{
+    return m_impl->isReady();
+}
+
+bool ContractionHierarchy::findPath(unsigned int source, unsigned int target,
+    vector<unsigned int>& nodes, vector<const StreetEdge*>& edges,
+    double& distance, unsigned int& nodesSettled) const
+{
+    return m_impl->findPath(source, target, nodes, edges, distance, nodesSettled);
+}
@@ -0,0 +1,64 @@
+// CoordKey.h
+
+// A coordinate packed into 64 bits: latitude and longitude each quantized to
+// signed fixed point with 7 decimal places, the precision of the map data.
+// Hashing and comparing a CoordKey is integer work, unlike GeoCoord, whose
+// equality compares its text.  The text is only needed for output.
+
+#ifndef COORDKEY_INCLUDED
+#define COORDKEY_INCLUDED
+
+#include "provided.h"
+#include <cstdint>
+#include <cmath>
+
+struct CoordKey
+{
+    uint64_t bits;
+};
+
+inline int32_t toFixedPoint(double degrees)
+{
+    return (int32_t)std::llround(degrees * 1e7);   // |longitude| * 1e7 <= 1.8e9 fits in 31 bits
+}
+
+inline CoordKey makeCoordKey(double latitude, double longitude)
+{
+    CoordKey key;
+    key.bits = ((uint64_t)(uint32_t)toFixedPoint(latitude) << 32) | (uint32_t)toFixedPoint(longitude);
+    return key;
+}
+
+inline CoordKey makeCoordKey(const GeoCoord& gc)
+{
+    return makeCoordKey(gc.latitude, gc.longitude);
+}
+
+inline bool operator==(const CoordKey& lhs, const CoordKey& rhs)
+{
+    return lhs.bits == rhs.bits;
+}
+
+inline bool operator!=(const CoordKey& lhs, const CoordKey& rhs)
+{
+    return lhs.bits != rhs.bits;
+}
+
+  // 64-bit finalizer from MurmurHash3; neighbouring coordinates differ only in
+  // their low bits, so they need a full avalanche before being bucketed
+inline uint64_t mixCoordKey(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+inline unsigned int hasher(const CoordKey& key)
+{
+    return (unsigned int)mixCoordKey(key.bits);
+}
+
+#endif // COORDKEY_INCLUDED
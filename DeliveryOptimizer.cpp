@@ -2,10 +2,39 @@
 #include <vector>
 #include <iostream>
 #include <cmath>
-#include <cstdlib>
 #include <random>
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include "TourSearch.h"
+#include "HeldKarp.h"
+#include "FleetSearch.h"
+#include "ScheduleSearch.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "Haversine.h"
 using namespace std;
 
+namespace
+{
+    int randInt(mt19937_64& engine, int min, int max)
+    {
+        uniform_int_distribution<> distro(min, max);
+        return distro(engine);
+    }
+
+      // Deliveries in the order of a tour of stop numbers, depot first
+    void reorder(vector<DeliveryRequest>& deliveries, const vector<int>& tour)
+    {
+        vector<DeliveryRequest> reordered;
+        reordered.reserve(deliveries.size());
+        for (size_t i = 1; i < tour.size(); i++)
+            reordered.push_back(deliveries[tour[i] - 1]);
+        deliveries.swap(reordered);
+    }
+}
+
 class DeliveryOptimizerImpl
 {
 public:
@@ -16,27 +45,32 @@ public:
         vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+    void optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        const vector<vector<double>>& distances,
+        double& oldDistance,
+        double& newDistance) const;
+    bool optimizeFleetOrder(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        const vector<vector<double>>& distances,
+        const vector<Vehicle>& vehicles,
+        vector<vector<DeliveryRequest>>& trips,
+        double& totalDistance) const;
+    void setOptions(const OptimizerOptions& options) { m_options = options; }
+    OptimizerOptions options() const { return m_options; }
+    void useThreadPool(ThreadPool* pool) { m_pool = pool; }
 private:
-    double crowDistance(GeoCoord depot, const vector<DeliveryRequest> deliveries) const;
-    inline int randInt(int min, int max) const
-    {
-        if (max < min)
-            std::swap(max, min);
-        static std::random_device rd;
-        static std::default_random_engine generator(rd());
-        std::uniform_int_distribution<> distro(min, max);
-        return distro(generator);
-    }
-    inline void swap(int curr, int rand, vector<DeliveryRequest>& deliveries) const
-    {
-        DeliveryRequest temp(deliveries[curr].item, deliveries[curr].location);
-        deliveries[curr] = deliveries[rand];
-        deliveries[rand] = temp;
-    }
+    void anneal(TourSearch& search, mt19937_64& engine, chrono::steady_clock::time_point start,
+        double target, atomic<bool>& done) const;
+    OptimizerOptions m_options;
+    ThreadPool* m_pool;     // runs the starts concurrently when set
 };
 
-DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm)
+DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* /*sm*/)
 {
+    m_pool = nullptr;
 }
 
 DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
@@ -49,45 +83,253 @@ void DeliveryOptimizerImpl::optimizeDeliveryOrder(
     double& oldCrowDistance,
     double& newCrowDistance) const
 {
-    //Calculates oldCrow
-    oldCrowDistance = crowDistance(depot, deliveries);
-
-    //Pesudo-random based on simulated annealing
-    int n = 0;
-    int heat = (int) deliveries.size() / 2;
-    double currentDist = oldCrowDistance;
-    while (n < (int) deliveries.size()) {
-        for (int i = 0; i < (int)deliveries.size(); i++) { //Swaps around current i with a random other deliveryrequest
-            int curr = n % deliveries.size();
-            int rand = randInt(0, deliveries.size() - 1);
-            swap(curr, rand, deliveries);
-            newCrowDistance = crowDistance(depot, deliveries);
-            if (newCrowDistance - currentDist > 0 && randInt(0, deliveries.size()) >= heat) { //checks if the permmutation is more efficient
-                swap(rand, curr, deliveries); //if not efficient then chance to swap back to original or keep this permutation
-            }
-            else {
-                currentDist = newCrowDistance; 
-            }
+    //Crow-flies distances between every pair of stops, depot first.  They are symmetric,
+    //so each row is batched from the diagonal on and mirrored below it
+    RadianCoords stops;
+    stops.reserve(deliveries.size() + 1);
+    stops.add(depot.latitude, depot.longitude);
+    for (const DeliveryRequest& d : deliveries)
+        stops.add(d.location.latitude, d.location.longitude);
+    size_t n = stops.size();
+    vector<vector<double>> distances(n, vector<double>(n, 0));
+    for (size_t i = 0; i + 1 < n; i++) {
+        haversineOneToMany(stops.lat[i], stops.lon[i], stops.cosLat[i], &stops.lat[i + 1], &stops.lon[i + 1],
+            &stops.cosLat[i + 1], n - i - 1, &distances[i][i + 1]);
+        for (size_t j = i + 1; j < n; j++)
+            distances[j][i] = distances[i][j];
+    }
+    optimizeDeliveryOrder(depot, deliveries, distances, oldCrowDistance, newCrowDistance);
+    LOG_DEBUG("oldCrowDistance is " << oldCrowDistance << ", newCrowDistance is " << newCrowDistance);
+}
+
+void DeliveryOptimizerImpl::optimizeDeliveryOrder(
+    const GeoCoord& /*depot*/,
+    vector<DeliveryRequest>& deliveries,
+    const vector<vector<double>>& distances,
+    double& oldDistance,
+    double& newDistance) const
+{
+    //Works on stop numbers into the matrix, depot first, starting from the order given,
+    //then puts the deliveries in the order found
+    //Time windows need the schedule kept as the tour changes
+    if (any_of(deliveries.begin(), deliveries.end(), [](const DeliveryRequest& d) { return d.hasWindow(); })) {
+        vector<double> earliest(1, 0), latest(1, 0), service(1, 0);
+        for (const DeliveryRequest& d : deliveries) {
+            earliest.push_back(d.earliest);
+            latest.push_back(d.latest);
+            service.push_back(d.serviceMinutes);
         }
-        heat /= 2; //change heat so less likely to choose a random permutation that is less efficient as we loop more
-        n++;
+        ScheduleSearch schedule(distances, earliest, latest, service, m_options.speedMph);
+        oldDistance = schedule.length();
+        schedule.insertAll();
+        newDistance = schedule.improve();
+        reorder(deliveries, schedule.tour());
+        return;
+    }
+
+    //Small batches are solved exactly while the table fits
+    vector<int> exact;
+    if (deliveries.size() <= m_options.exactStops
+        && solveHeldKarp(distances, m_options.exactMaxBytes, exact, newDistance)) {
+        oldDistance = 0;
+        for (size_t i = 0; i <= deliveries.size(); i++)
+            oldDistance += distances[i][i == deliveries.size() ? 0 : i + 1];
+        reorder(deliveries, exact);
+        return;
     }
-    std::cerr << "oldCrowDistance is " << oldCrowDistance << endl << "newCrowDistance is " << newCrowDistance << endl;
+
+    TourSearch search(distances);
+    search.setMoves(m_options.moves); //MoveSet bits match TourSearch::Move
+    oldDistance = search.length();
+    unsigned int starts = max(m_options.starts, 1u);
+    double target = m_options.targetGap > 0 ? search.lowerBound() * (1 + m_options.targetGap) : 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    atomic<bool> done(false);
+    vector<vector<int>> tours(starts);
+    vector<double> lengths(starts, numeric_limits<double>::infinity());
+    auto run = [&](size_t k) {
+        if (done)
+            return;
+        //Each start copies the search, sharing its matrix, and has an engine of its own;
+        //the first keeps the order given and the plain seed, so one start is the classic run
+        TourSearch mine = search;
+        mt19937_64 engine(m_options.seed);
+        if (k > 0) {
+            seed_seq seeds = { (unsigned int)m_options.seed, (unsigned int)k };
+            engine.seed(seeds);
+            vector<int> order = mine.tour();
+            shuffle(order.begin() + 1, order.end(), engine);
+            mine.setTour(order);
+        }
+        if (m_options.timeBudgetMs > 0 || m_options.iterationBudget > 0)
+            anneal(mine, engine, start, target, done);
+        //2-opt, Or-opt and relocate moves until none of them shortens the tour
+        lengths[k] = mine.improve();
+        tours[k] = mine.tour();
+        if (lengths[k] <= target)
+            done = true;
+    };
+    if (m_pool != nullptr)
+        m_pool->parallelFor(starts, run);
+    else
+        for (size_t k = 0; k < starts; k++)
+            run(k);
+
+    //Shortest wins, the earliest start on a tie, so the pick does not depend on timing
+    size_t best = min_element(lengths.begin(), lengths.end()) - lengths.begin();
+    newDistance = lengths[best];
+    reorder(deliveries, tours[best]);
 }
 
-double DeliveryOptimizerImpl::crowDistance(GeoCoord depot, const vector<DeliveryRequest> deliveries) const
+bool DeliveryOptimizerImpl::optimizeFleetOrder(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    const vector<vector<double>>& distances,
+    const vector<Vehicle>& vehicles,
+    vector<vector<DeliveryRequest>>& trips,
+    double& totalDistance) const
 {
-    GeoCoord coord1 = depot;
-    double dist = 0;
-    //Calculates oldCrowDistance
-    for (int i = 0; i < (int)deliveries.size(); i++) {
-        GeoCoord coord2 = deliveries[i].location;
-        double currentDist = distanceEarthMiles(coord1, coord2);
-        dist += currentDist;
-        coord1 = coord2;
+    trips.clear();
+    totalDistance = 0;
+    size_t stops = deliveries.size() + 1;
+    vector<double> weights(stops, 0), bearings(stops, 0);
+    double squash = cos(deg2rad(depot.latitude)); //a degree of longitude is shorter away from the equator
+    for (size_t i = 1; i < stops; i++) {
+        weights[i] = deliveries[i - 1].weight;
+        bearings[i] = atan2(deliveries[i - 1].location.latitude - depot.latitude,
+                            (deliveries[i - 1].location.longitude - depot.longitude) * squash);
     }
-    dist += distanceEarthMiles(depot, coord1);
-    return dist;
+
+    //Both constructions, each improved, keeping the shorter; packing only if neither fits
+    FleetSearch fleet(distances, weights, vehicles);
+    vector<vector<int>> best;
+    double bestLength = 0;
+    auto keep = [&]() {
+        double length = fleet.improve();
+        if (best.empty() || length < bestLength) {
+            best.assign(vehicles.size(), vector<int>());
+            for (int v = 0; v < fleet.vehicles(); v++)
+                best[v] = fleet.trip(v);
+            bestLength = length;
+        }
+    };
+    if (fleet.savings())
+        keep();
+    if (fleet.sweep(bearings))
+        keep();
+    if (best.empty() && fleet.pack())
+        keep();
+    if (best.empty())
+        return false;
+
+    //Then each trip on its own, as a single tour over its rows of the matrix
+    trips.assign(vehicles.size(), vector<DeliveryRequest>());
+    vector<double> lengths(vehicles.size(), 0);
+    auto orderTrip = [&](size_t v) {
+        const vector<int>& trip = best[v];
+        if (trip.empty())
+            return;
+        vector<vector<double>> tripDistances(trip.size() + 1, vector<double>(trip.size() + 1));
+        for (size_t i = 0; i <= trip.size(); i++)
+            for (size_t j = 0; j <= trip.size(); j++)
+                tripDistances[i][j] = distances[i == 0 ? 0 : trip[i - 1]][j == 0 ? 0 : trip[j - 1]];
+        for (int stop : trip)
+            trips[v].push_back(deliveries[stop - 1]);
+        double before;
+        optimizeDeliveryOrder(depot, trips[v], tripDistances, before, lengths[v]);
+    };
+    if (m_pool != nullptr)
+        m_pool->parallelFor(vehicles.size(), orderTrip);
+    else
+        for (size_t v = 0; v < vehicles.size(); v++)
+            orderTrip(v);
+    for (double length : lengths)
+        totalDistance += length;
+    return true;
+}
+
+void DeliveryOptimizerImpl::anneal(TourSearch& search, mt19937_64& engine, chrono::steady_clock::time_point start,
+    double target, atomic<bool>& done) const
+{
+    //Random moves, each scored by its change in length alone; worse tours are accepted
+    //with probability exp(-increase / temperature) while the temperature falls over the budget
+    int n = search.stops();
+    unsigned int moves = m_options.moves & OptimizerOptions::MOVE_ALL;
+    if (n < 4 || moves == 0)
+        return;
+    double initial = m_options.initialTemperature;
+    if (initial <= 0)
+        initial = 0.1 * search.length() / n; //a tenth of the average edge
+    double final = m_options.finalTemperature > 0 ? m_options.finalTemperature : initial / 1000;
+    if (initial <= 0 || final >= initial)
+        return;
+
+    vector<unsigned int> kinds;
+    for (unsigned int kind = OptimizerOptions::MOVE_TWO_OPT; kind <= OptimizerOptions::MOVE_RELOCATE; kind <<= 1)
+        if (moves & kind)
+            kinds.push_back(kind);
+
+    vector<int> best = search.tour();
+    double bestLength = search.length();
+    double current = bestLength;
+    double temperature = initial;
+    uniform_real_distribution<> chance(0, 1);
+    for (unsigned long long iteration = 0; ; iteration++) {
+        //Progress through the budget, whichever of time and iterations runs out first;
+        //the clock, and whether some start has already got close enough, are only read every so often
+        if (iteration % 256 == 0) {
+            if (done || bestLength <= target) {
+                done = true;
+                break;
+            }
+            double progress = 0;
+            if (m_options.iterationBudget > 0)
+                progress = (double)iteration / m_options.iterationBudget;
+            if (m_options.timeBudgetMs > 0) {
+                double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+                progress = max(progress, elapsed / m_options.timeBudgetMs);
+            }
+            if (progress >= 1)
+                break;
+            if (m_options.cooling == OptimizerOptions::COOL_LINEAR)
+                temperature = initial + (final - initial) * progress;
+            else
+                temperature = initial * pow(final / initial, progress);
+        }
+        else if (m_options.iterationBudget > 0 && iteration >= m_options.iterationBudget)
+            break;
+
+        unsigned int kind = kinds[randInt(engine, 0, (int)kinds.size() - 1)];
+        double delta;
+        int a, b, c;
+        if (kind == OptimizerOptions::MOVE_TWO_OPT) {
+            a = randInt(engine, 0, n - 3);
+            b = randInt(engine, a + 2, n - 1);
+            delta = search.twoOptDelta(a, b);
+        }
+        else {
+            int length = kind == OptimizerOptions::MOVE_RELOCATE ? 1 : randInt(engine, 2, min(3, n - 2));
+            a = randInt(engine, 1, n - length);
+            b = a + length - 1;
+            //Anywhere outside a - 1 .. b
+            c = randInt(engine, 0, n - length - 2);
+            if (c >= a - 1)
+                c += length + 1;
+            delta = search.moveDelta(a, b, c);
+        }
+        if (delta >= 0 && chance(engine) >= exp(-delta / temperature))
+            continue;
+        if (kind == OptimizerOptions::MOVE_TWO_OPT)
+            search.applyTwoOpt(a, b);
+        else
+            search.applyMove(a, b, c);
+        current += delta;
+        if (current < bestLength - 1e-9) {
+            bestLength = current;
+            best = search.tour();
+        }
+    }
+    search.setTour(best);
 }
 
 //******************** DeliveryOptimizer functions ****************************
@@ -113,3 +355,39 @@ void DeliveryOptimizer::optimizeDeliveryOrder(
 {
     return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
 }
+
+void DeliveryOptimizer::optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        const vector<vector<double>>& distances,
+        double& oldDistance,
+        double& newDistance) const
+{
+    return m_impl->optimizeDeliveryOrder(depot, deliveries, distances, oldDistance, newDistance);
+}
+
+bool DeliveryOptimizer::optimizeFleetOrder(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        const vector<vector<double>>& distances,
+        const vector<Vehicle>& vehicles,
+        vector<vector<DeliveryRequest>>& trips,
+        double& totalDistance) const
+{
+    return m_impl->optimizeFleetOrder(depot, deliveries, distances, vehicles, trips, totalDistance);
+}
+
+void DeliveryOptimizer::setOptions(const OptimizerOptions& options)
+{
+    m_impl->setOptions(options);
+}
+
+OptimizerOptions DeliveryOptimizer::options() const
+{
+    return m_impl->options();
+}
+
+void DeliveryOptimizer::useThreadPool(ThreadPool* pool)
+{
+    m_impl->useThreadPool(pool);
+}
@@ -3,8 +3,29 @@
 #include <string>
 #include <iterator>
 #include <iostream>
+#include <algorithm>
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "Metrics.h"
 using namespace std;
 
+namespace
+{
+    void recordPlan(const PlanMetrics& metrics)
+    {
+        static Histogram& total = metricsHistogram("plan_seconds", "Wall time of one delivery plan");
+        static Histogram& matrix = metricsHistogram("plan_matrix_seconds", "Distance matrix part of one delivery plan");
+        static Histogram& optimize = metricsHistogram("plan_optimize_seconds", "Optimizing part of one delivery plan");
+        static Histogram& route = metricsHistogram("plan_route_seconds", "Leg routing part of one delivery plan");
+        static Histogram& command = metricsHistogram("plan_command_seconds", "Command generation part of one delivery plan");
+        total.record(metrics.totalSeconds);
+        matrix.record(metrics.matrixSeconds);
+        optimize.record(metrics.optimizeSeconds);
+        route.record(metrics.routeSeconds);
+        command.record(metrics.commandSeconds);
+    }
+}
+
 class DeliveryPlannerImpl
 {
 public:
@@ -14,15 +35,52 @@ public:
         const GeoCoord& depot,
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
+        vector<DeliveryEta>& etas,
+        double& totalDistanceTravelled,
+        PlanMetrics* metrics) const;
+    void generateDeliveryPlans(const vector<DeliveryJob>& jobs, vector<DeliveryPlanResult>& results) const;
+    DeliveryResult generateFleetPlan(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        const vector<Vehicle>& vehicles,
+        vector<VehiclePlan>& plans,
         double& totalDistanceTravelled) const;
+    void setOptimizerOptions(const OptimizerOptions& options);
+    void useLegCache(LegCache* cache);
+    void useThreadPool(ThreadPool* pool);
 private:
-    void deliveryCommandGen(list<StreetSegment> toNextSpot, vector<DeliveryCommand>& commands, double& totalDistanceTravelled) const;
+    DeliveryResult planDeliveries(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, vector<DeliveryCommand>& commands, vector<DeliveryEta>& etas, double& totalDistanceTravelled, PlanMetrics* metrics) const;
+    DeliveryResult followOrder(const GeoCoord& depot, const vector<DeliveryRequest>& optimized_deliveries, vector<DeliveryCommand>& commands, vector<DeliveryEta>& etas, double& totalDistanceTravelled, PlanMetrics* metrics) const;
+    void deliveryCommandGen(const list<StreetSegment>& toNextSpot, vector<DeliveryCommand>& commands, double& totalDistanceTravelled) const;
     const StreetMap* m_sm;
+    ThreadPool* m_pool;     // routes jobs, legs and matrix rows concurrently when set
+    //Shared by every plan; both keep their per-query state per thread
+    PointToPointRouter m_router;
+    DeliveryOptimizer m_optimizer;
 };
 
 DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm)
+    : m_router(sm), m_optimizer(sm)
 {
     m_sm = sm;
+    m_pool = nullptr;
+}
+
+void DeliveryPlannerImpl::setOptimizerOptions(const OptimizerOptions& options)
+{
+    m_optimizer.setOptions(options);
+}
+
+void DeliveryPlannerImpl::useLegCache(LegCache* cache)
+{
+    m_router.useLegCache(cache);
+}
+
+void DeliveryPlannerImpl::useThreadPool(ThreadPool* pool)
+{
+    m_pool = pool;
+    m_router.useThreadPool(pool);
+    m_optimizer.useThreadPool(pool);
 }
 
 DeliveryPlannerImpl::~DeliveryPlannerImpl()
@@ -33,58 +91,183 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     const GeoCoord& depot,
     const vector<DeliveryRequest>& deliveries,
     vector<DeliveryCommand>& commands,
-    double& totalDistanceTravelled) const
+    vector<DeliveryEta>& etas,
+    double& totalDistanceTravelled,
+    PlanMetrics* metrics) const
+{
+    //Phases are only timed when the caller asked or the registry is collecting
+    PlanMetrics collected;
+    PlanMetrics* timing = metrics != nullptr ? metrics : metricsEnabled() ? &collected : nullptr;
+    if (timing != nullptr)
+        *timing = PlanMetrics();
+    PhaseTimer timer(timing != nullptr);
+    DeliveryResult result = planDeliveries(depot, deliveries, commands, etas, totalDistanceTravelled, timing);
+    if (timing != nullptr) {
+        timing->totalSeconds = timer.seconds();
+        if (metricsEnabled())
+            recordPlan(*timing);
+    }
+    return result;
+}
+
+DeliveryResult DeliveryPlannerImpl::planDeliveries(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries, vector<DeliveryCommand>& commands, vector<DeliveryEta>& etas, double& totalDistanceTravelled, PlanMetrics* metrics) const
 {
-    //Reset commands and totalDistanceTravelled first
+    //Reset commands, etas and totalDistanceTravelled first
     commands.clear();
+    etas.clear();
     totalDistanceTravelled = 0;
-    cerr << "Call generate Delivery Plan" << endl;
-    //Optimize the route first
-    DeliveryOptimizer optimized(m_sm);
+    LOG_TRACE("Generating a delivery plan for " << deliveries.size() << " deliveries");
+    //Optimize the route first, on road distances between every pair of stops
+    const PointToPointRouter& routes = m_router;
+    vector<vector<double>> distances;
+    PhaseTimer matrixTimer(metrics != nullptr);
+    DeliveryResult matrixResult = metrics != nullptr ? routes.computeDistanceMatrix(depot, deliveries, distances, metrics->routing)
+                                                     : routes.computeDistanceMatrix(depot, deliveries, distances);
+    if (metrics != nullptr)
+        metrics->matrixSeconds = matrixTimer.seconds();
+    if (matrixResult == BAD_COORD) {
+        return matrixResult;
+    }
+    const DeliveryOptimizer& optimized = m_optimizer;
     double x, y;
     vector<DeliveryRequest> optimized_deliveries = deliveries;
-    optimized.optimizeDeliveryOrder(depot, optimized_deliveries, x, y); //x,y Not really used since crowDistance!=actual
+    PhaseTimer optimizeTimer(metrics != nullptr);
+    if (matrixResult == DELIVERY_SUCCESS) {
+        optimized.optimizeDeliveryOrder(depot, optimized_deliveries, distances, x, y);
+    }
+    else { //Some pair is unreachable, crow distances still give an order to try
+        optimized.optimizeDeliveryOrder(depot, optimized_deliveries, x, y);
+    }
+    if (metrics != nullptr)
+        metrics->optimizeSeconds = optimizeTimer.seconds();
 
-    cerr << optimized_deliveries.size() << endl;
+    LOG_TRACE("Delivery order optimized, " << x << " miles before, " << y << " after");
+    return followOrder(depot, optimized_deliveries, commands, etas, totalDistanceTravelled, metrics);
+}
 
+DeliveryResult DeliveryPlannerImpl::followOrder(const GeoCoord& depot, const vector<DeliveryRequest>& optimized_deliveries, vector<DeliveryCommand>& commands, vector<DeliveryEta>& etas, double& totalDistanceTravelled, PlanMetrics* metrics) const
+{
+    const PointToPointRouter& routes = m_router;
     //Inserts depot as a destination to the beginning and the end
-    //Finds routes to every delivery
-    PointToPointRouter routes(m_sm);
-    list<StreetSegment> toNextSpot;
-    double dist;
+    //Finds routes to every delivery; once the order is fixed the legs are independent,
+    //so they may be routed concurrently and are then turned into commands in order
+    size_t legCount = optimized_deliveries.size() + 1;
+    vector<list<StreetSegment>> legs(legCount);
+    vector<DeliveryResult> legResults(legCount);
+    vector<RouteMetrics> legMetrics(metrics != nullptr ? legCount : 0);
+    PhaseTimer routeTimer(metrics != nullptr);
+    auto routeLeg = [&](size_t i) {
+        const GeoCoord& startCoord = i == 0 ? depot : optimized_deliveries[i - 1].location;
+        const GeoCoord& endCoord = i + 1 == legCount ? depot : optimized_deliveries[i].location;
+        double dist;
+        if (metrics != nullptr)
+            legResults[i] = routes.generatePointToPointRoute(startCoord, endCoord, legs[i], dist, legMetrics[i]);
+        else
+            legResults[i] = routes.generatePointToPointRoute(startCoord, endCoord, legs[i], dist);
+    };
+    if (m_pool != nullptr)
+        m_pool->parallelFor(legCount, routeLeg);
+    else
+        for (size_t i = 0; i < legCount; i++)
+            routeLeg(i);
+    PhaseTimer commandTimer(metrics != nullptr);
+    if (metrics != nullptr) {
+        metrics->routeSeconds = routeTimer.seconds();
+        metrics->legs = (unsigned int)legCount;
+        for (size_t i = 0; i < legCount; i++)
+            metrics->routing.add(legMetrics[i]);
+    }
 
-    GeoCoord startCoord = depot; //Begin at depot
+    //The clock runs from leaving the depot: driving, waiting for windows, delivering
+    double minutesPerMile = 60 / m_optimizer.options().speedMph;
+    double clock = 0;
     for (int i = 0; i < (int) optimized_deliveries.size(); i++) { //Through all delivery points
-        cerr << endl << "Delivery number " << i + 1 << endl << endl;
-        GeoCoord endCoord = optimized_deliveries[i].location;
-        //Creates Route to location
-        DeliveryResult result = routes.generatePointToPointRoute(startCoord, endCoord, toNextSpot, dist);
-        if (result != DELIVERY_SUCCESS) { //Either BAD_COORD OR NO_ROUTE
-            return result;
+        if (legResults[i] != DELIVERY_SUCCESS) { //Either BAD_COORD OR NO_ROUTE
+            return legResults[i];
         }
-        cerr << "Generate commands" << endl;
+        LOG_TRACE("Generating commands for delivery number " << i + 1);
         //Generates commands
-        deliveryCommandGen(toNextSpot, commands, totalDistanceTravelled);
-        //Change endCoord to startCoord
-        startCoord = endCoord;
+        double before = totalDistanceTravelled;
+        deliveryCommandGen(legs[i], commands, totalDistanceTravelled);
         //Deliver command
         DeliveryCommand command = DeliveryCommand();
         command.initAsDeliverCommand(optimized_deliveries[i].item);
         commands.push_back(command);
+        const DeliveryRequest& delivery = optimized_deliveries[i];
+        double arrival = clock + (totalDistanceTravelled - before) * minutesPerMile;
+        double start = max(arrival, delivery.earliest);
+        etas.push_back(DeliveryEta(delivery.item, arrival, start, start > delivery.latest));
+        clock = start + delivery.serviceMinutes;
     }
     //From last delivery location back to depot
-    DeliveryResult result = routes.generatePointToPointRoute(startCoord, depot, toNextSpot, dist);
+    DeliveryResult result = legResults[legCount - 1];
     if (result != DELIVERY_SUCCESS) { //Either BAD_COORD OR NO_ROUTE
         return result;
     }
-    deliveryCommandGen(toNextSpot, commands, totalDistanceTravelled);
-    cerr << "Reaches the end" << endl;
+    deliveryCommandGen(legs[legCount - 1], commands, totalDistanceTravelled);
+    if (metrics != nullptr)
+        metrics->commandSeconds = commandTimer.seconds();
+    LOG_TRACE("Plan complete, " << totalDistanceTravelled << " miles");
     return result; //DELIVERY_SUCCESS if reaches
 }
-void DeliveryPlannerImpl::deliveryCommandGen(list<StreetSegment> toNextSpot, vector<DeliveryCommand>& commands, double& totalDistanceTravelled) const {
+
+DeliveryResult DeliveryPlannerImpl::generateFleetPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    const vector<Vehicle>& vehicles,
+    vector<VehiclePlan>& plans,
+    double& totalDistanceTravelled) const
+{
+    plans.assign(vehicles.size(), VehiclePlan());
+    totalDistanceTravelled = 0;
+    //Splitting needs real road distances, so there is no crow-flies fallback here
+    vector<vector<double>> distances;
+    DeliveryResult matrixResult = m_router.computeDistanceMatrix(depot, deliveries, distances);
+    if (matrixResult != DELIVERY_SUCCESS)
+        return matrixResult;
+    vector<vector<DeliveryRequest>> trips;
+    double plannedDistance;
+    if (!m_optimizer.optimizeFleetOrder(depot, deliveries, distances, vehicles, trips, plannedDistance))
+        return OVER_CAPACITY;
+
+    //Each vehicle's trip is a plan of its own from here on
+    vector<DeliveryResult> results(vehicles.size(), DELIVERY_SUCCESS);
+    auto planTrip = [&](size_t v) {
+        plans[v].deliveries = trips[v];
+        if (!trips[v].empty())
+            results[v] = followOrder(depot, trips[v], plans[v].commands, plans[v].etas, plans[v].totalDistanceTravelled, nullptr);
+    };
+    if (m_pool != nullptr)
+        m_pool->parallelFor(vehicles.size(), planTrip);
+    else
+        for (size_t v = 0; v < vehicles.size(); v++)
+            planTrip(v);
+    for (size_t v = 0; v < vehicles.size(); v++) {
+        if (results[v] != DELIVERY_SUCCESS)
+            return results[v];
+        totalDistanceTravelled += plans[v].totalDistanceTravelled;
+    }
+    return DELIVERY_SUCCESS;
+}
+void DeliveryPlannerImpl::generateDeliveryPlans(const vector<DeliveryJob>& jobs, vector<DeliveryPlanResult>& results) const
+{
+    //Jobs are independent; with a pool they run side by side and each one's own legs
+    //and matrix rows spread further over whatever threads are free
+    results.assign(jobs.size(), DeliveryPlanResult());
+    auto planJob = [&](size_t i) {
+        results[i].result = generateDeliveryPlan(jobs[i].depot, jobs[i].deliveries, results[i].commands, results[i].etas, results[i].totalDistanceTravelled, nullptr);
+    };
+    if (m_pool != nullptr)
+        m_pool->parallelFor(jobs.size(), planJob);
+    else
+        for (size_t i = 0; i < jobs.size(); i++)
+            planJob(i);
+}
+
+void DeliveryPlannerImpl::deliveryCommandGen(const list<StreetSegment>& toNextSpot, vector<DeliveryCommand>& commands, double& totalDistanceTravelled) const {
     //Generate route to the next delivery location
     //Create commands to spot
-     cerr << "The size is " << toNextSpot.size() << endl;
+    LOG_TRACE("The leg has " << toNextSpot.size() << " segments");
     for (auto it = toNextSpot.cbegin(); it != toNextSpot.cend(); it++) {
         bool skip = false;
         double distance = distanceEarthMiles(it->start, it->end);
@@ -179,5 +362,59 @@ DeliveryResult DeliveryPlanner::generateDeliveryPlan(
     vector<DeliveryCommand>& commands,
     double& totalDistanceTravelled) const
 {
-    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled);
+    vector<DeliveryEta> etas;
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, etas, totalDistanceTravelled, nullptr);
+}
+
+DeliveryResult DeliveryPlanner::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    vector<DeliveryEta>& etas,
+    double& totalDistanceTravelled) const
+{
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, etas, totalDistanceTravelled, nullptr);
+}
+
+DeliveryResult DeliveryPlanner::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    vector<DeliveryEta>& etas,
+    double& totalDistanceTravelled,
+    PlanMetrics& metrics) const
+{
+    return m_impl->generateDeliveryPlan(depot, deliveries, commands, etas, totalDistanceTravelled, &metrics);
+}
+
+void DeliveryPlanner::generateDeliveryPlans(
+    const vector<DeliveryJob>& jobs,
+    vector<DeliveryPlanResult>& results) const
+{
+    m_impl->generateDeliveryPlans(jobs, results);
+}
+
+DeliveryResult DeliveryPlanner::generateFleetPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    const vector<Vehicle>& vehicles,
+    vector<VehiclePlan>& plans,
+    double& totalDistanceTravelled) const
+{
+    return m_impl->generateFleetPlan(depot, deliveries, vehicles, plans, totalDistanceTravelled);
+}
+
+void DeliveryPlanner::setOptimizerOptions(const OptimizerOptions& options)
+{
+    m_impl->setOptimizerOptions(options);
+}
+
+void DeliveryPlanner::useLegCache(LegCache* cache)
+{
+    m_impl->useLegCache(cache);
+}
+
+void DeliveryPlanner::useThreadPool(ThreadPool* pool)
+{
+    m_impl->useThreadPool(pool);
 }
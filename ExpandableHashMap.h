@@ -2,10 +2,81 @@
 
 // Skeleton for the ExpandableHashMap class template.  You must implement the first six
 // member functions.
+#ifndef EXPANDABLEHASHMAP_INCLUDED
+#define EXPANDABLEHASHMAP_INCLUDED
+
 #include <iostream>
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <type_traits>
 #include "provided.h"
 
-template<typename KeyType, typename ValueType>
+// Allocator policies decide where a map's nodes and bucket arrays live.
+// A policy provides allocate(bytes), deallocate(ptr, bytes) and release(),
+// which frees everything it handed out at once.  FREES_IN_BULK tells the map
+// that release() alone reclaims its memory, so it need not visit each node.
+
+  // One heap allocation per node, the original behaviour
+struct HeapAllocator
+{
+	static const bool FREES_IN_BULK = false;
+	void* allocate(size_t bytes) { return ::operator new(bytes); }
+	void deallocate(void* ptr, size_t) { ::operator delete(ptr); }
+	void release() {}
+};
+
+  // Bump allocation out of large blocks; individual frees are no-ops and
+  // release() rewinds to the first block, keeping the blocks for reuse.
+  // The blocks are returned to the heap when the allocator is destroyed.
+class ArenaAllocator
+{
+public:
+	static const bool FREES_IN_BULK = true;
+	ArenaAllocator() : m_block(0), m_used(0) {}
+	~ArenaAllocator()
+	{
+		for (size_t i = 0; i < m_blocks.size(); i++)
+			::operator delete(m_blocks[i].m_data);
+	}
+	void* allocate(size_t bytes)
+	{
+		bytes = (bytes + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+		while (m_block < m_blocks.size() && m_used + bytes > m_blocks[m_block].m_size) { //current block full, move on
+			m_block++;
+			m_used = 0;
+		}
+		if (m_block == m_blocks.size()) { //out of blocks, each new one twice the last
+			size_t size = m_blocks.empty() ? FIRST_BLOCK : m_blocks.back().m_size * 2;
+			while (size < bytes)
+				size *= 2;
+			Block block = { static_cast<char*>(::operator new(size)), size };
+			m_blocks.push_back(block);
+		}
+		void* ptr = m_blocks[m_block].m_data + m_used;
+		m_used += bytes;
+		return ptr;
+	}
+	void deallocate(void*, size_t) {}
+	void release()
+	{
+		m_block = 0;
+		m_used = 0;
+	}
+	ArenaAllocator(const ArenaAllocator&) = delete;
+	ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+private:
+	static const size_t FIRST_BLOCK = 4096;
+	struct Block {
+		char* m_data;
+		size_t m_size;
+	};
+	std::vector<Block> m_blocks;
+	size_t m_block;		// block currently being carved up
+	size_t m_used;		// bytes used in that block
+};
+
+template<typename KeyType, typename ValueType, typename Allocator = HeapAllocator>
 class ExpandableHashMap
 {
 public:
@@ -38,49 +109,45 @@ private:
 		HashNode* m_next;
 	}; 
 	unsigned int getBucketNumber(const KeyType& key) const;
+	HashNode** newTable(unsigned int buckets);
 	void deleteTable();
 	void rehash();
+	Allocator m_alloc;
 	double m_loadFactor;
 	unsigned int m_buckets;
 	unsigned int m_count;
 	HashNode** m_table;
 };
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFactor)
+template<typename KeyType, typename ValueType, typename Allocator>
+ExpandableHashMap<KeyType, ValueType, Allocator>::ExpandableHashMap(double maximumLoadFactor)
 {
 	//Default values with nullptrs
 	m_buckets = 8;
 	m_loadFactor = maximumLoadFactor;
 	m_count = 0;
-	m_table = new HashNode*[m_buckets];
-	for (unsigned int i = 0; i < m_buckets; i++) {
-		m_table[i] = nullptr;
-	}
+	m_table = newTable(m_buckets);
 }
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::~ExpandableHashMap()
+template<typename KeyType, typename ValueType, typename Allocator>
+ExpandableHashMap<KeyType, ValueType, Allocator>::~ExpandableHashMap()
 {
 	deleteTable();
 }
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::reset()
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::reset()
 {
 	deleteTable(); 
 	//Reset table with default values
 	m_buckets = 8;
 	m_count = 0;
-	m_table = new HashNode*[m_buckets];
-	for (unsigned int i = 0; i < m_buckets; i++) {
-		m_table[i] = nullptr;
-	}
+	m_table = newTable(m_buckets);
 }
-template<typename KeyType, typename ValueType>
-int ExpandableHashMap<KeyType, ValueType>::size() const
+template<typename KeyType, typename ValueType, typename Allocator>
+int ExpandableHashMap<KeyType, ValueType, Allocator>::size() const
 {
 	return m_count;
 }
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::associate(const KeyType& key, const ValueType& value)
 {
 	unsigned int ID = getBucketNumber(key); //hashkey location
 	HashNode* ptr = m_table[ID];
@@ -92,7 +159,7 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
 		ptr = ptr->m_next;
 	}
 	//No duplicate, insert at front, rehash called if above max loadfactor
-	HashNode* newNode = new HashNode(key, value);
+	HashNode* newNode = new (m_alloc.allocate(sizeof(HashNode))) HashNode(key, value);
 	newNode->m_next = m_table[ID]; //Insertion at front
 	m_table[ID] = newNode;
 	m_count++;
@@ -100,8 +167,8 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
 		rehash();
 	}
 }
-template<typename KeyType, typename ValueType>
-const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key) const
+template<typename KeyType, typename ValueType, typename Allocator>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Allocator>::find(const KeyType& key) const
 {
 	unsigned int ID = getBucketNumber(key); //Same value if keys are same
 	HashNode* ptr = m_table[ID];
@@ -114,32 +181,45 @@ const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key)
 	return nullptr; //Not found
 }
 
-template<typename KeyType, typename ValueType>
-unsigned int ExpandableHashMap<KeyType, ValueType>::getBucketNumber(const KeyType& key) const { //Helper function to make bucket ID
+template<typename KeyType, typename ValueType, typename Allocator>
+unsigned int ExpandableHashMap<KeyType, ValueType, Allocator>::getBucketNumber(const KeyType& key) const { //Helper function to make bucket ID
 	unsigned int hasher(const KeyType & k);  // prototype function
 	unsigned int h = hasher(key);
 	return h % m_buckets;
 }
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::deleteTable() {
-	for (unsigned int i = 0; i < m_buckets; i++) {
-		HashNode* ptr = m_table[i];
-		while (ptr != nullptr) { //Deletes all linked HashNodes
-			HashNode* tempPtr = ptr->m_next;
-			delete ptr;
-			ptr = tempPtr;
+template<typename KeyType, typename ValueType, typename Allocator>
+typename ExpandableHashMap<KeyType, ValueType, Allocator>::HashNode** ExpandableHashMap<KeyType, ValueType, Allocator>::newTable(unsigned int buckets) {
+	//Bucket array of nullptrs from the allocator
+	HashNode** table = static_cast<HashNode**>(m_alloc.allocate(buckets * sizeof(HashNode*)));
+	for (unsigned int i = 0; i < buckets; i++) {
+		table[i] = nullptr;
+	}
+	return table;
+}
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::deleteTable() {
+	//An arena holding trivially destructible entries is freed in one step, without walking the chains
+	const bool walkNodes = !Allocator::FREES_IN_BULK
+		|| !std::is_trivially_destructible<KeyType>::value || !std::is_trivially_destructible<ValueType>::value;
+	if (walkNodes) {
+		for (unsigned int i = 0; i < m_buckets; i++) {
+			HashNode* ptr = m_table[i];
+			while (ptr != nullptr) { //Deletes all linked HashNodes
+				HashNode* tempPtr = ptr->m_next;
+				ptr->~HashNode();
+				m_alloc.deallocate(ptr, sizeof(HashNode));
+				ptr = tempPtr;
+			}
 		}
 	}
-	delete[] m_table; //Deletes new table
+	m_alloc.deallocate(m_table, m_buckets * sizeof(HashNode*)); //Deletes new table
+	m_alloc.release();
 }
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::rehash() {
+template<typename KeyType, typename ValueType, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Allocator>::rehash() {
 	unsigned int hasher(const KeyType & k);  // Prototype function
 	unsigned int m_newBuckets = m_buckets * 2; //Resize
-	HashNode** m_tempTable = new HashNode* [m_newBuckets];
-	for (unsigned int i = 0; i < m_newBuckets; i++) { //Sets to default nullptr in new table
-		m_tempTable[i] = nullptr;
-	}
+	HashNode** m_tempTable = newTable(m_newBuckets); //Sets to default nullptr in new table
 	for (unsigned int i = 0; i < m_buckets; i++) { //Copies to new array
 		HashNode* ptr = m_table[i];
 			while (ptr != nullptr) { //not empty
@@ -150,7 +230,9 @@ void ExpandableHashMap<KeyType, ValueType>::rehash() {
 				ptr = tempPtr; //next in original linked list
 			}
 	}
-	delete[] m_table; //deletes old array, keeps values
+	m_alloc.deallocate(m_table, m_buckets * sizeof(HashNode*)); //deletes old array, keeps values
 	m_buckets = m_newBuckets; //replaces old table with new
 	m_table = m_tempTable;
-}
\ No newline at end of file
+}
+
+#endif // EXPANDABLEHASHMAP_INCLUDED
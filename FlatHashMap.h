@@ -0,0 +1,242 @@
+// FlatHashMap.h
+
+// Open-addressing counterpart to ExpandableHashMap.  Entries live in one
+// contiguous slot array and collisions are resolved with Robin Hood linear
+// probing, so a find touches one or two cache lines instead of a chain of
+// separately allocated nodes.  Like ExpandableHashMap it hashes keys with a
+// free function  unsigned int hasher(const KeyType&).
+//
+// Each slot has a 32-bit metadata word: the low 8 bits hold the probe distance
+// plus one, the high 24 bits the generation the slot was written in.  A slot is
+// occupied only if its generation is current, which is what makes clear() O(1).
+
+#ifndef FLATHASHMAP_INCLUDED
+#define FLATHASHMAP_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+template<typename KeyType, typename ValueType>
+class FlatHashMap
+{
+public:
+	FlatHashMap(double maximumLoadFactor = 0.5);
+	void reset();		// empties the map and releases its storage
+	void clear();		// empties the map in O(1), keeping its capacity
+	void reserve(unsigned int count);
+	int size() const;
+	void associate(const KeyType& key, const ValueType& value);
+	bool erase(const KeyType& key);
+
+	  // for a map that can't be modified, return a pointer to const ValueType
+	const ValueType* find(const KeyType& key) const;
+
+	  // for a modifiable map, return a pointer to modifiable ValueType
+	ValueType* find(const KeyType& key)
+	{
+		return const_cast<ValueType*>(const_cast<const FlatHashMap*>(this)->find(key));
+	}
+
+	  // starts loading key's home slot into cache; a batch of finds is much faster when
+	  // each is prefetched a few finds ahead of time
+	void prefetch(const KeyType& key) const;
+
+	  // Iteration visits occupied slots in table order: for (auto& entry : map) entry.key(), entry.value()
+	class iterator
+	{
+	public:
+		iterator(FlatHashMap* map, unsigned int slot) : m_map(map), m_slot(slot) { skipEmpty(); }
+		const KeyType& key() const { return m_map->m_slots[m_slot].m_key; }
+		ValueType& value() const { return m_map->m_slots[m_slot].m_value; }
+		iterator& operator*() { return *this; }
+		iterator& operator++() { m_slot++; skipEmpty(); return *this; }
+		bool operator!=(const iterator& other) const { return m_slot != other.m_slot; }
+		bool operator==(const iterator& other) const { return m_slot == other.m_slot; }
+	private:
+		void skipEmpty()
+		{
+			while (m_slot < m_map->capacity() && !m_map->occupied(m_slot))
+				m_slot++;
+		}
+		FlatHashMap* m_map;
+		unsigned int m_slot;
+	};
+	iterator begin() { return iterator(this, 0); }
+	iterator end() { return iterator(this, capacity()); }
+
+	  // C++11 syntax for preventing copying and assignment
+	FlatHashMap(const FlatHashMap&) = delete;
+	FlatHashMap& operator=(const FlatHashMap&) = delete;
+
+private:
+	struct Slot { //Metadata word, then the entry itself
+		uint32_t m_meta;
+		KeyType m_key;
+		ValueType m_value;
+	};
+	static const unsigned int INITIAL_SLOTS = 8;
+	static const uint32_t MAX_DISTANCE = 255;
+	unsigned int capacity() const { return (unsigned int)m_slots.size(); }
+	bool occupied(unsigned int slot) const { return (m_slots[slot].m_meta >> 8) == m_generation; }
+	uint32_t distance(unsigned int slot) const { return m_slots[slot].m_meta & 0xff; }
+	unsigned int homeSlot(const KeyType& key) const;
+	void resize(unsigned int slots);
+	void insertNew(KeyType key, ValueType value);
+	double m_loadFactor;
+	unsigned int m_count;
+	unsigned int m_shift;		// 32 - log2(capacity), for Fibonacci hashing
+	uint32_t m_generation;
+	std::vector<Slot> m_slots;
+};
+template<typename KeyType, typename ValueType>
+FlatHashMap<KeyType, ValueType>::FlatHashMap(double maximumLoadFactor)
+{
+	m_loadFactor = maximumLoadFactor;
+	reset();
+}
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::reset()
+{
+	//Default size, all storage released
+	std::vector<Slot>().swap(m_slots);
+	m_count = 0;
+	m_generation = 1;
+	resize(INITIAL_SLOTS);
+}
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::clear()
+{
+	//Stale slots keep their keys and values until overwritten, they just stop counting as occupied
+	m_count = 0;
+	m_generation = (m_generation + 1) & 0xffffff;
+	if (m_generation == 0) { //wrapped, old generations could look current again
+		for (unsigned int i = 0; i < capacity(); i++)
+			m_slots[i].m_meta = 0;
+		m_generation = 1;
+	}
+}
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::reserve(unsigned int count)
+{
+	unsigned int slots = capacity();
+	while (count > slots * m_loadFactor)
+		slots *= 2;
+	if (slots != capacity())
+		resize(slots);
+}
+template<typename KeyType, typename ValueType>
+int FlatHashMap<KeyType, ValueType>::size() const
+{
+	return m_count;
+}
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+{
+	ValueType* existing = find(key);
+	if (existing != nullptr) { //Duplicate key, replaces value
+		*existing = value;
+		return;
+	}
+	if (m_count + 1 > capacity() * m_loadFactor) //Would exceed max loadfactor
+		resize(capacity() * 2);
+	insertNew(key, value);
+	m_count++;
+}
+template<typename KeyType, typename ValueType>
+bool FlatHashMap<KeyType, ValueType>::erase(const KeyType& key)
+{
+	const ValueType* value = find(key);
+	if (value == nullptr)
+		return false;
+	unsigned int mask = capacity() - 1;
+	unsigned int slot = (unsigned int)((const char*)value - (const char*)m_slots.data()) / sizeof(Slot);
+	//Backward shift: pull each following displaced entry one slot closer to home
+	unsigned int next = (slot + 1) & mask;
+	while (occupied(next) && distance(next) > 1) {
+		m_slots[slot] = m_slots[next];
+		m_slots[slot].m_meta--;
+		slot = next;
+		next = (next + 1) & mask;
+	}
+	m_slots[slot].m_meta = 0;
+	m_count--;
+	return true;
+}
+template<typename KeyType, typename ValueType>
+const ValueType* FlatHashMap<KeyType, ValueType>::find(const KeyType& key) const
+{
+	unsigned int mask = capacity() - 1;
+	unsigned int slot = homeSlot(key);
+	for (uint32_t dist = 1; ; dist++) {
+		//An empty slot, or one closer to its home than we are to ours, ends the search
+		if (!occupied(slot) || distance(slot) < dist)
+			return nullptr;
+		if (m_slots[slot].m_key == key)
+			return &m_slots[slot].m_value;
+		slot = (slot + 1) & mask;
+	}
+}
+
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::prefetch(const KeyType& key) const
+{
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(&m_slots[homeSlot(key)]);
+#else
+	(void)key;
+#endif
+}
+
+template<typename KeyType, typename ValueType>
+unsigned int FlatHashMap<KeyType, ValueType>::homeSlot(const KeyType& key) const { //Helper function to make slot ID
+	unsigned int hasher(const KeyType & k);  // prototype function
+	return (unsigned int)((uint32_t)(hasher(key) * 2654435769u) >> m_shift);
+}
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::resize(unsigned int slots) {
+	std::vector<Slot> oldSlots(slots);
+	for (unsigned int i = 0; i < slots; i++)
+		oldSlots[i].m_meta = 0;
+	oldSlots.swap(m_slots);
+	uint32_t oldGeneration = m_generation;
+	m_generation = 1;
+	m_shift = 32;
+	for (unsigned int s = slots; s > 1; s /= 2)
+		m_shift--;
+	for (unsigned int i = 0; i < oldSlots.size(); i++) { //Reinserts live entries into the new array
+		if ((oldSlots[i].m_meta >> 8) == oldGeneration)
+			insertNew(oldSlots[i].m_key, oldSlots[i].m_value);
+	}
+}
+template<typename KeyType, typename ValueType>
+void FlatHashMap<KeyType, ValueType>::insertNew(KeyType key, ValueType value) {
+	//Robin Hood: take the slot from any entry that is nearer its home than we are to ours
+	unsigned int mask = capacity() - 1;
+	unsigned int slot = homeSlot(key);
+	for (uint32_t dist = 1; ; dist++) {
+		if (dist > MAX_DISTANCE) { //Probe distance no longer fits in the metadata byte
+			resize(capacity() * 2); //whatever entry is in hand now gets placed in the bigger table
+			mask = capacity() - 1;
+			slot = homeSlot(key);
+			dist = 1;
+		}
+		Slot& entry = m_slots[slot];
+		if (!occupied(slot)) {
+			entry.m_key = key;
+			entry.m_value = value;
+			entry.m_meta = (m_generation << 8) | dist;
+			return;
+		}
+		if (distance(slot) < dist) {
+			std::swap(key, entry.m_key);
+			std::swap(value, entry.m_value);
+			uint32_t displaced = distance(slot);
+			entry.m_meta = (m_generation << 8) | dist;
+			dist = displaced;
+		}
+		slot = (slot + 1) & mask;
+	}
+}
+
+#endif // FLATHASHMAP_INCLUDED
@@ -0,0 +1,396 @@
+#include "FleetSearch.h"
+#include <algorithm>
+#include <numeric>
+using namespace std;
+
+namespace
+{
+    const double IMPROVEMENT = 1e-10;   // smaller gains are rounding noise and could cycle forever
+    const size_t CLOSING_CHAINS = 300;  // savings pairs up leftover trips one by one below this many
+
+    struct Saving
+    {
+        double saved;
+        int tail;
+        int head;
+    };
+
+      // Union-find root, halving the path on the way
+    int findRoot(vector<int>& parent, int i)
+    {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+}
+
+FleetSearch::FleetSearch(const vector<vector<double>>& distances, const vector<double>& weights,
+    const vector<Vehicle>& vehicles, unsigned int neighbourCount)
+    : m_n((int)distances.size()), m_dist(distances), m_weights(weights), m_vehicles(vehicles)
+{
+    m_weights.resize(m_n, 0);
+    m_weights[0] = 0;
+
+    //Nearest by the round trip, as in TourSearch, leaving out the depot
+    m_neighbours.resize(m_n);
+    vector<int> others;
+    for (int a = 1; a < m_n; a++) {
+        others.clear();
+        for (int c = 1; c < m_n; c++)
+            if (c != a)
+                others.push_back(c);
+        size_t keep = min((size_t)neighbourCount, others.size());
+        partial_sort(others.begin(), others.begin() + keep, others.end(), [&](int x, int y) {
+            return distance(a, x) + distance(x, a) < distance(a, y) + distance(y, a);
+        });
+        m_neighbours[a].assign(others.begin(), others.begin() + keep);
+    }
+
+    int nodes = m_n + (int)m_vehicles.size();
+    m_next.resize(nodes);
+    m_prev.resize(nodes);
+    m_vehicle.assign(m_n, -1);
+    m_items.assign(m_vehicles.size(), 0);
+    m_load.assign(m_vehicles.size(), 0);
+}
+
+double FleetSearch::distance(int from, int to) const
+{
+    //Every vehicle's copy of the depot is the depot
+    return m_dist[from < m_n ? from : 0][to < m_n ? to : 0];
+}
+
+bool FleetSearch::fits(int vehicle, int items, double weight) const
+{
+    return m_items[vehicle] + items <= (int)m_vehicles[vehicle].maxItems
+        && m_load[vehicle] + weight <= m_vehicles[vehicle].maxWeight + 1e-9;
+}
+
+void FleetSearch::setTrips(const vector<vector<int>>& trips)
+{
+    for (int v = 0; v < vehicles(); v++) {
+        int depot = m_n + v;
+        m_next[depot] = depot;
+        m_prev[depot] = depot;
+        m_items[v] = 0;
+        m_load[v] = 0;
+        for (int stop : trips[v])
+            insertAfter(stop, m_prev[depot]);
+    }
+}
+
+void FleetSearch::unlink(int stop)
+{
+    m_next[m_prev[stop]] = m_next[stop];
+    m_prev[m_next[stop]] = m_prev[stop];
+    m_items[m_vehicle[stop]]--;
+    m_load[m_vehicle[stop]] -= m_weights[stop];
+}
+
+void FleetSearch::insertAfter(int stop, int after)
+{
+    int v = after < m_n ? m_vehicle[after] : after - m_n;
+    m_vehicle[stop] = v;
+    m_items[v]++;
+    m_load[v] += m_weights[stop];
+    m_prev[stop] = after;
+    m_next[stop] = m_next[after];
+    m_prev[m_next[after]] = stop;
+    m_next[after] = stop;
+}
+
+double FleetSearch::length() const
+{
+    double total = 0;
+    for (int v = 0; v < vehicles(); v++) {
+        int depot = m_n + v;
+        int node = depot;
+        do {
+            total += distance(node, m_next[node]);
+            node = m_next[node];
+        } while (node != depot);
+    }
+    return total;
+}
+
+vector<int> FleetSearch::trip(int vehicle) const
+{
+    vector<int> stops;
+    int depot = m_n + vehicle;
+    for (int node = m_next[depot]; node != depot; node = m_next[node])
+        stops.push_back(node);
+    return stops;
+}
+
+bool FleetSearch::savings()
+{
+    //Chains of stops with their loads kept at the union-find root; a chain's last stop
+    //may be joined to another's first
+    vector<int> parent(m_n), after(m_n, -1), before(m_n, -1), items(m_n, 1);
+    vector<double> load(m_weights);
+    iota(parent.begin(), parent.end(), 0);
+    auto fitsSome = [&](int chainItems, double chainLoad) {
+        for (const Vehicle& vehicle : m_vehicles)
+            if (chainItems <= (int)vehicle.maxItems && chainLoad <= vehicle.maxWeight + 1e-9)
+                return true;
+        return false;
+    };
+    for (int i = 1; i < m_n; i++)
+        if (!fitsSome(1, m_weights[i]))
+            return false;
+    auto join = [&](int tail, int head) {
+        int a = findRoot(parent, tail), b = findRoot(parent, head);
+        if (after[tail] != -1 || before[head] != -1 || a == b || !fitsSome(items[a] + items[b], load[a] + load[b]))
+            return false;
+        after[tail] = head;
+        before[head] = tail;
+        parent[b] = a;
+        items[a] += items[b];
+        load[a] += load[b];
+        return true;
+    };
+
+    vector<Saving> candidates;
+    for (int i = 1; i < m_n; i++) {
+        for (int j : m_neighbours[i]) {
+            Saving ij = { distance(i, 0) + distance(0, j) - distance(i, j), i, j };
+            Saving ji = { distance(j, 0) + distance(0, i) - distance(j, i), j, i };
+            if (ij.saved > 0)
+                candidates.push_back(ij);
+            if (ji.saved > 0)
+                candidates.push_back(ji);
+        }
+    }
+    sort(candidates.begin(), candidates.end(), [](const Saving& x, const Saving& y) {
+        if (x.saved != y.saved)
+            return x.saved > y.saved;
+        return x.tail != y.tail ? x.tail < y.tail : x.head < y.head;
+    });
+    for (const Saving& s : candidates)
+        join(s.tail, s.head);
+
+    //Too many chains left for the fleet: join the best remaining pair, saving or not,
+    //while there are few enough to compare every pair
+    vector<int> heads;
+    for (int i = 1; i < m_n; i++)
+        if (before[i] == -1)
+            heads.push_back(i);
+    while (heads.size() > m_vehicles.size() && heads.size() <= CLOSING_CHAINS) {
+        vector<int> tails(heads.size());
+        for (size_t c = 0; c < heads.size(); c++) {
+            int t = heads[c];
+            while (after[t] != -1)
+                t = after[t];
+            tails[c] = t;
+        }
+        int bestTail = -1, bestHead = -1;
+        size_t bestChain = 0;
+        double bestSaved = 0;
+        for (size_t a = 0; a < heads.size(); a++) {
+            for (size_t b = 0; b < heads.size(); b++) {
+                int ra = findRoot(parent, heads[a]), rb = findRoot(parent, heads[b]);
+                if (a == b || !fitsSome(items[ra] + items[rb], load[ra] + load[rb]))
+                    continue;
+                double saved = distance(tails[a], 0) + distance(0, heads[b]) - distance(tails[a], heads[b]);
+                if (bestTail == -1 || saved > bestSaved) {
+                    bestTail = tails[a];
+                    bestHead = heads[b];
+                    bestChain = b;
+                    bestSaved = saved;
+                }
+            }
+        }
+        if (bestTail == -1)
+            return false;
+        join(bestTail, bestHead);
+        heads.erase(heads.begin() + bestChain);
+    }
+    if (heads.size() > m_vehicles.size())
+        return false;
+
+    //Heaviest chain first, each onto the free vehicle it fits most snugly
+    sort(heads.begin(), heads.end(), [&](int x, int y) {
+        int rx = findRoot(parent, x), ry = findRoot(parent, y);
+        return load[rx] != load[ry] ? load[rx] > load[ry] : items[rx] > items[ry];
+    });
+    vector<vector<int>> trips(m_vehicles.size());
+    vector<char> used(m_vehicles.size(), 0);
+    for (int head : heads) {
+        int root = findRoot(parent, head);
+        int chosen = -1;
+        for (int v = 0; v < vehicles(); v++) {
+            if (used[v] || items[root] > (int)m_vehicles[v].maxItems || load[root] > m_vehicles[v].maxWeight + 1e-9)
+                continue;
+            if (chosen == -1 || m_vehicles[v].maxWeight < m_vehicles[chosen].maxWeight)
+                chosen = v;
+        }
+        if (chosen == -1)
+            return false;
+        used[chosen] = 1;
+        for (int stop = head; stop != -1; stop = after[stop])
+            trips[chosen].push_back(stop);
+    }
+    setTrips(trips);
+    return true;
+}
+
+bool FleetSearch::sweep(const vector<double>& bearings)
+{
+    //Roomiest vehicles first, so small ones take the remainders
+    vector<int> stops(m_n - 1), order(m_vehicles.size());
+    iota(stops.begin(), stops.end(), 1);
+    iota(order.begin(), order.end(), 0);
+    sort(stops.begin(), stops.end(), [&](int x, int y) { return bearings[x] < bearings[y]; });
+    stable_sort(order.begin(), order.end(), [&](int x, int y) {
+        return m_vehicles[x].maxWeight != m_vehicles[y].maxWeight ? m_vehicles[x].maxWeight > m_vehicles[y].maxWeight
+                                                                  : m_vehicles[x].maxItems > m_vehicles[y].maxItems;
+    });
+
+    //The sweep may start anywhere round the circle; try a few places and keep the shortest
+    const size_t STARTS = 8;
+    vector<vector<int>> best;
+    double bestLength = 0;
+    size_t tries = min(STARTS, max(stops.size(), (size_t)1));
+    for (size_t t = 0; t < tries; t++) {
+        size_t first = t * stops.size() / tries;
+        vector<vector<int>> trips(m_vehicles.size());
+        size_t current = 0;
+        int items = 0;
+        double load = 0;
+        bool fitted = true;
+        for (size_t k = 0; k < stops.size() && fitted; k++) {
+            int stop = stops[(first + k) % stops.size()];
+            while (current < order.size() && (items + 1 > (int)m_vehicles[order[current]].maxItems
+                || load + m_weights[stop] > m_vehicles[order[current]].maxWeight + 1e-9)) {
+                current++;
+                items = 0;
+                load = 0;
+            }
+            if (current == order.size()) {
+                fitted = false;
+                break;
+            }
+            trips[order[current]].push_back(stop);
+            items++;
+            load += m_weights[stop];
+        }
+        if (!fitted)
+            continue;
+        double length = 0;
+        for (const vector<int>& trip : trips)
+            for (size_t k = 0; k <= trip.size() && !trip.empty(); k++)
+                length += distance(k == 0 ? 0 : trip[k - 1], k == trip.size() ? 0 : trip[k]);
+        if (best.empty() || length < bestLength) {
+            best = trips;
+            bestLength = length;
+        }
+    }
+    if (best.empty())
+        return false;
+    setTrips(best);
+    return true;
+}
+
+bool FleetSearch::pack()
+{
+    vector<int> stops(m_n - 1);
+    iota(stops.begin(), stops.end(), 1);
+    stable_sort(stops.begin(), stops.end(), [&](int x, int y) { return m_weights[x] > m_weights[y]; });
+    vector<vector<int>> trips(m_vehicles.size());
+    vector<int> items(m_vehicles.size(), 0);
+    vector<double> load(m_vehicles.size(), 0);
+    for (int stop : stops) {
+        int chosen = -1;
+        double spare = 0;
+        for (int v = 0; v < vehicles(); v++) {
+            double left = m_vehicles[v].maxWeight - load[v] - m_weights[stop];
+            if (items[v] + 1 > (int)m_vehicles[v].maxItems || left < -1e-9)
+                continue;
+            if (chosen == -1 || left > spare) {
+                chosen = v;
+                spare = left;
+            }
+        }
+        if (chosen == -1)
+            return false;
+        trips[chosen].push_back(stop);
+        items[chosen]++;
+        load[chosen] += m_weights[stop];
+    }
+    setTrips(trips);
+    return true;
+}
+
+void FleetSearch::wake(int node)
+{
+    if (node < 1 || node >= m_n || m_active[node])
+        return;
+    m_active[node] = 1;
+    m_queue.push_back(node);
+}
+
+bool FleetSearch::improveStop(int stop)
+{
+    //First improving move that puts stop next to one of its neighbours on another trip
+    int before = m_prev[stop], after = m_next[stop];
+    int own = m_vehicle[stop];
+    double removed = distance(before, stop) + distance(stop, after) - distance(before, after);
+    for (int c : m_neighbours[stop]) {
+        int other = m_vehicle[c];
+        if (other == own)
+            continue;
+
+        //Relocate: just after c or just before it
+        if (fits(other, 1, m_weights[stop])) {
+            int places[2] = { c, m_prev[c] };
+            for (int a : places) {
+                int b = m_next[a];
+                if (distance(a, stop) + distance(stop, b) - distance(a, b) - removed < -IMPROVEMENT) {
+                    int touched[4] = { before, after, a, b };
+                    unlink(stop);
+                    insertAfter(stop, a);
+                    for (int node : touched)
+                        wake(node);
+                    return true;
+                }
+            }
+        }
+
+        //Swap: stop takes c's place and c takes stop's
+        double shift = m_weights[c] - m_weights[stop];
+        if (fits(own, 0, shift) && fits(other, 0, -shift)) {
+            int cBefore = m_prev[c], cAfter = m_next[c];
+            double delta = distance(before, c) + distance(c, after) + distance(cBefore, stop) + distance(stop, cAfter)
+                         - distance(before, stop) - distance(stop, after) - distance(cBefore, c) - distance(c, cAfter);
+            if (delta < -IMPROVEMENT) {
+                unlink(stop);
+                unlink(c);
+                insertAfter(c, before);
+                insertAfter(stop, cBefore);
+                int touched[5] = { before, after, cBefore, cAfter, c };
+                for (int node : touched)
+                    wake(node);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+double FleetSearch::improve()
+{
+    m_active.assign(m_n, 1);
+    m_queue.clear();
+    for (int stop = 1; stop < m_n; stop++)
+        m_queue.push_back(stop);
+    while (!m_queue.empty()) {
+        int stop = m_queue.front();
+        m_queue.pop_front();
+        m_active[stop] = 0;
+        if (improveStop(stop))
+            wake(stop); //its surroundings changed, try it again
+    }
+    return length();
+}
@@ -0,0 +1,69 @@
+// FleetSearch.h
+
+// Splits the stops of a distance matrix among several vehicles, each making
+// one trip from the depot, stop 0, without going over its limits on items
+// (one per stop) and weight.  A plan is built by one of three constructions:
+//   savings  every stop starts on a trip of its own, and trips are joined end
+//            to start in order of the distance that saves, while they fit
+//   sweep    stops are taken in order of bearing from the depot and each
+//            vehicle is filled in turn
+//   pack     the heaviest stops first, each onto the vehicle with the most
+//            weight to spare; a last resort for tight limits
+// and then improved by moving a stop from one trip to another, or swapping two
+// stops between trips, until neither shortens the plan.  As in TourSearch,
+// only moves that put a stop next to one of its nearest neighbours are tried,
+// and stops whose surroundings have not changed are skipped.  Each trip is a
+// linked list that starts and ends at a copy of the depot of its own, so every
+// move is evaluated and applied in O(1); ordering within a trip is left to
+// TourSearch.
+
+#ifndef FLEETSEARCH_INCLUDED
+#define FLEETSEARCH_INCLUDED
+
+#include "provided.h"
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+class FleetSearch
+{
+public:
+      // weights[i] is stop i's; weights[0], the depot's, is ignored
+    FleetSearch(const std::vector<std::vector<double>>& distances, const std::vector<double>& weights,
+        const std::vector<Vehicle>& vehicles, unsigned int neighbourCount = 20);
+
+      // each builds a whole plan, replacing the current one, or returns false,
+      // leaving it alone, if the stops do not all fit that way
+    bool savings();
+    bool sweep(const std::vector<double>& bearings);   // bearings[i]: stop i's from the depot, in radians
+    bool pack();
+    void setTrips(const std::vector<std::vector<int>>& trips);  // trips[v] for vehicle v, which must fit
+
+    double improve();                                   // to a local optimum, returns the new length
+    double length() const;
+    std::vector<int> trip(int vehicle) const;           // stops in order, without the depot
+    int vehicles() const { return (int)m_vehicles.size(); }
+private:
+    double distance(int from, int to) const;
+    bool fits(int vehicle, int items, double weight) const;
+    void unlink(int stop);
+    void insertAfter(int stop, int after);
+    bool improveStop(int stop);
+    void wake(int node);
+
+    int m_n;                                    // stops, depot included
+    const std::vector<std::vector<double>>& m_dist;    // the caller's, which must outlive the search
+    std::vector<double> m_weights;
+    std::vector<Vehicle> m_vehicles;
+    std::vector<std::vector<int>> m_neighbours; // nearest stops first, either direction
+      // Nodes 1 .. m_n - 1 are stops; node m_n + v is vehicle v's copy of the depot
+    std::vector<int> m_next;
+    std::vector<int> m_prev;
+    std::vector<int> m_vehicle;                 // the trip each stop is on
+    std::vector<int> m_items;                   // per vehicle
+    std::vector<double> m_load;                 // weight carried, per vehicle
+    std::vector<char> m_active;
+    std::deque<int> m_queue;
+};
+
+#endif // FLEETSEARCH_INCLUDED
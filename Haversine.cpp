@@ -0,0 +1,326 @@
+#include "provided.h"
+#include "Haversine.h"
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HAVERSINE_HAS_SSE2 1
+#include <emmintrin.h>
+#endif
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define HAVERSINE_HAS_AVX2 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+namespace
+{
+    const double EARTH_DIAMETER_KM = 2.0 * 6371.0;
+    const double MILES_PER_KM = 1 / 1.609344;
+
+    //pi, pi/2 and pi/4 with the part a double cannot hold, so reducing an angle by them is exact
+    const double PI_HI = 3.14159265358979311600e+00;
+    const double PI_LO = 1.22464679914735317720e-16;
+    const double PIO2_HI = 1.57079632679489655800e+00;
+    const double PIO2_LO = 6.12323399573676588610e-17;
+    const double PIO4 = 7.85398163397448278999e-01;
+
+    //sin x = x + x^3 (S3 + x^2 (S5 + ...)), Taylor to x^17: the next term is under 1e-19 on [0, pi/4]
+    const double S3 = -1.0 / 6;
+    const double S5 = 1.0 / 120;
+    const double S7 = -1.0 / 5040;
+    const double S9 = 1.0 / 362880;
+    const double S11 = -1.0 / 39916800;
+    const double S13 = 1.0 / 6227020800.0;
+    const double S15 = -1.0 / 1307674368000.0;
+    const double S17 = 1.0 / 355687428096000.0;
+
+    //fdlibm's asin on [0, 0.5]: asin x = x + x t P(t) / Q(t) with t = x^2
+    const double PS0 = 1.66666666666666657415e-01;
+    const double PS1 = -3.25565818622400915405e-01;
+    const double PS2 = 2.01212532134862925881e-01;
+    const double PS3 = -4.00555345006794114027e-02;
+    const double PS4 = 7.91534994289814532176e-04;
+    const double PS5 = 3.47933107596021167570e-05;
+    const double QS1 = -2.40339491173441421878e+00;
+    const double QS2 = 2.02094576023350569471e+00;
+    const double QS3 = -6.88283971605453293030e-01;
+    const double QS4 = 7.70381505559019352791e-02;
+
+    typedef void (*OneToManyKernel)(double, double, double, const double*, const double*, const double*, size_t, double*);
+
+      // distanceEarthMiles, operation for operation, on converted points
+    void oneToManyScalar(double lat, double lon, double cosLat,
+        const double* lats, const double* lons, const double* cosLats, size_t count, double* miles)
+    {
+        for (size_t j = 0; j < count; j++) {
+            double u = std::sin((lats[j] - lat) / 2);
+            double v = std::sin((lons[j] - lon) / 2);
+            miles[j] = EARTH_DIAMETER_KM * std::asin(std::sqrt(u * u + cosLat * cosLats[j] * v * v)) * MILES_PER_KM;
+        }
+    }
+
+      // Runs of whole vectors go straight to the kernel, and the rest through a buffer
+      // padded with the origin, so every distance goes through the same lanes
+    template<size_t LANES, OneToManyKernel WHOLE_VECTORS>
+    void padded(double lat, double lon, double cosLat,
+        const double* lats, const double* lons, const double* cosLats, size_t count, double* miles)
+    {
+        size_t whole = count - count % LANES;
+        WHOLE_VECTORS(lat, lon, cosLat, lats, lons, cosLats, whole, miles);
+        if (whole < count) {
+            double padLats[LANES], padLons[LANES], padCos[LANES], padMiles[LANES];
+            for (size_t k = 0; k < LANES; k++) {
+                bool real = whole + k < count;
+                padLats[k] = real ? lats[whole + k] : lat;
+                padLons[k] = real ? lons[whole + k] : lon;
+                padCos[k] = real ? cosLats[whole + k] : cosLat;
+            }
+            WHOLE_VECTORS(lat, lon, cosLat, padLats, padLons, padCos, LANES, padMiles);
+            for (size_t k = 0; whole + k < count; k++)
+                miles[whole + k] = padMiles[k];
+        }
+    }
+
+#ifdef HAVERSINE_HAS_SSE2
+      // b where mask is set, a elsewhere; SSE2 has no blend
+    inline __m128d select2(__m128d mask, __m128d a, __m128d b)
+    {
+        return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+    }
+
+    inline __m128d sinSquared2(__m128d x)
+    {
+        //sin^2 is even and symmetric about pi/2, and above pi/4 it is 1 - sin^2(pi/2 - x)
+        __m128d y = _mm_andnot_pd(_mm_set1_pd(-0.0), x);
+        y = select2(_mm_cmpgt_pd(y, _mm_set1_pd(PIO2_HI)), y,
+            _mm_add_pd(_mm_sub_pd(_mm_set1_pd(PI_HI), y), _mm_set1_pd(PI_LO)));
+        __m128d upper = _mm_cmpgt_pd(y, _mm_set1_pd(PIO4));
+        __m128d z = select2(upper, y, _mm_add_pd(_mm_sub_pd(_mm_set1_pd(PIO2_HI), y), _mm_set1_pd(PIO2_LO)));
+        __m128d z2 = _mm_mul_pd(z, z);
+        __m128d p = _mm_set1_pd(S17);
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S15));
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S13));
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S11));
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S9));
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S7));
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S5));
+        p = _mm_add_pd(_mm_mul_pd(p, z2), _mm_set1_pd(S3));
+        __m128d s = _mm_add_pd(z, _mm_mul_pd(_mm_mul_pd(z, z2), p));
+        __m128d s2 = _mm_mul_pd(s, s);
+        return select2(upper, s2, _mm_sub_pd(_mm_set1_pd(1.0), s2));
+    }
+
+    inline __m128d asin2(__m128d x)
+    {
+        //Above 0.5, asin x = pi/2 - 2 asin(sqrt((1 - x) / 2)), and 1 - x is exact there
+        __m128d upper = _mm_cmpgt_pd(x, _mm_set1_pd(0.5));
+        __m128d t = select2(upper, _mm_mul_pd(x, x), _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(1.0), x), _mm_set1_pd(0.5)));
+        __m128d base = select2(upper, x, _mm_sqrt_pd(t));
+        __m128d p = _mm_set1_pd(PS5);
+        p = _mm_add_pd(_mm_mul_pd(p, t), _mm_set1_pd(PS4));
+        p = _mm_add_pd(_mm_mul_pd(p, t), _mm_set1_pd(PS3));
+        p = _mm_add_pd(_mm_mul_pd(p, t), _mm_set1_pd(PS2));
+        p = _mm_add_pd(_mm_mul_pd(p, t), _mm_set1_pd(PS1));
+        p = _mm_mul_pd(_mm_add_pd(_mm_mul_pd(p, t), _mm_set1_pd(PS0)), t);
+        __m128d q = _mm_set1_pd(QS4);
+        q = _mm_add_pd(_mm_mul_pd(q, t), _mm_set1_pd(QS3));
+        q = _mm_add_pd(_mm_mul_pd(q, t), _mm_set1_pd(QS2));
+        q = _mm_add_pd(_mm_mul_pd(q, t), _mm_set1_pd(QS1));
+        q = _mm_add_pd(_mm_mul_pd(q, t), _mm_set1_pd(1.0));
+        __m128d a = _mm_add_pd(base, _mm_mul_pd(base, _mm_div_pd(p, q)));
+        return select2(upper, a, _mm_sub_pd(_mm_set1_pd(PIO2_HI),
+            _mm_sub_pd(_mm_add_pd(a, a), _mm_set1_pd(PIO2_LO))));
+    }
+
+      // count a multiple of 2
+    void oneToManySse2(double lat, double lon, double cosLat,
+        const double* lats, const double* lons, const double* cosLats, size_t count, double* miles)
+    {
+        __m128d originLat = _mm_set1_pd(lat), originLon = _mm_set1_pd(lon), originCos = _mm_set1_pd(cosLat);
+        __m128d half = _mm_set1_pd(0.5);
+        for (size_t j = 0; j < count; j += 2) {
+            __m128d u2 = sinSquared2(_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(lats + j), originLat), half));
+            __m128d v2 = sinSquared2(_mm_mul_pd(_mm_sub_pd(_mm_loadu_pd(lons + j), originLon), half));
+            __m128d h = _mm_add_pd(u2, _mm_mul_pd(_mm_mul_pd(originCos, _mm_loadu_pd(cosLats + j)), v2));
+            __m128d a = asin2(_mm_sqrt_pd(_mm_min_pd(h, _mm_set1_pd(1.0))));
+            _mm_storeu_pd(miles + j, _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(EARTH_DIAMETER_KM), a), _mm_set1_pd(MILES_PER_KM)));
+        }
+    }
+#endif
+
+#ifdef HAVERSINE_HAS_AVX2
+    AVX2_TARGET inline __m256d fma4(__m256d a, __m256d b, double c)
+    {
+        return _mm256_fmadd_pd(a, b, _mm256_set1_pd(c));
+    }
+
+    AVX2_TARGET inline __m256d sinSquared4(__m256d x)
+    {
+        __m256d y = _mm256_andnot_pd(_mm256_set1_pd(-0.0), x);
+        y = _mm256_blendv_pd(y, _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(PI_HI), y), _mm256_set1_pd(PI_LO)),
+            _mm256_cmp_pd(y, _mm256_set1_pd(PIO2_HI), _CMP_GT_OQ));
+        __m256d upper = _mm256_cmp_pd(y, _mm256_set1_pd(PIO4), _CMP_GT_OQ);
+        __m256d z = _mm256_blendv_pd(y, _mm256_add_pd(_mm256_sub_pd(_mm256_set1_pd(PIO2_HI), y), _mm256_set1_pd(PIO2_LO)), upper);
+        __m256d z2 = _mm256_mul_pd(z, z);
+        __m256d p = fma4(_mm256_set1_pd(S17), z2, S15);
+        p = fma4(p, z2, S13);
+        p = fma4(p, z2, S11);
+        p = fma4(p, z2, S9);
+        p = fma4(p, z2, S7);
+        p = fma4(p, z2, S5);
+        p = fma4(p, z2, S3);
+        __m256d s = _mm256_fmadd_pd(_mm256_mul_pd(z, z2), p, z);
+        __m256d s2 = _mm256_mul_pd(s, s);
+        return _mm256_blendv_pd(s2, _mm256_sub_pd(_mm256_set1_pd(1.0), s2), upper);
+    }
+
+    AVX2_TARGET inline __m256d asin4(__m256d x)
+    {
+        __m256d upper = _mm256_cmp_pd(x, _mm256_set1_pd(0.5), _CMP_GT_OQ);
+        __m256d t = _mm256_blendv_pd(_mm256_mul_pd(x, x),
+            _mm256_mul_pd(_mm256_sub_pd(_mm256_set1_pd(1.0), x), _mm256_set1_pd(0.5)), upper);
+        __m256d base = _mm256_blendv_pd(x, _mm256_sqrt_pd(t), upper);
+        __m256d p = fma4(_mm256_set1_pd(PS5), t, PS4);
+        p = fma4(p, t, PS3);
+        p = fma4(p, t, PS2);
+        p = fma4(p, t, PS1);
+        p = _mm256_mul_pd(fma4(p, t, PS0), t);
+        __m256d q = fma4(_mm256_set1_pd(QS4), t, QS3);
+        q = fma4(q, t, QS2);
+        q = fma4(q, t, QS1);
+        q = fma4(q, t, 1.0);
+        __m256d a = _mm256_fmadd_pd(base, _mm256_div_pd(p, q), base);
+        return _mm256_blendv_pd(a, _mm256_sub_pd(_mm256_set1_pd(PIO2_HI),
+            _mm256_sub_pd(_mm256_add_pd(a, a), _mm256_set1_pd(PIO2_LO))), upper);
+    }
+
+      // count a multiple of 4
+    AVX2_TARGET void oneToManyAvx2(double lat, double lon, double cosLat,
+        const double* lats, const double* lons, const double* cosLats, size_t count, double* miles)
+    {
+        __m256d originLat = _mm256_set1_pd(lat), originLon = _mm256_set1_pd(lon), originCos = _mm256_set1_pd(cosLat);
+        __m256d half = _mm256_set1_pd(0.5);
+        for (size_t j = 0; j < count; j += 4) {
+            __m256d u2 = sinSquared4(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(lats + j), originLat), half));
+            __m256d v2 = sinSquared4(_mm256_mul_pd(_mm256_sub_pd(_mm256_loadu_pd(lons + j), originLon), half));
+            __m256d h = _mm256_fmadd_pd(_mm256_mul_pd(originCos, _mm256_loadu_pd(cosLats + j)), v2, u2);
+            __m256d a = asin4(_mm256_sqrt_pd(_mm256_min_pd(h, _mm256_set1_pd(1.0))));
+            _mm256_storeu_pd(miles + j, _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(EARTH_DIAMETER_KM), a), _mm256_set1_pd(MILES_PER_KM)));
+        }
+    }
+#endif
+
+    bool supported(HaversineKernel kernel)
+    {
+        switch (kernel) {
+        case HAVERSINE_SCALAR:
+            return true;
+        case HAVERSINE_SSE2:
+#ifdef HAVERSINE_HAS_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case HAVERSINE_AVX2:
+#ifdef HAVERSINE_HAS_AVX2
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    atomic<HaversineKernel>& currentKernel()
+    {
+        static atomic<HaversineKernel> kernel(supported(HAVERSINE_AVX2) ? HAVERSINE_AVX2
+            : supported(HAVERSINE_SSE2) ? HAVERSINE_SSE2 : HAVERSINE_SCALAR);
+        return kernel;
+    }
+
+    OneToManyKernel kernelFunction(HaversineKernel kernel)
+    {
+        switch (kernel) {
+#ifdef HAVERSINE_HAS_AVX2
+        case HAVERSINE_AVX2:
+            return padded<4, oneToManyAvx2>;
+#endif
+#ifdef HAVERSINE_HAS_SSE2
+        case HAVERSINE_SSE2:
+            return padded<2, oneToManySse2>;
+#endif
+        default:
+            return oneToManyScalar;
+        }
+    }
+}
+
+void RadianCoords::add(double latitudeDegrees, double longitudeDegrees)
+{
+    lat.push_back(deg2rad(latitudeDegrees));
+    lon.push_back(deg2rad(longitudeDegrees));
+    cosLat.push_back(std::cos(lat.back()));
+}
+
+void RadianCoords::reserve(size_t count)
+{
+    lat.reserve(count);
+    lon.reserve(count);
+    cosLat.reserve(count);
+}
+
+void RadianCoords::clear()
+{
+    lat.clear();
+    lon.clear();
+    cosLat.clear();
+}
+
+HaversineKernel haversineKernel()
+{
+    return currentKernel().load(memory_order_relaxed);
+}
+
+bool useHaversineKernel(HaversineKernel kernel)
+{
+    if (!supported(kernel))
+        return false;
+    currentKernel().store(kernel, memory_order_relaxed);
+    return true;
+}
+
+const char* haversineKernelName(HaversineKernel kernel)
+{
+    switch (kernel) {
+    case HAVERSINE_AVX2:
+        return "avx2";
+    case HAVERSINE_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+void haversineOneToMany(double lat, double lon, double cosLat,
+    const double* lats, const double* lons, const double* cosLats, size_t count, double* miles)
+{
+    kernelFunction(haversineKernel())(lat, lon, cosLat, lats, lons, cosLats, count, miles);
+}
+
+void haversineOneToMany(const RadianCoords& from, size_t i, const RadianCoords& to, double* miles)
+{
+    haversineOneToMany(from.lat[i], from.lon[i], from.cosLat[i], to.lat.data(), to.lon.data(), to.cosLat.data(), to.size(), miles);
+}
+
+void haversineManyToMany(const RadianCoords& from, const RadianCoords& to, vector<vector<double>>& miles)
+{
+    OneToManyKernel kernel = kernelFunction(haversineKernel());
+    miles.resize(from.size());
+    for (size_t i = 0; i < from.size(); i++) {
+        miles[i].resize(to.size());
+        kernel(from.lat[i], from.lon[i], from.cosLat[i], to.lat.data(), to.lon.data(), to.cosLat.data(), to.size(), miles[i].data());
+    }
+}
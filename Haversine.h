@@ -0,0 +1,65 @@
+// Haversine.h
+
+// Great-circle distances many at a time.  distanceEarthMiles() converts both
+// points to radians and takes the cosine of both latitudes on every call, and
+// the optimizer and the A* heuristic call it over and over on the same points.
+// Here points are converted once into a RadianCoords table, a structure of
+// arrays holding latitude and longitude in radians and the cosine of the
+// latitude, and the distances from one point to a run of others are computed a
+// vector of lanes at a time:
+//   AVX2 with FMA   four lanes, chosen at run time when the processor has both
+//   SSE2            two lanes, on any x86-64 processor
+//   scalar          the same formula as distanceEarthMiles, with std::sin and
+//                   std::asin, everywhere else
+// The vector kernels replace sin and asin with polynomials: sin is reduced to
+// [0, pi/4] with pi split in two parts, so nearby and antimeridian-crossing
+// points keep their precision, and asin uses fdlibm's rational approximation
+// on [0, 0.5] and its half-angle identity above that.  For latitudes within
+// +-90 and longitudes within +-180 degrees, every kernel agrees with
+// distanceEarthMiles to within HAVERSINE_MAX_ULPS units in the last place for
+// points under 10,000 miles apart (7 is the worst seen), which testOptimizer.cpp
+// checks.  Nearer to antipodal the formula itself is ill-conditioned, asin's
+// slope growing without bound, and the two drift apart by up to about 2e-12
+// relative; points within rounding of antipodal come out as half the
+// circumference, where the scalar formula can return NaN.
+//
+// A run that does not fill the last vector is padded rather than finished in
+// scalar code, so a distance does not depend on where in the run it falls.
+
+#ifndef HAVERSINE_INCLUDED
+#define HAVERSINE_INCLUDED
+
+#include <vector>
+#include <cstddef>
+
+const int HAVERSINE_MAX_ULPS = 8;
+
+struct RadianCoords
+{
+    std::vector<double> lat;        // radians
+    std::vector<double> lon;
+    std::vector<double> cosLat;
+      // converted with deg2rad, as distanceEarthMiles does
+    void add(double latitudeDegrees, double longitudeDegrees);
+    size_t size() const { return lat.size(); }
+    void reserve(size_t count);
+    void clear();
+};
+
+enum HaversineKernel { HAVERSINE_SCALAR, HAVERSINE_SSE2, HAVERSINE_AVX2 };
+
+  // the kernel in use; the best one the processor supports unless changed
+HaversineKernel haversineKernel();
+  // switches kernels, for tests and benchmarks; false, changing nothing, if unsupported
+bool useHaversineKernel(HaversineKernel kernel);
+const char* haversineKernelName(HaversineKernel kernel);
+
+  // miles from (lat, lon) to each of count points, into miles[0..count)
+void haversineOneToMany(double lat, double lon, double cosLat,
+    const double* lats, const double* lons, const double* cosLats, size_t count, double* miles);
+  // miles from point i of from to every point of to
+void haversineOneToMany(const RadianCoords& from, size_t i, const RadianCoords& to, double* miles);
+  // miles[i][j] from point i of from to point j of to
+void haversineManyToMany(const RadianCoords& from, const RadianCoords& to, std::vector<std::vector<double>>& miles);
+
+#endif // HAVERSINE_INCLUDED
@@ -0,0 +1,97 @@
+#include "HeldKarp.h"
+#include <limits>
+using namespace std;
+
+namespace
+{
+    const int MAX_STOPS = 31;   // beyond this the subset count overflows long before any cap matters
+}
+
+size_t heldKarpBytes(int stops)
+{
+    if (stops <= 1)
+        return 0;
+    if (stops > MAX_STOPS)
+        return numeric_limits<size_t>::max();
+    size_t m = stops - 1;
+    return (((size_t)1 << m) * m + m * m) * sizeof(double);
+}
+
+bool solveHeldKarp(const vector<vector<double>>& distances, size_t maxBytes, vector<int>& tour, double& length)
+{
+    int n = (int)distances.size();
+    if (n > MAX_STOPS || heldKarpBytes(n) > maxBytes)
+        return false;
+    if (n <= 2) {
+        tour.clear();
+        for (int i = 0; i < n; i++)
+            tour.push_back(i);
+        length = n == 2 ? distances[0][1] + distances[1][0] : 0;
+        return true;
+    }
+
+    //Stops 1 .. n-1 become bits 0 .. m-1
+    const double INF = numeric_limits<double>::infinity();
+    size_t m = n - 1;
+    size_t full = (size_t)1 << m;
+    vector<double> into(m * m);     // into[k * m + j]: distance from stop j to stop k
+    for (size_t k = 0; k < m; k++)
+        for (size_t j = 0; j < m; j++)
+            into[k * m + j] = j == k ? INF : distances[j + 1][k + 1];
+    vector<double> best(full * m, INF);
+    for (size_t k = 0; k < m; k++)
+        best[((size_t)1 << k) * m + k] = distances[0][k + 1];
+
+    for (size_t subset = 1; subset < full; subset++) {
+        if ((subset & (subset - 1)) == 0)
+            continue; //one stop, straight from the depot
+        double* row = &best[subset * m];
+        for (size_t k = 0; k < m; k++) {
+            if (!(subset & ((size_t)1 << k)))
+                continue;
+            const double* from = &best[(subset ^ ((size_t)1 << k)) * m];
+            const double* column = &into[k * m];
+            double shortest = INF;
+            for (size_t j = 0; j < m; j++) {
+                double d = from[j] + column[j];
+                shortest = d < shortest ? d : shortest;
+            }
+            row[k] = shortest;
+        }
+    }
+
+    //Close the tour, then walk back through the table, each step finding the stop
+    //whose entry produced the one after it
+    size_t subset = full - 1;
+    size_t last = 0;
+    double shortestTour = INF;
+    for (size_t j = 0; j < m; j++) {
+        double d = best[subset * m + j] + distances[j + 1][0];
+        if (d < shortestTour) {
+            shortestTour = d;
+            last = j;
+        }
+    }
+    if (shortestTour == INF)
+        return false; //some stop cannot be reached, or left
+    length = shortestTour;
+    tour.assign(n, 0);
+    for (int position = n - 1; position >= 1; position--) {
+        tour[position] = (int)last + 1;
+        size_t previous = subset ^ ((size_t)1 << last);
+        if (previous == 0)
+            break;
+        const double* from = &best[previous * m];
+        const double* column = &into[last * m];
+        size_t before = 0;
+        for (size_t j = 0; j < m; j++) {
+            if (from[j] + column[j] == best[subset * m + last]) {
+                before = j;
+                break;
+            }
+        }
+        subset = previous;
+        last = before;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+// HeldKarp.h
+
+// Exact shortest tour by dynamic programming over subsets of stops (Held-Karp).
+// Stop 0, the depot, starts and ends the tour.  best[S][k] is the length of the
+// shortest path from the depot through every stop in S ending at k, and
+//   best[S][k] = min over j in S - {k} of best[S - {k}][j] + distance(j, k)
+// Time is O(2^n n^2) and memory O(2^n n) for n stops besides the depot, so it
+// is only for small batches; a dozen stops take well under a millisecond.
+//
+// The table is laid out subset-major with the last stop varying fastest, and
+// the distances into each stop are kept as a contiguous column, so every
+// minimum above is a straight pass over two arrays that the compiler can
+// vectorize.  Entries for stops not in S hold infinity and drop out by
+// themselves, which keeps the inner loop free of branches.
+
+#ifndef HELDKARP_INCLUDED
+#define HELDKARP_INCLUDED
+
+#include <vector>
+#include <cstddef>
+
+  // bytes solveHeldKarp needs for a matrix of this many stops, depot included
+size_t heldKarpBytes(int stops);
+
+  // the shortest tour of a square distance matrix, starting at 0, or false, leaving
+  // tour and length alone, if that would take more than maxBytes or no tour exists
+bool solveHeldKarp(const std::vector<std::vector<double>>& distances, size_t maxBytes,
+    std::vector<int>& tour, double& length);
+
+#endif // HELDKARP_INCLUDED
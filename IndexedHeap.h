@@ -0,0 +1,116 @@
+// IndexedHeap.h
+
+// Min-heap of node IDs keyed by distance, with decrease-key.  Each node is in
+// the heap at most once, and a position array indexed by node ID finds it in
+// O(1), so improving a node's key moves the existing entry instead of pushing a
+// duplicate.  The heap is 4-ary: shallower than a binary heap and each node's
+// children share a cache line.
+//
+// Positions are kept clean between uses: popping a node and clear() both reset
+// its position, so preparing for the next search costs O(entries left), not
+// O(nodes).
+
+#ifndef INDEXEDHEAP_INCLUDED
+#define INDEXEDHEAP_INCLUDED
+
+#include <vector>
+
+class IndexedHeap
+{
+public:
+    static const unsigned int NOT_IN_HEAP = 0xffffffff;
+
+    void reserve(unsigned int nodeCount)   // node IDs must be below nodeCount
+    {
+        if (m_position.size() < nodeCount)
+            m_position.resize(nodeCount, (unsigned int)NOT_IN_HEAP);
+    }
+    void clear()
+    {
+        for (size_t i = 0; i < m_items.size(); i++)
+            m_position[m_items[i].m_node] = NOT_IN_HEAP;
+        m_items.clear();
+    }
+    bool empty() const { return m_items.empty(); }
+    size_t size() const { return m_items.size(); }
+    bool contains(unsigned int node) const { return m_position[node] != NOT_IN_HEAP; }
+    unsigned int top() const { return m_items[0].m_node; }
+    double topKey() const { return m_items[0].m_key; }
+    double key(unsigned int node) const { return m_items[m_position[node]].m_key; }
+
+      // inserts node, or lowers its key if it is already queued with a larger one
+    void pushOrDecrease(unsigned int node, double key)
+    {
+        unsigned int pos = m_position[node];
+        if (pos == NOT_IN_HEAP) {
+            Item item = { key, node };
+            m_items.push_back(item);
+            siftUp((unsigned int)m_items.size() - 1);
+        }
+        else if (key < m_items[pos].m_key) {
+            m_items[pos].m_key = key;
+            siftUp(pos);
+        }
+    }
+
+    unsigned int pop()
+    {
+        unsigned int node = m_items[0].m_node;
+        m_position[node] = NOT_IN_HEAP;
+        Item last = m_items.back();
+        m_items.pop_back();
+        if (!m_items.empty()) { //Moves the last item to the root and lets it sink
+            m_items[0] = last;
+            m_position[last.m_node] = 0;
+            siftDown(0);
+        }
+        return node;
+    }
+
+private:
+    struct Item {
+        double m_key;
+        unsigned int m_node;
+    };
+    void place(unsigned int pos, const Item& item)
+    {
+        m_items[pos] = item;
+        m_position[item.m_node] = pos;
+    }
+    void siftUp(unsigned int pos)
+    {
+        Item item = m_items[pos];
+        while (pos > 0) {
+            unsigned int parent = (pos - 1) / 4;
+            if (!(item.m_key < m_items[parent].m_key))
+                break;
+            place(pos, m_items[parent]);
+            pos = parent;
+        }
+        place(pos, item);
+    }
+    void siftDown(unsigned int pos)
+    {
+        Item item = m_items[pos];
+        unsigned int count = (unsigned int)m_items.size();
+        for (;;) {
+            unsigned int first = 4 * pos + 1;
+            if (first >= count)
+                break;
+            unsigned int best = first; //Smallest of up to four children
+            unsigned int last = first + 4 < count ? first + 4 : count;
+            for (unsigned int c = first + 1; c < last; c++)
+                if (m_items[c].m_key < m_items[best].m_key)
+                    best = c;
+            if (!(m_items[best].m_key < item.m_key))
+                break;
+            place(pos, m_items[best]);
+            pos = best;
+        }
+        place(pos, item);
+    }
+    std::vector<Item> m_items;
+    std::vector<unsigned int> m_position;   // index into m_items, or NOT_IN_HEAP
+};
+
+#endif // INDEXEDHEAP_INCLUDED
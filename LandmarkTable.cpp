@@ -0,0 +1,337 @@
+#include "provided.h"
+#include "IndexedHeap.h"
+#include "MappedFile.h"
+#include "Logger.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+// ALT ("A*, landmarks, triangle inequality"): for any landmark L the road
+// distances satisfy d(v,t) >= d(L,t) - d(L,v) and d(v,t) >= d(v,L) - d(t,L),
+// so the best of those over a handful of well spread landmarks is an
+// admissible A* heuristic that, unlike straight-line distance, knows about
+// rivers, freeways and dead ends.
+//
+// Distances are stored as 32-bit multiples of DISTANCE_UNIT, node-major so one
+// node's K "from" and K "to" values share a cache line or two.  Rounding moves
+// each stored value by at most half a unit, so every difference is taken one
+// unit smaller to stay a lower bound.
+
+namespace
+{
+    const double DISTANCE_UNIT = 1e-6;                 // miles per stored step, up to ~4294 miles
+    const uint32_t UNREACHABLE = 0xffffffff;
+    const double INFINITE_DISTANCE = numeric_limits<double>::infinity();
+
+    const char ALT_MAGIC[8] = { 'S', 'M', 'A', 'P', 'A', 'L', 'T', '\0' };
+    const uint32_t ALT_BYTE_ORDER = 0x01020304;
+    const uint32_t ALT_VERSION = 1;
+
+    struct AltHeader
+    {
+        char     magic[8];
+        uint32_t byteOrder;
+        uint32_t version;
+        uint32_t nodeCount;
+        uint32_t landmarkCount;
+        double   distanceUnit;
+        uint64_t mapFingerprint;
+        uint64_t checksum;
+    };
+
+    uint32_t quantize(double miles)
+    {
+        double steps = miles / DISTANCE_UNIT;
+        if (!(steps < UNREACHABLE - 1.0)) //too far to store, or not reachable at all
+            return UNREACHABLE;
+        return (uint32_t)llround(steps);
+    }
+}
+
+class LandmarkTableImpl
+{
+public:
+    LandmarkTableImpl(const StreetMap* sm);
+    ~LandmarkTableImpl();
+    void build(unsigned int landmarkCount);
+    bool save(string altFile) const;
+    bool load(string altFile);
+    bool isReady() const;
+    unsigned int landmarkCount() const { return m_landmarkCount; }
+    double lowerBound(unsigned int node, unsigned int target) const;
+private:
+    void dijkstra(unsigned int source, bool reverse, vector<double>& dist);
+    const StreetMap* m_sm;
+    vector<uint32_t> m_distances;           // per node: d(L,node) for each L, then d(node,L) for each L
+    vector<unsigned int> m_landmarks;
+    //Reverse graph, only needed while building
+    vector<uint32_t> m_inOffsets;
+    vector<uint32_t> m_inSources;
+    vector<double> m_inLengths;
+    IndexedHeap m_heap;
+    uint64_t m_fingerprint;
+    unsigned long long m_mapGeneration;  // the map as it was when built or loaded
+    unsigned int m_nodeCount;
+    unsigned int m_landmarkCount;
+    bool m_ready;
+};
+
+LandmarkTableImpl::LandmarkTableImpl(const StreetMap* sm)
+    : m_sm(sm), m_fingerprint(0), m_mapGeneration(0), m_nodeCount(0), m_landmarkCount(0), m_ready(false)
+{
+}
+
+LandmarkTableImpl::~LandmarkTableImpl()
+{
+}
+
+void LandmarkTableImpl::dijkstra(unsigned int source, bool reverse, vector<double>& dist)
+{
+    //Full single-source Dijkstra, over edges into each node when reverse is set
+    dist.assign(m_sm->nodeCount(), INFINITE_DISTANCE);
+    m_heap.clear();
+    dist[source] = 0;
+    m_heap.pushOrDecrease(source, 0);
+    while (!m_heap.empty()) {
+        unsigned int u = m_heap.pop();
+        if (!reverse) {
+            for (const StreetEdge& edge : m_sm->edgesFrom(u)) {
+                double d = dist[u] + edge.length;
+                if (d < dist[edge.target]) {
+                    dist[edge.target] = d;
+                    m_heap.pushOrDecrease(edge.target, d);
+                }
+            }
+        }
+        else {
+            for (uint32_t i = m_inOffsets[u]; i < m_inOffsets[u + 1]; i++) {
+                double d = dist[u] + m_inLengths[i];
+                if (d < dist[m_inSources[i]]) {
+                    dist[m_inSources[i]] = d;
+                    m_heap.pushOrDecrease(m_inSources[i], d);
+                }
+            }
+        }
+    }
+}
+
+void LandmarkTableImpl::build(unsigned int landmarkCount)
+{
+    unsigned int n = m_sm->nodeCount();
+    m_ready = false;
+    m_landmarks.clear();
+    m_distances.clear();
+    if (n == 0 || landmarkCount == 0)
+        return;
+    if (landmarkCount > n)
+        landmarkCount = n;
+
+    //Reverse CSR by counting sort, for the distances to each landmark
+    m_inOffsets.assign(n + 1, 0);
+    for (unsigned int u = 0; u < n; u++)
+        for (const StreetEdge& edge : m_sm->edgesFrom(u))
+            m_inOffsets[edge.target + 1]++;
+    for (unsigned int v = 0; v < n; v++)
+        m_inOffsets[v + 1] += m_inOffsets[v];
+    m_inSources.resize(m_inOffsets[n]);
+    m_inLengths.resize(m_inOffsets[n]);
+    vector<uint32_t> next(m_inOffsets.begin(), m_inOffsets.end() - 1);
+    for (unsigned int u = 0; u < n; u++) {
+        for (const StreetEdge& edge : m_sm->edgesFrom(u)) {
+            m_inSources[next[edge.target]] = u;
+            m_inLengths[next[edge.target]++] = edge.length;
+        }
+    }
+    m_heap.reserve(n);
+
+    //Farthest-point selection: each landmark is the node farthest by road from all the
+    //ones chosen so far, starting from whatever lies farthest from node 0
+    vector<double> nearest, from, to;
+    dijkstra(0, false, nearest);
+    m_distances.assign((size_t)n * 2 * landmarkCount, UNREACHABLE);
+    for (unsigned int l = 0; l < landmarkCount; l++) {
+        unsigned int landmark = 0;
+        double farthest = -1;
+        for (unsigned int v = 0; v < n; v++) {
+            if (nearest[v] != INFINITE_DISTANCE && nearest[v] > farthest) {
+                farthest = nearest[v];
+                landmark = v;
+            }
+        }
+        if (farthest <= 0 && l > 0) //every reachable node is already a landmark
+            break;
+        m_landmarks.push_back(landmark);
+        dijkstra(landmark, false, from);
+        dijkstra(landmark, true, to);
+        for (unsigned int v = 0; v < n; v++) {
+            m_distances[(size_t)v * 2 * landmarkCount + l] = quantize(from[v]);
+            m_distances[(size_t)v * 2 * landmarkCount + landmarkCount + l] = quantize(to[v]);
+            if (l == 0 || from[v] < nearest[v])
+                nearest[v] = from[v];
+        }
+    }
+    if (m_landmarks.size() < landmarkCount) { //fewer useful landmarks than asked for, repack the rows
+        unsigned int k = (unsigned int)m_landmarks.size();
+        vector<uint32_t> packed((size_t)n * 2 * k);
+        for (unsigned int v = 0; v < n; v++) {
+            for (unsigned int l = 0; l < k; l++) {
+                packed[(size_t)v * 2 * k + l] = m_distances[(size_t)v * 2 * landmarkCount + l];
+                packed[(size_t)v * 2 * k + k + l] = m_distances[(size_t)v * 2 * landmarkCount + landmarkCount + l];
+            }
+        }
+        m_distances.swap(packed);
+        landmarkCount = k;
+    }
+    vector<uint32_t>().swap(m_inOffsets);
+    vector<uint32_t>().swap(m_inSources);
+    vector<double>().swap(m_inLengths);
+    m_landmarkCount = landmarkCount;
+    m_nodeCount = n;
+    m_fingerprint = m_sm->graphFingerprint();
+    m_mapGeneration = m_sm->generation();
+    m_ready = true;
+}
+
+bool LandmarkTableImpl::isReady() const
+{
+    //Distances are per node of the map it was made for, so any reload since makes them stale
+    return m_ready && m_mapGeneration == m_sm->generation();
+}
+
+double LandmarkTableImpl::lowerBound(unsigned int node, unsigned int target) const
+{
+    unsigned int k = m_landmarkCount;
+    const uint32_t* v = &m_distances[(size_t)node * 2 * k];
+    const uint32_t* t = &m_distances[(size_t)target * 2 * k];
+    int64_t best = 0;
+    for (unsigned int l = 0; l < k; l++) {
+        //A landmark that cannot reach, or be reached from, either end says nothing
+        if (v[l] != UNREACHABLE && t[l] != UNREACHABLE && (int64_t)t[l] - v[l] - 1 > best)
+            best = (int64_t)t[l] - v[l] - 1;
+        if (v[k + l] != UNREACHABLE && t[k + l] != UNREACHABLE && (int64_t)v[k + l] - t[k + l] - 1 > best)
+            best = (int64_t)v[k + l] - t[k + l] - 1;
+    }
+    return best * DISTANCE_UNIT;
+}
+
+bool LandmarkTableImpl::save(string altFile) const
+{
+    if (!m_ready)
+        return false;
+    AltHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ALT_MAGIC, sizeof(header.magic));
+    header.byteOrder = ALT_BYTE_ORDER;
+    header.version = ALT_VERSION;
+    header.nodeCount = m_nodeCount;
+    header.landmarkCount = m_landmarkCount;
+    header.distanceUnit = DISTANCE_UNIT;
+    header.mapFingerprint = m_fingerprint;
+
+    //Landmark node IDs, then the distance rows
+    string payload;
+    payload.append(reinterpret_cast<const char*>(m_landmarks.data()), m_landmarks.size() * sizeof(uint32_t));
+    payload.append(reinterpret_cast<const char*>(m_distances.data()), m_distances.size() * sizeof(uint32_t));
+    header.checksum = checksumBytes(payload.data(), payload.size());
+
+    ofstream outfile(altFile, ios::binary | ios::trunc);
+    if (!outfile)
+    {
+        LOG_ERROR("Cannot open " << altFile << " for writing");
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(payload.data(), payload.size());
+    return (bool)outfile;
+}
+
+bool LandmarkTableImpl::load(string altFile)
+{
+    m_ready = false;
+    MappedFile file;
+    if (!file.open(altFile))
+    {
+        LOG_ERROR("Cannot open " << altFile);
+        return false;
+    }
+    AltHeader header;
+    if (file.size() < sizeof(header)) {
+        LOG_ERROR(altFile << " is too small to be a landmark table");
+        return false;
+    }
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, ALT_MAGIC, sizeof(header.magic)) != 0 || header.byteOrder != ALT_BYTE_ORDER
+        || header.version != ALT_VERSION || header.distanceUnit != DISTANCE_UNIT) {
+        LOG_ERROR(altFile << " is not a version " << ALT_VERSION << " landmark table");
+        return false;
+    }
+    size_t distanceCount = (size_t)header.nodeCount * 2 * header.landmarkCount;
+    size_t payloadBytes = (header.landmarkCount + distanceCount) * sizeof(uint32_t);
+    const char* payload = file.data() + sizeof(header);
+    if (file.size() - sizeof(header) != payloadBytes || checksumBytes(payload, payloadBytes) != header.checksum) {
+        LOG_ERROR(altFile << " is truncated or corrupt");
+        return false;
+    }
+    if (header.nodeCount != m_sm->nodeCount() || header.mapFingerprint != m_sm->graphFingerprint()) {
+        LOG_ERROR(altFile << " was built from a different map");
+        return false;
+    }
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(payload);
+    m_landmarks.assign(words, words + header.landmarkCount);
+    m_distances.assign(words + header.landmarkCount, words + header.landmarkCount + distanceCount);
+    m_landmarkCount = header.landmarkCount;
+    m_nodeCount = header.nodeCount;
+    m_fingerprint = header.mapFingerprint;
+    m_mapGeneration = m_sm->generation();
+    m_ready = true;
+    return true;
+}
+
+//******************** LandmarkTable functions ********************************
+
+// These functions simply delegate to LandmarkTableImpl's functions.
+
+LandmarkTable::LandmarkTable(const StreetMap* sm)
+{
+    m_impl = new LandmarkTableImpl(sm);
+}
+
+LandmarkTable::~LandmarkTable()
+{
+    delete m_impl;
+}
+
+void LandmarkTable::build(unsigned int landmarkCount)
+{
+    m_impl->build(landmarkCount);
+}
+
+bool LandmarkTable::save(string altFile) const
+{
+    return m_impl->save(altFile);
+}
+
+bool LandmarkTable::load(string altFile)
+{
+    return m_impl->load(altFile);
+}
+
+bool LandmarkTable::isReady() const
+{
+    return m_impl->isReady();
+}
+
+unsigned int LandmarkTable::landmarkCount() const
+{
+    return m_impl->landmarkCount();
+}
+
+double LandmarkTable::lowerBound(unsigned int node, unsigned int target) const
+{
+    return m_impl->lowerBound(node, target);
+}
@@ -0,0 +1,296 @@
+#include "provided.h"
+#include "FlatHashMap.h"
+#include "CoordKey.h"
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+using namespace std;
+
+// The cache is split into shards by key hash, each with its own lock, table and
+// LRU list, so concurrent routers rarely wait on one another.  Each shard gets
+// an equal share of the byte limit.  An entry stores its path as
+// (node, position of the edge within edgesFrom(node)) pairs, 8 bytes a step,
+// which turn back into StreetEdge pointers on the current map for free.
+//
+// Keys carry the generation of the map the path was found on.  Generations
+// differ between maps and between loads of one map, so maps sharing the cache
+// keep their entries apart, and a reloaded map never finds its old entries;
+// those are left to age out of the LRU lists.
+
+  // Ordered pair of node IDs on one load of one map
+struct LegKey
+{
+    uint64_t generation;
+    uint64_t nodes;
+};
+
+inline bool operator==(const LegKey& lhs, const LegKey& rhs)
+{
+    return lhs.nodes == rhs.nodes && lhs.generation == rhs.generation;
+}
+
+inline uint64_t mixLegKey(const LegKey& key)
+{
+    return mixCoordKey(key.nodes ^ key.generation * 0x9e3779b97f4a7c15ULL);
+}
+
+inline unsigned int hasher(const LegKey& key)
+{
+    return (unsigned int)mixLegKey(key);
+}
+
+namespace
+{
+    const uint32_t NO_ENTRY = 0xffffffff;
+    const unsigned int SHARD_COUNT = 16;
+
+    LegKey makeLegKey(const StreetMap* sm, unsigned int source, unsigned int target)
+    {
+        LegKey key = { sm->generation(), (uint64_t)source << 32 | target };
+        return key;
+    }
+}
+
+class LegCacheImpl
+{
+public:
+    LegCacheImpl(size_t maxBytes);
+    ~LegCacheImpl();
+    void setMaxBytes(size_t maxBytes);
+    void clear();
+    size_t bytesUsed() const;
+    unsigned long long hits() const { return m_hits; }
+    unsigned long long misses() const { return m_misses; }
+    bool find(const StreetMap* sm, unsigned int source, unsigned int target,
+        vector<unsigned int>& nodes, vector<const StreetEdge*>& edges, double& distance);
+    void store(const StreetMap* sm, unsigned int source, unsigned int target,
+        const vector<unsigned int>& nodes, const vector<const StreetEdge*>& edges, double distance);
+private:
+    struct Entry {
+        LegKey m_key;
+        double m_distance;
+        vector<uint32_t> m_steps;       // node, edge position, node, edge position, ...
+        uint32_t m_prev;                // towards the most recently used
+        uint32_t m_next;                // towards the least recently used
+    };
+    struct Shard {
+        mutex m_mutex;
+        FlatHashMap<LegKey, uint32_t> m_index;   // key -> position in m_entries
+        vector<Entry> m_entries;
+        vector<uint32_t> m_free;                // unused positions in m_entries
+        uint32_t m_head;                        // most recently used, or NO_ENTRY
+        uint32_t m_tail;                        // least recently used, or NO_ENTRY
+        size_t m_bytes;
+    };
+    static size_t entryBytes(const Entry& e) { return sizeof(Entry) + e.m_steps.capacity() * sizeof(uint32_t) + 16; }
+    Shard& shardFor(const LegKey& key) { return *m_shards[(mixLegKey(key) >> 32) % SHARD_COUNT]; }
+    void resetShard(Shard& shard);
+    void unlink(Shard& shard, uint32_t e);
+    void pushFront(Shard& shard, uint32_t e);
+    void evict(Shard& shard, size_t limit);
+
+    Shard* m_shards[SHARD_COUNT];
+    atomic<size_t> m_shardLimit;
+    atomic<unsigned long long> m_hits;
+    atomic<unsigned long long> m_misses;
+};
+
+LegCacheImpl::LegCacheImpl(size_t maxBytes)
+    : m_shardLimit(maxBytes / SHARD_COUNT), m_hits(0), m_misses(0)
+{
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+        m_shards[i] = new Shard;
+        resetShard(*m_shards[i]);
+    }
+}
+
+LegCacheImpl::~LegCacheImpl()
+{
+    for (unsigned int i = 0; i < SHARD_COUNT; i++)
+        delete m_shards[i];
+}
+
+void LegCacheImpl::resetShard(Shard& shard)
+{
+    shard.m_index.reset();
+    vector<Entry>().swap(shard.m_entries);
+    vector<uint32_t>().swap(shard.m_free);
+    shard.m_head = NO_ENTRY;
+    shard.m_tail = NO_ENTRY;
+    shard.m_bytes = 0;
+}
+
+void LegCacheImpl::unlink(Shard& shard, uint32_t e)
+{
+    Entry& entry = shard.m_entries[e];
+    if (entry.m_prev != NO_ENTRY)
+        shard.m_entries[entry.m_prev].m_next = entry.m_next;
+    else
+        shard.m_head = entry.m_next;
+    if (entry.m_next != NO_ENTRY)
+        shard.m_entries[entry.m_next].m_prev = entry.m_prev;
+    else
+        shard.m_tail = entry.m_prev;
+}
+
+void LegCacheImpl::pushFront(Shard& shard, uint32_t e)
+{
+    Entry& entry = shard.m_entries[e];
+    entry.m_prev = NO_ENTRY;
+    entry.m_next = shard.m_head;
+    if (shard.m_head != NO_ENTRY)
+        shard.m_entries[shard.m_head].m_prev = e;
+    shard.m_head = e;
+    if (shard.m_tail == NO_ENTRY)
+        shard.m_tail = e;
+}
+
+void LegCacheImpl::evict(Shard& shard, size_t limit)
+{
+    while (shard.m_bytes > limit && shard.m_tail != NO_ENTRY) {
+        uint32_t e = shard.m_tail;
+        Entry& entry = shard.m_entries[e];
+        unlink(shard, e);
+        shard.m_index.erase(entry.m_key);
+        shard.m_bytes -= entryBytes(entry);
+        vector<uint32_t>().swap(entry.m_steps);
+        shard.m_free.push_back(e);
+    }
+}
+
+void LegCacheImpl::setMaxBytes(size_t maxBytes)
+{
+    m_shardLimit = maxBytes / SHARD_COUNT;
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+        lock_guard<mutex> lock(m_shards[i]->m_mutex);
+        evict(*m_shards[i], m_shardLimit);
+    }
+}
+
+void LegCacheImpl::clear()
+{
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+        lock_guard<mutex> lock(m_shards[i]->m_mutex);
+        resetShard(*m_shards[i]);
+    }
+    m_hits = 0;
+    m_misses = 0;
+}
+
+size_t LegCacheImpl::bytesUsed() const
+{
+    size_t total = 0;
+    for (unsigned int i = 0; i < SHARD_COUNT; i++) {
+        lock_guard<mutex> lock(m_shards[i]->m_mutex);
+        total += m_shards[i]->m_bytes;
+    }
+    return total;
+}
+
+bool LegCacheImpl::find(const StreetMap* sm, unsigned int source, unsigned int target,
+    vector<unsigned int>& nodes, vector<const StreetEdge*>& edges, double& distance)
+{
+    LegKey key = makeLegKey(sm, source, target);
+    Shard& shard = shardFor(key);
+    lock_guard<mutex> lock(shard.m_mutex);
+    const uint32_t* e = shard.m_index.find(key);
+    if (e == nullptr) {
+        m_misses++;
+        return false;
+    }
+    m_hits++;
+    unlink(shard, *e);
+    pushFront(shard, *e);
+    const Entry& entry = shard.m_entries[*e];
+    nodes.clear();
+    edges.clear();
+    for (size_t i = 0; i < entry.m_steps.size(); i += 2) {
+        nodes.push_back(entry.m_steps[i]);
+        edges.push_back(sm->edgesFrom(entry.m_steps[i]).begin() + entry.m_steps[i + 1]);
+    }
+    distance = entry.m_distance;
+    return true;
+}
+
+void LegCacheImpl::store(const StreetMap* sm, unsigned int source, unsigned int target,
+    const vector<unsigned int>& nodes, const vector<const StreetEdge*>& edges, double distance)
+{
+    LegKey key = makeLegKey(sm, source, target);
+    Shard& shard = shardFor(key);
+    lock_guard<mutex> lock(shard.m_mutex);
+    if (shard.m_index.find(key) != nullptr) //another thread got there first
+        return;
+    uint32_t e;
+    if (!shard.m_free.empty()) {
+        e = shard.m_free.back();
+        shard.m_free.pop_back();
+    }
+    else {
+        e = (uint32_t)shard.m_entries.size();
+        shard.m_entries.push_back(Entry());
+    }
+    Entry& entry = shard.m_entries[e];
+    entry.m_key = key;
+    entry.m_distance = distance;
+    entry.m_steps.resize(2 * edges.size());
+    for (size_t i = 0; i < edges.size(); i++) {
+        entry.m_steps[2 * i] = nodes[i];
+        entry.m_steps[2 * i + 1] = (uint32_t)(edges[i] - sm->edgesFrom(nodes[i]).begin());
+    }
+    shard.m_bytes += entryBytes(entry);
+    shard.m_index.associate(key, e);
+    pushFront(shard, e);
+    evict(shard, m_shardLimit); //may evict the new entry itself if it alone is over the limit
+}
+
+//******************** LegCache functions *************************************
+
+// These functions simply delegate to LegCacheImpl's functions.
+
+LegCache::LegCache(size_t maxBytes)
+{
+    m_impl = new LegCacheImpl(maxBytes);
+}
+
+LegCache::~LegCache()
+{
+    delete m_impl;
+}
+
+void LegCache::setMaxBytes(size_t maxBytes)
+{
+    m_impl->setMaxBytes(maxBytes);
+}
+
+void LegCache::clear()
+{
+    m_impl->clear();
+}
+
+size_t LegCache::bytesUsed() const
+{
+    return m_impl->bytesUsed();
+}
+
+unsigned long long LegCache::hits() const
+{
+    return m_impl->hits();
+}
+
+unsigned long long LegCache::misses() const
+{
+    return m_impl->misses();
+}
+
+bool LegCache::find(const StreetMap* sm, unsigned int source, unsigned int target,
+    vector<unsigned int>& nodes, vector<const StreetEdge*>& edges, double& distance) const
+{
+    return m_impl->find(sm, source, target, nodes, edges, distance);
+}
+
+void LegCache::store(const StreetMap* sm, unsigned int source, unsigned int target,
+    const vector<unsigned int>& nodes, const vector<const StreetEdge*>& edges, double distance)
+{
+    m_impl->store(sm, source, target, nodes, edges, distance);
+}
@@ -0,0 +1,266 @@
+#include "Logger.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdint>
+#include <cctype>
+#include <algorithm>
+using namespace std;
+
+atomic<int> g_logLevel(LOG_INFO);
+
+namespace
+{
+    const size_t SLOT_COUNT = 4096;                 // a power of two
+    const size_t MAX_TEXT = 255;                    // longer messages are cut short
+    const chrono::milliseconds IDLE_WAIT(2);        // how long the logging thread naps when there is nothing to do
+
+    struct Slot
+    {
+        atomic<size_t> sequence;                    // its position when free, position + 1 once written
+        LogLevel level;
+        chrono::steady_clock::time_point time;
+        unsigned int thread;
+        const char* file;
+        int line;
+        char text[MAX_TEXT + 1];
+    };
+
+      // Which number the current thread logs under, 0 until it first logs
+    thread_local unsigned int t_thread = 0;
+
+    const char* baseName(const char* path)
+    {
+        const char* name = path;
+        for (const char* p = path; *p != '\0'; p++)
+            if (*p == '/' || *p == '\\')
+                name = p + 1;
+        return name;
+    }
+
+    void writeToStderr(const LogRecord& record)
+    {
+        //Formatted apart, so cerr's own flags are left as other code set them
+        ostringstream line;
+        line << "[" << fixed << setprecision(6) << setw(11) << record.seconds << "] " << left << setw(7)
+             << logLevelName(record.level) << right << " t" << record.thread << " " << record.file << ":"
+             << record.line << "  " << record.text << '\n';
+        cerr << line.str();
+    }
+
+    class LogQueue
+    {
+    public:
+        LogQueue();
+        ~LogQueue();
+        void push(LogLevel level, const char* file, int line, const string& text);
+        void flush();
+        void setSink(function<void(const LogRecord&)> sink);
+        unsigned long long dropped() const { return m_dropped.load(); }
+    private:
+        bool popOne();
+        void reportDrops();
+        void deliver(const LogRecord& record);
+        void consumerLoop();
+
+        vector<Slot> m_slots;
+        atomic<size_t> m_tail;                      // next position to claim
+        atomic<size_t> m_head;                      // next position to read; only the logging thread moves it
+        atomic<unsigned long long> m_dropped;
+        unsigned long long m_reportedDrops;         // logging thread only
+        atomic<unsigned int> m_threadCount;
+        chrono::steady_clock::time_point m_start;
+        mutex m_sinkMutex;                          // guards m_sink; producers never take it
+        function<void(const LogRecord&)> m_sink;
+        mutex m_mutex;                              // guards sleeping, waking and m_stopping
+        condition_variable m_wake;
+        bool m_stopping;
+        thread m_consumer;
+    };
+
+    LogQueue::LogQueue()
+        : m_slots(SLOT_COUNT), m_tail(0), m_head(0), m_dropped(0), m_reportedDrops(0), m_threadCount(0),
+          m_start(chrono::steady_clock::now()), m_stopping(false)
+    {
+        for (size_t i = 0; i < SLOT_COUNT; i++)
+            m_slots[i].sequence.store(i, memory_order_relaxed);
+        m_consumer = thread(&LogQueue::consumerLoop, this);
+    }
+
+    LogQueue::~LogQueue()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_consumer.join();
+        cerr.flush();
+    }
+
+    void LogQueue::push(LogLevel level, const char* file, int line, const string& text)
+    {
+        if (t_thread == 0)
+            t_thread = ++m_threadCount;
+        //Claims the slot at the tail, unless the logging thread has not read it yet
+        size_t position = m_tail.load(memory_order_relaxed);
+        Slot* slot;
+        for (;;) {
+            slot = &m_slots[position & (SLOT_COUNT - 1)];
+            size_t sequence = slot->sequence.load(memory_order_acquire);
+            if (sequence == position) {
+                if (m_tail.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                    break;
+            }
+            else if (sequence < position) { //a lap behind: the buffer is full
+                m_dropped++;
+                return;
+            }
+            else
+                position = m_tail.load(memory_order_relaxed);
+        }
+        slot->level = level;
+        slot->time = chrono::steady_clock::now();
+        slot->thread = t_thread;
+        slot->file = file;
+        slot->line = line;
+        size_t length = text.size() < MAX_TEXT ? text.size() : MAX_TEXT;
+        memcpy(slot->text, text.data(), length);
+        slot->text[length] = '\0';
+        slot->sequence.store(position + 1, memory_order_release);
+    }
+
+    bool LogQueue::popOne()
+    {
+        size_t position = m_head.load(memory_order_relaxed);
+        Slot& slot = m_slots[position & (SLOT_COUNT - 1)];
+        if (slot.sequence.load(memory_order_acquire) != position + 1)
+            return false;  //empty, or the producer is still writing it
+        LogRecord record = { slot.level, chrono::duration<double>(slot.time - m_start).count(), slot.thread,
+                             baseName(slot.file), slot.line, slot.text };
+        deliver(record);
+        slot.sequence.store(position + SLOT_COUNT, memory_order_release);
+        m_head.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    void LogQueue::reportDrops()
+    {
+        unsigned long long dropped = m_dropped.load();
+        if (dropped == m_reportedDrops)
+            return;
+        string text = to_string(dropped - m_reportedDrops) + " log messages dropped, the log buffer was full";
+        LogRecord record = { LOG_WARNING, chrono::duration<double>(chrono::steady_clock::now() - m_start).count(),
+                             0, "Logger.cpp", __LINE__, text.c_str() };
+        deliver(record);
+        m_reportedDrops = dropped;
+    }
+
+    void LogQueue::deliver(const LogRecord& record)
+    {
+        lock_guard<mutex> lock(m_sinkMutex);
+        try {
+            if (m_sink)
+                m_sink(record);
+            else
+                writeToStderr(record);
+        }
+        catch (...) { //a failing sink loses its record, not the logging thread
+        }
+    }
+
+    void LogQueue::consumerLoop()
+    {
+        for (;;) {
+            while (popOne())
+                ;
+            reportDrops();
+            unique_lock<mutex> lock(m_mutex);
+            if (m_stopping)
+                break;
+            m_wake.wait_for(lock, IDLE_WAIT);
+        }
+        while (popOne())
+            ;
+        reportDrops();
+    }
+
+    void LogQueue::flush()
+    {
+        size_t target = m_tail.load(memory_order_acquire);
+        while (m_head.load(memory_order_acquire) < target) {
+            m_wake.notify_one();
+            this_thread::yield();
+        }
+        lock_guard<mutex> lock(m_sinkMutex);
+        if (!m_sink)
+            cerr.flush();
+    }
+
+    void LogQueue::setSink(function<void(const LogRecord&)> sink)
+    {
+        lock_guard<mutex> lock(m_sinkMutex);
+        m_sink = sink;
+    }
+
+      // Made by the first message, so a program that never logs never starts the thread
+    LogQueue& logQueue()
+    {
+        static LogQueue queue;
+        return queue;
+    }
+}
+
+void setLogLevel(LogLevel level)
+{
+    g_logLevel.store(level, memory_order_relaxed);
+}
+
+LogLevel logLevel()
+{
+    return (LogLevel)g_logLevel.load(memory_order_relaxed);
+}
+
+void setLogSink(function<void(const LogRecord&)> sink)
+{
+    logQueue().setSink(sink);
+}
+
+void flushLog()
+{
+    logQueue().flush();
+}
+
+unsigned long long droppedLogRecords()
+{
+    return logQueue().dropped();
+}
+
+void writeLog(LogLevel level, const char* file, int line, const string& text)
+{
+    logQueue().push(level, file, line, text);
+}
+
+const char* logLevelName(LogLevel level)
+{
+    static const char* const NAMES[] = { "TRACE", "DEBUG", "INFO", "WARNING", "ERROR", "OFF" };
+    return level >= LOG_TRACE && level <= LOG_OFF ? NAMES[level] : "?";
+}
+
+bool parseLogLevel(const string& name, LogLevel& level)
+{
+    for (int candidate = LOG_TRACE; candidate <= LOG_OFF; candidate++) {
+        const char* known = logLevelName((LogLevel)candidate);
+        if (name.size() == strlen(known) && equal(name.begin(), name.end(), known,
+                [](char a, char b) { return toupper((unsigned char)a) == b; })) {
+            level = (LogLevel)candidate;
+            return true;
+        }
+    }
+    return false;
+}
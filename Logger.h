@@ -0,0 +1,82 @@
+// Logger.h
+
+// Leveled diagnostics that cost next to nothing when they are not wanted and
+// never make the thread that logs wait on stderr.
+//
+//   LOG_DEBUG("matrix row " << row << " done in " << ms << " ms");
+//
+// A message below LOG_MIN_LEVEL, a compile-time constant, is removed by the
+// compiler altogether; build with -DLOG_MIN_LEVEL=2 to strip trace and debug
+// messages from a release build.  One below the runtime level, setLogLevel(),
+// costs a relaxed atomic load and a compare; the message is not formatted.
+//
+// A message that is wanted is formatted on the calling thread, stamped with
+// its level, time, thread and source line, and put on a fixed ring buffer of
+// records.  Producers claim a slot with one compare-and-swap and publish it
+// with a sequence number, so they never lock; a single background thread,
+// started by the first message, takes records off in order and hands them to
+// the sink: by default one line each on stderr, or setLogSink()'s function.
+// When producers outrun the sink the buffer fills and further messages are
+// dropped and counted rather than blocking, and the count is reported once
+// there is room again.  Messages longer than a slot's text are cut short.
+//
+// flushLog() waits for everything logged so far to reach the sink; it also
+// happens when the program exits normally.
+
+#ifndef LOGGER_INCLUDED
+#define LOGGER_INCLUDED
+
+#include <string>
+#include <sstream>
+#include <functional>
+#include <atomic>
+
+enum LogLevel { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARNING, LOG_ERROR, LOG_OFF };
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0     // LOG_TRACE: every message compiled in
+#endif
+
+struct LogRecord
+{
+    LogLevel    level;
+    double      seconds;        // since the logger started
+    unsigned int thread;        // small number, in the order threads first logged
+    const char* file;           // file name without its directory
+    int         line;
+    const char* text;           // NUL terminated; only valid during the sink call
+};
+
+extern std::atomic<int> g_logLevel;
+
+inline bool logEnabled(LogLevel level)
+{
+    return level >= LOG_MIN_LEVEL && level >= g_logLevel.load(std::memory_order_relaxed);
+}
+
+void setLogLevel(LogLevel level);               // LOG_INFO to start with
+LogLevel logLevel();
+  // sink runs on the logging thread, one record at a time; an empty function restores stderr
+void setLogSink(std::function<void(const LogRecord&)> sink);
+void flushLog();
+unsigned long long droppedLogRecords();         // since the program started
+void writeLog(LogLevel level, const char* file, int line, const std::string& text);
+const char* logLevelName(LogLevel level);
+bool parseLogLevel(const std::string& name, LogLevel& level);   // a name as logLevelName gives, any case
+
+#define LOG_AT(level, message)                                              \
+    do {                                                                    \
+        if (logEnabled(level)) {                                            \
+            std::ostringstream logStream_;                                  \
+            logStream_ << message;                                          \
+            writeLog((level), __FILE__, __LINE__, logStream_.str());        \
+        }                                                                   \
+    } while (false)
+
+#define LOG_TRACE(message)   LOG_AT(LOG_TRACE, message)
+#define LOG_DEBUG(message)   LOG_AT(LOG_DEBUG, message)
+#define LOG_INFO(message)    LOG_AT(LOG_INFO, message)
+#define LOG_WARNING(message) LOG_AT(LOG_WARNING, message)
+#define LOG_ERROR(message)   LOG_AT(LOG_ERROR, message)
+
+#endif // LOGGER_INCLUDED
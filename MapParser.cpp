@@ -0,0 +1,277 @@
+#include "MapParser.h"
+#include "FlatHashMap.h"
+#include <cstring>
+#include <cstdlib>
+using namespace std;
+
+namespace
+{
+    const double POWERS_OF_TEN[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const int MAX_EXACT_DIGITS = 15;        // 10^15 < 2^53, so the digits are an exact double
+    const int MAX_EXACT_FRACTION = 22;      // and so is 10^22
+    const uint32_t MAX_COUNT_DIGITS = 9;
+    const size_t MAX_QUOTED = 40;           // characters of a bad line repeated in its error
+
+    struct Line
+    {
+        const char* begin;
+        const char* end;                    // without the newline or a carriage return before it
+    };
+
+    bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* skipSpaces(const char* p, const char* end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+      // Takes the line at p, moving p past it; false if there is none or, unless atEnd,
+      // it has no newline before limit and so may continue past it
+    bool takeLine(const char*& p, const char* limit, bool atEnd, Line& line)
+    {
+        if (p >= limit)
+            return false;
+        const char* newline = static_cast<const char*>(memchr(p, '\n', limit - p));
+        if (newline == nullptr && !atEnd)
+            return false;
+        line.begin = p;
+        line.end = newline ? newline : limit;
+        if (line.end > line.begin && line.end[-1] == '\r')
+            line.end--;
+        p = newline ? newline + 1 : limit;
+        return true;
+    }
+
+    bool isBlank(const Line& line)
+    {
+        return skipSpaces(line.begin, line.end) == line.end;
+    }
+
+      // One number at p, which must end at whitespace or end; p is left after it
+    bool parseNumber(const char*& p, const char* end, double& value)
+    {
+        const char* start = p;
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        uint64_t digits = 0;
+        int significant = 0, fraction = 0;
+        bool anyDigit = false, dot = false;
+        for (; p < end; p++) {
+            char c = *p;
+            if (c >= '0' && c <= '9') {
+                anyDigit = true;
+                if (significant > 0 || c != '0')
+                    significant++;
+                if (significant <= MAX_EXACT_DIGITS)
+                    digits = digits * 10 + (c - '0');
+                if (dot)
+                    fraction++;
+            }
+            else if (c == '.' && !dot)
+                dot = true;
+            else
+                break;
+        }
+        if (anyDigit && significant <= MAX_EXACT_DIGITS && fraction <= MAX_EXACT_FRACTION && (p == end || isSpace(*p))) {
+            value = (double)digits / POWERS_OF_TEN[fraction];
+            if (negative)
+                value = -value;
+            return true;
+        }
+        //Too many digits, an exponent, or not a number at all
+        while (p < end && !isSpace(*p))
+            p++;
+        string token(start, p);
+        char* stop;
+        value = strtod(token.c_str(), &stop);
+        return !token.empty() && stop == token.c_str() + token.size();
+    }
+
+      // Four numbers and nothing else; texts[i] and lengths[i] give where each was written
+    bool parseSegment(const Line& line, double values[4], const char* texts[4], uint32_t lengths[4])
+    {
+        const char* p = line.begin;
+        for (int i = 0; i < 4; i++) {
+            p = skipSpaces(p, line.end);
+            texts[i] = p;
+            if (!parseNumber(p, line.end, values[i]))
+                return false;
+            lengths[i] = (uint32_t)(p - texts[i]);
+        }
+        return skipSpaces(p, line.end) == line.end;
+    }
+
+    bool isSegment(const Line& line)
+    {
+        double values[4];
+        const char* texts[4];
+        uint32_t lengths[4];
+        return parseSegment(line, values, texts, lengths);
+    }
+
+    bool parseCount(const Line& line, uint32_t& count)
+    {
+        const char* p = skipSpaces(line.begin, line.end);
+        const char* digits = p;
+        count = 0;
+        while (p < line.end && *p >= '0' && *p <= '9' && p - digits < MAX_COUNT_DIGITS)
+            count = count * 10 + (*p++ - '0');
+        return p > digits && skipSpaces(p, line.end) == line.end;
+    }
+
+      // A name, then a count of at least one, then a segment
+    bool isRecordStart(const char* p, const char* limit, bool atEnd)
+    {
+        Line name, count, segment;
+        uint32_t segments;
+        return takeLine(p, limit, atEnd, name) && !isBlank(name) && !isSegment(name)
+            && takeLine(p, limit, atEnd, count) && parseCount(count, segments) && segments > 0
+            && takeLine(p, limit, atEnd, segment) && isSegment(segment);
+    }
+
+    string quoted(const Line& line)
+    {
+        size_t length = line.end - line.begin;
+        string text(line.begin, length < MAX_QUOTED ? length : MAX_QUOTED);
+        return "'" + text + (length > MAX_QUOTED ? "...'" : "'");
+    }
+}
+
+size_t findRecordStart(const char* text, size_t size, size_t from, bool atEnd)
+{
+    const char* limit = text + size;
+    const char* p = text + from;
+    Line line;
+    if (from > 0 && text[from - 1] != '\n' && !takeLine(p, limit, atEnd, line))  //from is mid-line
+        return size;
+    while (p < limit) {
+        if (isRecordStart(p, limit, atEnd))
+            return p - text;
+        if (!takeLine(p, limit, atEnd, line))
+            break;
+    }
+    return size;
+}
+
+void parseMapPiece(const char* text, size_t begin, size_t end, size_t size, bool atEnd, MapPiece& piece)
+{
+    piece.streets.clear();
+    piece.nodes.clear();
+    piece.segments.clear();
+    piece.errors.clear();
+    piece.lines = 0;
+    const char* p = text + begin;
+    const char* stop = text + end;
+    const char* limit = text + size;
+    FlatHashMap<CoordKey, uint32_t> nodeIds;
+    nodeIds.reserve((unsigned int)((end - begin) / 48));   //at most about one new node per segment line
+    GeoCoord ends[2];  //only their latitude and longitude are used, to measure segments
+    Line line;
+
+    auto take = [&](Line& l) {
+        if (!takeLine(p, stop, atEnd || stop < limit, l))
+            return false;
+        if (p[-1] == '\n')
+            piece.lines++;
+        return true;
+    };
+    auto fail = [&](uint32_t at, const string& message) {
+        MapError error = { at, message };
+        piece.errors.push_back(error);
+    };
+      // Back to the start of the line just taken, then on to the next record start
+    auto resync = [&](const Line& from, uint32_t at) {
+        p = from.begin;
+        piece.lines = at;
+        Line skipped;
+        while (p < stop && !isRecordStart(p, limit, atEnd) && take(skipped))
+            ;
+    };
+
+    while (p < stop) {
+        uint32_t nameLine = piece.lines;
+        take(line);
+        if (isBlank(line))
+            continue;
+        if (isSegment(line)) {
+            fail(nameLine, "segment outside any street");
+            resync(line, nameLine);
+            continue;
+        }
+        MapStreet street = { line.begin, (uint32_t)(line.end - line.begin) };
+        string name(street.name, street.nameLength);
+        uint32_t countLine = piece.lines;
+        Line countText;
+        uint32_t count;
+        if (!take(countText)) {
+            //The piece ends with a name, so the record after it is what follows
+            const char* next = p;
+            if (!takeLine(next, limit, atEnd, countText)) {
+                fail(countLine, "file ends before the segment count of street '" + name + "'");
+                break;
+            }
+            fail(countLine, "expected the segment count of street '" + name + "', found " + quoted(countText));
+            continue;
+        }
+        if (!parseCount(countText, count)) {
+            fail(countLine, "expected the segment count of street '" + name + "', found " + quoted(countText));
+            resync(countText, countLine);
+            continue;
+        }
+        uint32_t streetIndex = (uint32_t)piece.streets.size();
+        piece.streets.push_back(street);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t segmentLine = piece.lines;
+            double values[4];
+            const char* texts[4];
+            uint32_t lengths[4];
+            if (p >= stop && stop == limit && atEnd) {
+                fail(segmentLine, "file ends after " + to_string(i) + " of the " + to_string(count)
+                    + " segments of street '" + name + "'");
+                break;
+            }
+            bool took = take(line);
+            if (!took || !parseSegment(line, values, texts, lengths)) {
+                //A piece ends where a record starts, so running into its end is a short count too
+                fail(segmentLine, "expected segment " + to_string(i + 1) + " of " + to_string(count)
+                    + " of street '" + name + "'");
+                if (took)
+                    resync(line, segmentLine);
+                break;
+            }
+            MapSegment segment;
+            segment.street = streetIndex;
+            for (int e = 0; e < 2; e++) {
+                CoordKey key = makeCoordKey(values[2 * e], values[2 * e + 1]);
+                if (e == 0 && !piece.segments.empty() && piece.nodes[piece.segments.back().ends[1]].key == key) {
+                    segment.ends[0] = piece.segments.back().ends[1];  //segments of a street mostly chain end to start
+                    ends[0] = ends[1];
+                    continue;
+                }
+                const uint32_t* found = nodeIds.find(key);
+                if (found == nullptr) {
+                    MapNode node = { key, values[2 * e], values[2 * e + 1], texts[2 * e], texts[2 * e + 1],
+                                     lengths[2 * e], lengths[2 * e + 1] };
+                    segment.ends[e] = (uint32_t)piece.nodes.size();
+                    nodeIds.associate(key, segment.ends[e]);
+                    piece.nodes.push_back(node);
+                }
+                else
+                    segment.ends[e] = *found;
+                ends[e].latitude = values[2 * e];
+                ends[e].longitude = values[2 * e + 1];
+            }
+            segment.length = distanceEarthMiles(ends[0], ends[1]);
+            piece.segments.push_back(segment);
+        }
+    }
+}
@@ -0,0 +1,82 @@
+// MapParser.h
+
+// Parses the text map format a piece at a time, so that load() can read the
+// file in large blocks and hand separate pieces of each block to separate
+// threads.  The file is a sequence of street records:
+//   a line with the street's name
+//   a line with the number of segments that follow
+//   one line per segment: start latitude, start longitude, end latitude, end longitude
+//
+// Nothing in a record says where it starts, so a piece boundary is found by
+// looking at the lines themselves: a record starts at a line that is not a
+// segment, followed by a line holding just a count, followed by a segment.
+// Only a street named like four numbers could fool that.  The same test is
+// used to get back in step after a malformed record, so a file is parsed the
+// same way however it is split.
+//
+// A piece is parsed into its own streets, its distinct nodes in the order they
+// are first seen, and segments referring to both by their index in the piece;
+// joining pieces in file order then numbers nodes exactly as reading the whole
+// file in one go would.  Coordinates are converted without going through
+// strings: a decimal with at most 15 significant digits is its digits divided
+// by a power of ten, both exact doubles, which rounds the same as stod.  Any
+// other number falls back to strtod.
+
+#ifndef MAPPARSER_INCLUDED
+#define MAPPARSER_INCLUDED
+
+#include "CoordKey.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct MapStreet
+{
+    const char* name;               // into the parsed text, not NUL terminated
+    uint32_t    nameLength;
+};
+
+struct MapNode
+{
+    CoordKey    key;
+    double      latitude;
+    double      longitude;
+    const char* latitudeText;       // as written in the file, into the parsed text
+    const char* longitudeText;
+    uint32_t    latitudeLength;
+    uint32_t    longitudeLength;
+};
+
+struct MapSegment
+{
+    uint32_t street;                // index into the piece's streets
+    uint32_t ends[2];               // indexes into the piece's nodes
+    double   length;                // miles
+};
+
+struct MapError
+{
+    uint32_t    line;               // counted from the start of the piece, from 0
+    std::string message;
+};
+
+struct MapPiece
+{
+    std::vector<MapStreet>  streets;
+    std::vector<MapNode>    nodes;
+    std::vector<MapSegment> segments;
+    std::vector<MapError>   errors;
+    uint32_t                lines;  // newlines in the piece
+};
+
+  // offset of the first record start at or after from, in the first size bytes of
+  // text, or size if there is none; a record whose lines are cut off by size only
+  // counts if atEnd says nothing follows
+size_t findRecordStart(const char* text, size_t size, size_t from, bool atEnd);
+
+  // parses text[begin, end), where begin is the start of the text or of a record;
+  // lines may be looked at up to size to get back in step after an error
+void parseMapPiece(const char* text, size_t begin, size_t end, size_t size, bool atEnd, MapPiece& piece);
+
+#endif // MAPPARSER_INCLUDED
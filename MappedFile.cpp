@@ -0,0 +1,108 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_file(nullptr), m_mapping(nullptr)
+{
+}
+
+bool MappedFile::open(const string& path)
+{
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) { //empty files can't be mapped
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const char*>(view);
+    m_size = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+        UnmapViewOfFile(m_data);
+    if (m_mapping != nullptr)
+        CloseHandle(m_mapping);
+    if (m_file != nullptr)
+        CloseHandle(m_file);
+    m_data = nullptr;
+    m_size = 0;
+    m_file = nullptr;
+    m_mapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile()
+    : m_data(nullptr), m_size(0), m_fd(-1)
+{
+}
+
+bool MappedFile::open(const string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { //empty files can't be mapped
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_data = static_cast<const char*>(view);
+    m_size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+    if (m_fd >= 0)
+        ::close(m_fd);
+    m_data = nullptr;
+    m_size = 0;
+    m_fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
@@ -0,0 +1,58 @@
+// MappedFile.h
+
+// Read-only memory mapping of a whole file, used to load binary snapshots
+// without copying or parsing them.
+
+#ifndef MAPPEDFILE_INCLUDED
+#define MAPPEDFILE_INCLUDED
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+    bool open(const std::string& path);   // maps the file, closing any previous mapping
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+      // We prevent a MappedFile object from being copied or assigned.
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+private:
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void* m_file;
+    void* m_mapping;
+#else
+    int m_fd;
+#endif
+};
+
+  // 64-bit checksum over a byte range, processed a word at a time so that
+  // verifying a large snapshot costs about as much as reading it once
+inline uint64_t checksumBytes(const char* data, size_t size)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word = 0;
+        for (int b = 0; b < 8; b++) { //little-endian assembly, compilers fold this into one load
+            word |= (uint64_t)(unsigned char)data[i + b] << (8 * b);
+        }
+        h = (h ^ word) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < size; i++) { //leftover tail bytes
+        h = (h ^ (unsigned char)data[i]) * prime;
+    }
+    return h;
+}
+
+#endif // MAPPEDFILE_INCLUDED
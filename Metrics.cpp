@@ -0,0 +1,214 @@
+#include "Metrics.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <fstream>
+#include <cmath>
+#include <limits>
+using namespace std;
+
+atomic<bool> g_metricsEnabled(false);
+
+namespace
+{
+    const double NO_VALUE = numeric_limits<double>::quiet_NaN();
+
+      // atomic<double> has no arithmetic before C++20
+    void addTo(atomic<double>& total, double value)
+    {
+        double seen = total.load(memory_order_relaxed);
+        while (!total.compare_exchange_weak(seen, seen + value, memory_order_relaxed))
+            ;
+    }
+
+    template<typename Better>
+    void keepBest(atomic<double>& best, double value, Better better)
+    {
+        double seen = best.load(memory_order_relaxed);
+        while ((std::isnan(seen) || better(value, seen)) && !best.compare_exchange_weak(seen, value, memory_order_relaxed))
+            ;
+    }
+
+    struct Registry
+    {
+        mutex m_mutex;
+        vector<unique_ptr<Histogram>> m_histograms;     // in the order they were made
+    };
+
+    Registry& registry()
+    {
+        static Registry r;
+        return r;
+    }
+
+    void writeNumber(ostringstream& out, double value)
+    {
+        //JSON has no NaN or infinity; both mean nothing was recorded here
+        if (std::isfinite(value))
+            out << value;
+        else
+            out << "null";
+    }
+}
+
+Histogram::Histogram(const string& name, const string& help)
+    : m_name(name), m_help(help)
+{
+    reset();
+}
+
+void Histogram::reset()
+{
+    for (int i = 0; i < BUCKET_COUNT; i++)
+        m_buckets[i].store(0, memory_order_relaxed);
+    m_count.store(0, memory_order_relaxed);
+    m_sum.store(0, memory_order_relaxed);
+    m_min.store(NO_VALUE, memory_order_relaxed);
+    m_max.store(NO_VALUE, memory_order_relaxed);
+}
+
+int Histogram::bucketFor(double value)
+{
+    if (!(value > 0))
+        return 0;
+    //value = fraction * 2^exponent with fraction in [0.5, 1); sub-buckets split each power of two evenly
+    int exponent;
+    double fraction = frexp(value, &exponent);
+    exponent--;
+    if (exponent < MIN_EXPONENT)
+        return 1;
+    if (exponent >= MAX_EXPONENT)
+        return BUCKET_COUNT - 1;
+    int sub = (int)((fraction * 2 - 1) * SUB_BUCKETS);
+    return 1 + (exponent - MIN_EXPONENT) * SUB_BUCKETS + sub;
+}
+
+double Histogram::bucketMiddle(int bucket)
+{
+    if (bucket == 0)
+        return 0;
+    int exponent = (bucket - 1) / SUB_BUCKETS + MIN_EXPONENT;
+    int sub = (bucket - 1) % SUB_BUCKETS;
+    return ldexp(1 + (sub + 0.5) / SUB_BUCKETS, exponent);
+}
+
+void Histogram::record(double value)
+{
+    m_buckets[bucketFor(value)].fetch_add(1, memory_order_relaxed);
+    m_count.fetch_add(1, memory_order_relaxed);
+    addTo(m_sum, value);
+    keepBest(m_min, value, [](double a, double b) { return a < b; });
+    keepBest(m_max, value, [](double a, double b) { return a > b; });
+}
+
+double Histogram::min() const
+{
+    return m_min.load(memory_order_relaxed);
+}
+
+double Histogram::max() const
+{
+    return m_max.load(memory_order_relaxed);
+}
+
+double Histogram::percentile(double fraction) const
+{
+    //Read while others may still record, so the buckets may add up to a little more than count
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+    uint64_t rank = (uint64_t)ceil(fraction * total);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    int bucket = 0;
+    for (; bucket < BUCKET_COUNT - 1; bucket++) {
+        seen += m_buckets[bucket].load(memory_order_relaxed);
+        if (seen >= rank)
+            break;
+    }
+    //The exact extremes are better than the middle of the end buckets
+    double value = bucketMiddle(bucket);
+    if (value < min())
+        value = min();
+    if (value > max())
+        value = max();
+    return value;
+}
+
+void enableMetrics(bool enabled)
+{
+    g_metricsEnabled.store(enabled, memory_order_relaxed);
+}
+
+Histogram& metricsHistogram(const string& name, const string& help)
+{
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.m_mutex);
+    for (size_t i = 0; i < r.m_histograms.size(); i++)
+        if (r.m_histograms[i]->name() == name)
+            return *r.m_histograms[i];
+    r.m_histograms.push_back(unique_ptr<Histogram>(new Histogram(name, help)));
+    return *r.m_histograms.back();
+}
+
+void resetMetrics()
+{
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.m_mutex);
+    for (size_t i = 0; i < r.m_histograms.size(); i++)
+        r.m_histograms[i]->reset();
+}
+
+string metricsJson()
+{
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.m_mutex);
+    ostringstream out;
+    out.precision(9);
+    out << "{";
+    for (size_t i = 0; i < r.m_histograms.size(); i++) {
+        const Histogram& h = *r.m_histograms[i];
+        out << (i == 0 ? "\n" : ",\n") << "  \"" << h.name() << "\": {\"count\": " << h.count() << ", \"sum\": ";
+        writeNumber(out, h.sum());
+        out << ", \"min\": ";
+        writeNumber(out, h.min());
+        out << ", \"max\": ";
+        writeNumber(out, h.max());
+        out << ", \"p50\": ";
+        writeNumber(out, h.percentile(0.5));
+        out << ", \"p99\": ";
+        writeNumber(out, h.percentile(0.99));
+        out << "}";
+    }
+    out << "\n}\n";
+    return out.str();
+}
+
+string metricsPrometheus()
+{
+    Registry& r = registry();
+    lock_guard<mutex> lock(r.m_mutex);
+    ostringstream out;
+    out.precision(9);
+    for (size_t i = 0; i < r.m_histograms.size(); i++) {
+        const Histogram& h = *r.m_histograms[i];
+        out << "# HELP " << h.name() << " " << h.help() << "\n"
+            << "# TYPE " << h.name() << " summary\n"
+            << h.name() << "{quantile=\"0.5\"} " << h.percentile(0.5) << "\n"
+            << h.name() << "{quantile=\"0.99\"} " << h.percentile(0.99) << "\n"
+            << h.name() << "_sum " << h.sum() << "\n"
+            << h.name() << "_count " << h.count() << "\n";
+    }
+    return out.str();
+}
+
+bool writeMetrics(const string& path, bool prometheus)
+{
+    ofstream outfile(path, ios::trunc);
+    if (!outfile)
+        return false;
+    outfile << (prometheus ? metricsPrometheus() : metricsJson());
+    return (bool)outfile;
+}
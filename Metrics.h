@@ -0,0 +1,94 @@
+// Metrics.h
+
+// Process-wide registry of latency and size histograms, fed by the router and
+// planner when enableMetrics(true) is set and dumped as JSON or in the
+// Prometheus text format.  While disabled, which is how a program starts, the
+// only cost at each instrumented call is one relaxed atomic load: clocks are
+// not read and nothing is recorded.
+//
+// A histogram keeps counts in log-linear buckets: eight per power of two from
+// about a nanosecond (2^-30) up to 2^34, so a percentile read back is the
+// middle of its bucket and within 1/16 of the true value.  Recording is a few
+// relaxed atomic adds with no lock, from any number of threads; values outside
+// the range land in the end buckets, and min and max are kept exactly.
+//
+// metricsHistogram() finds or makes a histogram by name under a lock, so hot
+// paths look theirs up once and keep the reference; histograms are never
+// destroyed, and resetMetrics() only zeroes them.
+
+#ifndef METRICS_INCLUDED
+#define METRICS_INCLUDED
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+class Histogram
+{
+public:
+    Histogram(const std::string& name, const std::string& help);
+    void record(double value);
+    void reset();
+    const std::string& name() const { return m_name; }
+    const std::string& help() const { return m_help; }
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    double sum() const { return m_sum.load(std::memory_order_relaxed); }
+    double min() const;
+    double max() const;
+    double percentile(double fraction) const;   // 0.5 for the median; 0 if nothing was recorded
+      // We prevent a Histogram object from being copied or assigned.
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+private:
+    static const int SUB_BUCKETS = 8;
+    static const int MIN_EXPONENT = -30;
+    static const int MAX_EXPONENT = 34;
+    static const int BUCKET_COUNT = (MAX_EXPONENT - MIN_EXPONENT) * SUB_BUCKETS + 1;  // the first holds 0 and below
+    static int bucketFor(double value);
+    static double bucketMiddle(int bucket);
+
+    std::string m_name;
+    std::string m_help;
+    std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+    std::atomic<uint64_t> m_count;
+    std::atomic<double> m_sum;
+    std::atomic<double> m_min;
+    std::atomic<double> m_max;
+};
+
+extern std::atomic<bool> g_metricsEnabled;
+
+inline bool metricsEnabled()
+{
+    return g_metricsEnabled.load(std::memory_order_relaxed);
+}
+
+void enableMetrics(bool enabled);
+Histogram& metricsHistogram(const std::string& name, const std::string& help);
+void resetMetrics();
+std::string metricsJson();              // {"name": {"count": .., "sum": .., "min": .., "max": .., "p50": .., "p99": ..}, ..}
+std::string metricsPrometheus();        // each histogram as a summary with 0.5 and 0.99 quantiles
+bool writeMetrics(const std::string& path, bool prometheus);
+
+  // Seconds since construction, when on; reads no clock when off
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(bool on)
+     : m_on(on)
+    {
+        if (on)
+            m_start = std::chrono::steady_clock::now();
+    }
+    bool on() const { return m_on; }
+    double seconds() const
+    {
+        return m_on ? std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count() : 0;
+    }
+private:
+    bool m_on;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#endif // METRICS_INCLUDED
@@ -4,9 +4,34 @@
 #include <queue>
 #include <unordered_set>
 #include <iostream>
-#include "ExpandableHashMap.h"
+#include <algorithm>
+#include <limits>
+#include "IndexedHeap.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "Metrics.h"
+#include "Haversine.h"
 using namespace std;
 
+namespace
+{
+    void recordRoute(const RouteMetrics& counts)
+    {
+        static Histogram& seconds = metricsHistogram("route_seconds", "Wall time of one point-to-point route");
+        static Histogram& expanded = metricsHistogram("route_nodes_expanded", "Nodes expanded finding one route");
+        seconds.record(counts.seconds);
+        expanded.record((double)counts.nodesExpanded);
+    }
+
+    void recordMatrix(const RouteMetrics& counts)
+    {
+        static Histogram& seconds = metricsHistogram("matrix_seconds", "Wall time of one distance matrix");
+        static Histogram& expanded = metricsHistogram("matrix_nodes_expanded", "Nodes expanded by all rows of one distance matrix");
+        seconds.record(counts.seconds);
+        expanded.record((double)counts.nodesExpanded);
+    }
+}
+
 class PointToPointRouterImpl
 {
 public:
@@ -16,98 +41,406 @@ public:
         const GeoCoord& start,
         const GeoCoord& end,
         list<StreetSegment>& route,
-        double& totalDistanceTravelled) const;
+        double& totalDistanceTravelled,
+        RouteMetrics* metrics) const;
+    DeliveryResult computeDistanceMatrix(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        vector<vector<double>>& matrix,
+        RouteMetrics* metrics) const;
+    unsigned int nodesExpanded() const;
+    void useContractionHierarchy(const ContractionHierarchy* ch);
+    void useLandmarks(const LandmarkTable* landmarks);
+    void useLegCache(LegCache* cache);
+    void useThreadPool(ThreadPool* pool);
 private:
-    struct LowestFScore {
-    public:
-        LowestFScore(GeoCoord a, double v) : m_coord(a), m_fScore(v) {}
-        GeoCoord m_coord;
-        double m_fScore;    
-    };    
-    struct CompareFScore {
-        bool operator()(LowestFScore const& p1, LowestFScore const& p2)
+      // Scratch state for one search, indexed by node ID.  A node's entries only
+      // count when its stamp equals the current generation, so starting the next
+      // search is a counter increment instead of clearing or reallocating.
+    struct SearchContext {
+        SearchContext() : m_generation(0), m_expanded(0), m_pushes(0) {}
+        void begin(unsigned int nodeCount);
+        bool seen(unsigned int node) const { return m_stamp[node] == m_generation; }
+        bool closed(unsigned int node) const { return m_closedStamp[node] == m_generation; }
+        void close(unsigned int node) { m_closedStamp[node] = m_generation; }
+        void record(unsigned int node, double g, unsigned int parent, const StreetEdge* edge)
         {
-            // return "true" if "p1" is ordered  
-            // before "p2", for example: 
-            return p1.m_fScore > p2.m_fScore;
+            m_stamp[node] = m_generation;
+            m_gScore[node] = g;
+            m_parent[node] = parent;
+            m_parentEdge[node] = edge;
         }
+        vector<unsigned int> m_stamp;
+        vector<unsigned int> m_closedStamp;         // closed set: already expanded with its final g-score
+        vector<double> m_gScore;
+        vector<unsigned int> m_parent;              // node we arrived from
+        vector<const StreetEdge*> m_parentEdge;     // edge taken out of it
+        vector<double> m_heuristic;                 // great-circle miles to the target, for seen nodes
+        RadianCoords m_batch;                       // neighbours whose great-circle bound is due
+        vector<unsigned int> m_batchNodes;
+        vector<double> m_batchMiles;
+        IndexedHeap m_openSet;                      // keyed by f-score, one entry per node
+        unsigned int m_generation;
+        unsigned int m_expanded;                    // nodes expanded by the last search
+        unsigned int m_pushes;                      // and open-set pushes it made
     };
+    SearchContext& searchContext() const;
+    void crowMiles(SearchContext& ctx, unsigned int target) const;
+    DeliveryResult findRoute(const GeoCoord& start, const GeoCoord& end, list<StreetSegment>& route,
+        double& totalDistanceTravelled, RouteMetrics& counts) const;
+    DeliveryResult fillMatrix(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+        vector<vector<double>>& matrix, RouteMetrics& counts) const;
+    void distancesFrom(unsigned int origin, const vector<pair<unsigned int, unsigned int>>& targets,
+        unsigned int distinctTargets, vector<double>& row) const;
+    bool findPath(unsigned int startNode, unsigned int endNode,
+        vector<unsigned int>& nodes, vector<const StreetEdge*>& edges) const;
     const StreetMap* m_sm;
+    const ContractionHierarchy* m_ch;   // answers queries instead of A* when set and ready
+    const LandmarkTable* m_landmarks;   // A* heuristic instead of straight-line distance when set and ready
+    LegCache* m_cache;                  // consulted before searching, and filled after, when set
+    ThreadPool* m_pool;                 // runs matrix rows concurrently when set
 };
 
 PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm)
 {
     m_sm = sm;
+    m_ch = nullptr;
+    m_landmarks = nullptr;
+    m_cache = nullptr;
+    m_pool = nullptr;
 }
 
 PointToPointRouterImpl::~PointToPointRouterImpl()
 {
 }
 
+void PointToPointRouterImpl::SearchContext::begin(unsigned int nodeCount)
+{
+    if (m_stamp.size() < nodeCount) { //Only grows, so a bigger map after a reload reallocates once
+        m_stamp.resize(nodeCount, 0);
+        m_closedStamp.resize(nodeCount, 0);
+        m_gScore.resize(nodeCount);
+        m_parent.resize(nodeCount);
+        m_parentEdge.resize(nodeCount);
+        m_heuristic.resize(nodeCount);
+    }
+    m_generation++;
+    if (m_generation == 0) { //wrapped, old stamps could look current again
+        fill(m_stamp.begin(), m_stamp.end(), 0);
+        fill(m_closedStamp.begin(), m_closedStamp.end(), 0);
+        m_generation = 1;
+    }
+    m_openSet.reserve(nodeCount);
+    m_openSet.clear();
+    m_expanded = 0;
+    m_pushes = 0;
+}
+
+PointToPointRouterImpl::SearchContext& PointToPointRouterImpl::searchContext() const
+{
+    //One context per thread, shared by every router that thread uses; searches never nest
+    thread_local SearchContext context;
+    return context;
+}
+
+void PointToPointRouterImpl::crowMiles(SearchContext& ctx, unsigned int target) const
+{
+    //Great-circle bounds for the batched nodes, in one call so they are computed a vector at a time
+    const RadianCoords& radians = m_sm->nodeRadians();
+    size_t count = ctx.m_batchNodes.size();
+    ctx.m_batchMiles.resize(count);
+    haversineOneToMany(radians.lat[target], radians.lon[target], radians.cosLat[target],
+        ctx.m_batch.lat.data(), ctx.m_batch.lon.data(), ctx.m_batch.cosLat.data(), count, ctx.m_batchMiles.data());
+    for (size_t i = 0; i < count; i++)
+        ctx.m_heuristic[ctx.m_batchNodes[i]] = ctx.m_batchMiles[i];
+}
+
+unsigned int PointToPointRouterImpl::nodesExpanded() const
+{
+    return searchContext().m_expanded;
+}
+
+void PointToPointRouterImpl::useContractionHierarchy(const ContractionHierarchy* ch)
+{
+    m_ch = ch;
+}
+
+void PointToPointRouterImpl::useLandmarks(const LandmarkTable* landmarks)
+{
+    m_landmarks = landmarks;
+}
+
+void PointToPointRouterImpl::useLegCache(LegCache* cache)
+{
+    m_cache = cache;
+}
+
+void PointToPointRouterImpl::useThreadPool(ThreadPool* pool)
+{
+    m_pool = pool;
+}
+
 DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
     const GeoCoord& start,
     const GeoCoord& end,
     list<StreetSegment>& route,
-    double& totalDistanceTravelled) const
+    double& totalDistanceTravelled,
+    RouteMetrics* metrics) const
+{
+    //Counting is always on and costs next to nothing; the clock is only read when someone is looking
+    PhaseTimer timer(metrics != nullptr || metricsEnabled());
+    RouteMetrics counts;
+    DeliveryResult result = findRoute(start, end, route, totalDistanceTravelled, counts);
+    if (timer.on()) {
+        counts.seconds = timer.seconds();
+        if (metrics != nullptr)
+            metrics->add(counts);
+        if (metricsEnabled())
+            recordRoute(counts);
+    }
+    return result;
+}
+
+DeliveryResult PointToPointRouterImpl::findRoute(const GeoCoord& start, const GeoCoord& end, list<StreetSegment>& route,
+    double& totalDistanceTravelled, RouteMetrics& counts) const
 {
     //Reset route and dist in case
     route.clear();
     totalDistanceTravelled = 0;
-    cerr << "Called Routes" << endl;
+    LOG_TRACE("Route from " << start.latitudeText << " " << start.longitudeText << " to "
+        << end.latitudeText << " " << end.longitudeText);
     //Bad Ending or Starting Coordinates
-    vector<StreetSegment> segs;
-    if (!(m_sm->getSegmentsThatStartWith(start, segs)) || !(m_sm->getSegmentsThatStartWith(end, segs))) {
-        cerr << "Bad Coordinates" << endl;
+    unsigned int startNode, endNode;
+    counts.nodeLookups += 2;
+    if (!m_sm->findNode(start, startNode) || !m_sm->findNode(end, endNode)) {
+        LOG_DEBUG("Bad coordinates: the start or end of the route is not on the map");
         return BAD_COORD;  // invalid start or end
     }
+    //Every way of finding the path gives it as the map's own edges, kept per thread for reuse
+    thread_local vector<unsigned int> nodes;
+    thread_local vector<const StreetEdge*> edges;
+    double cachedDistance;
+    if (m_cache != nullptr && m_cache->find(m_sm, startNode, endNode, nodes, edges, cachedDistance)) {
+        searchContext().m_expanded = 0;
+        counts.cacheHits++;
+    }
+    else {
+        if (m_cache != nullptr)
+            counts.cacheMisses++;
+        bool found = findPath(startNode, endNode, nodes, edges);
+        counts.searches++;
+        counts.nodesExpanded += searchContext().m_expanded;
+        counts.heapPushes += searchContext().m_pushes;
+        if (!found) {
+            //openSet empty without finding a path, no route
+            LOG_DEBUG("No route from node " << startNode << " to node " << endNode);
+            return NO_ROUTE;
+        }
+        if (m_cache != nullptr) {
+            double distance = 0;
+            for (size_t i = 0; i < edges.size(); i++)
+                distance += edges[i]->length;
+            m_cache->store(m_sm, startNode, endNode, nodes, edges, distance);
+        }
+    }
+    for (size_t i = 0; i < edges.size(); i++) {
+        route.push_back(m_sm->segmentFor(nodes[i], *edges[i]));
+        totalDistanceTravelled += edges[i]->length;
+    }
+    LOG_TRACE("Route found: " << edges.size() << " segments, " << totalDistanceTravelled << " miles");
+    return DELIVERY_SUCCESS;
+}
+
+bool PointToPointRouterImpl::findPath(unsigned int startNode, unsigned int endNode,
+    vector<unsigned int>& nodes, vector<const StreetEdge*>& edges) const
+{
+    SearchContext& ctx = searchContext();
+    if (m_ch != nullptr && m_ch->isReady()) {
+        //The hierarchy unpacks its shortcuts into the map's own edges, so the path matches A*'s
+        double distance;
+        ctx.m_pushes = 0;
+        return m_ch->findPath(startNode, endNode, nodes, edges, distance, ctx.m_expanded);
+    }
+    nodes.clear();
+    edges.clear();
+    const LandmarkTable* landmarks = m_landmarks != nullptr && m_landmarks->isReady() ? m_landmarks : nullptr;
+    const RadianCoords& radians = m_sm->nodeRadians();
+    ctx.begin(m_sm->nodeCount());
+    //Without landmarks, a node's great-circle bound is worked out once, when it is first
+    //seen, together with the other neighbours of the node being expanded
+    auto batch = [&](unsigned int node) {
+        ctx.m_batchNodes.push_back(node);
+        ctx.m_batch.lat.push_back(radians.lat[node]);
+        ctx.m_batch.lon.push_back(radians.lon[node]);
+        ctx.m_batch.cosLat.push_back(radians.cosLat[node]);
+    };
+    auto clearBatch = [&]() {
+        ctx.m_batchNodes.clear();
+        ctx.m_batch.clear();
+    };
+    auto heuristic = [&](unsigned int node) {
+        return landmarks != nullptr ? landmarks->lowerBound(node, endNode) : ctx.m_heuristic[node];
+    };
     //openSet
-    priority_queue<LowestFScore, vector<LowestFScore>, CompareFScore> openSet;
-    openSet.push(LowestFScore(start, 0));
-    //cameFrom
-    ExpandableHashMap<GeoCoord, GeoCoord> came_from;
-    //gScore
-    ExpandableHashMap<GeoCoord, double> gScore;
-    gScore.associate(start, 0);
-    //fScore
-    ExpandableHashMap<GeoCoord, double> fScore;
-    fScore.associate(start, distanceEarthMiles(start, end));
+    IndexedHeap& openSet = ctx.m_openSet;
+    if (landmarks == nullptr) {
+        clearBatch();
+        batch(startNode);
+        crowMiles(ctx, endNode);
+    }
+    openSet.pushOrDecrease(startNode, heuristic(startNode));
+    ctx.m_pushes++;
+    //gScore and cameFrom
+    ctx.record(startNode, 0, startNode, nullptr);
 
     //A* Algorithm, prioritizes the lowest distance first
     while (!openSet.empty()) {
-        GeoCoord current = openSet.top().m_coord;
-        if (current == end) { //Found path to the end
-            while (came_from.find(current) != nullptr) {
-                GeoCoord* temp = came_from.find(current);
-                if (m_sm->getSegmentsThatStartWith(current, segs)) { //Should always return true
-                    for (auto it = segs.begin(); it != segs.end(); it++) {
-                        if (it->end == *temp) { //Finds segment with to point
-                            route.push_front(*it);
-                            totalDistanceTravelled = distanceEarthMiles(it->start, it->end);
-                            break;
-                        }
-                    }
-                }
-                current = *temp;
+        unsigned int current = openSet.pop();
+        if (current == endNode) { //Found path to the end
+            //Walks back to the start, each step already knows the edge it took
+            while (current != startNode) {
+                nodes.push_back(ctx.m_parent[current]);
+                edges.push_back(ctx.m_parentEdge[current]);
+                current = ctx.m_parent[current];
             }
-            cerr << "Delivery" << endl;
-            return DELIVERY_SUCCESS;
+            reverse(nodes.begin(), nodes.end());
+            reverse(edges.begin(), edges.end());
+            openSet.clear();
+            return true;
         }
-        openSet.pop();
-        m_sm->getSegmentsThatStartWith(current, segs);
-        for (auto neighbor = segs.begin(); neighbor != segs.end(); neighbor++) {
-            double tentative_gScore = *gScore.find(current) + distanceEarthMiles(current, neighbor->end);
-            if (gScore.find(neighbor->end) == nullptr || tentative_gScore < *gScore.find(neighbor->end)) {
-                // Records better paths than previous ones
-                came_from.associate(neighbor->end, current);
-                gScore.associate(neighbor->end, tentative_gScore);
-                fScore.associate(neighbor->end, tentative_gScore + distanceEarthMiles(neighbor->end, end));
-                openSet.push(LowestFScore(neighbor->end, *fScore.find(neighbor->end)));
+        //The great-circle heuristic is consistent, so a popped node's g-score is final.  Landmark
+        //bounds are rounded and can be inconsistent by a few millionths of a mile, so with
+        //them a closed node is reopened if a shorter path to it turns up.
+        ctx.close(current);
+        ctx.m_expanded++;
+        double currentG = ctx.m_gScore[current];
+        StreetEdgeRange neighbors = m_sm->edgesFrom(current); //Edges are read in place, nothing copied
+        if (landmarks == nullptr) {
+            clearBatch();
+            for (const StreetEdge& neighbor : neighbors)
+                if (!ctx.seen(neighbor.target))
+                    batch(neighbor.target);
+            if (!ctx.m_batchNodes.empty())
+                crowMiles(ctx, endNode);
+        }
+        for (const StreetEdge& neighbor : neighbors) {
+            if (landmarks == nullptr && ctx.closed(neighbor.target))
+                continue;
+            double tentative_gScore = currentG + neighbor.length;
+            if (!ctx.seen(neighbor.target) || tentative_gScore < ctx.m_gScore[neighbor.target]) {
+                // Records better paths than previous ones, moving the node up the heap if queued
+                ctx.record(neighbor.target, tentative_gScore, current, &neighbor);
+                openSet.pushOrDecrease(neighbor.target, tentative_gScore + heuristic(neighbor.target));
+                ctx.m_pushes++;
             }
         }
     }
-    //openSet empty without finding a path, no route
-    cerr << "No Delivery" << endl;
-    return NO_ROUTE;
+    return false;
+}
+
+DeliveryResult PointToPointRouterImpl::computeDistanceMatrix(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<vector<double>>& matrix,
+    RouteMetrics* metrics) const
+{
+    PhaseTimer timer(metrics != nullptr || metricsEnabled());
+    RouteMetrics counts;
+    DeliveryResult result = fillMatrix(depot, deliveries, matrix, counts);
+    if (timer.on()) {
+        counts.seconds = timer.seconds();
+        if (metrics != nullptr)
+            metrics->add(counts);
+        if (metricsEnabled())
+            recordMatrix(counts);
+    }
+    return result;
+}
+
+DeliveryResult PointToPointRouterImpl::fillMatrix(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+    vector<vector<double>>& matrix, RouteMetrics& counts) const
+{
+    size_t stops = deliveries.size() + 1;
+    matrix.assign(stops, vector<double>(stops, numeric_limits<double>::infinity()));
+    //Targets sorted by node so a settled node finds its stops by binary search
+    vector<pair<unsigned int, unsigned int>> targets(stops);
+    for (size_t i = 0; i < stops; i++) {
+        const GeoCoord& gc = i == 0 ? depot : deliveries[i - 1].location;
+        counts.nodeLookups++;
+        if (!m_sm->findNode(gc, targets[i].first)) {
+            LOG_DEBUG("Bad coordinates: stop " << i << " of the distance matrix is not on the map");
+            return BAD_COORD;
+        }
+        targets[i].second = (unsigned int)i;
+    }
+    vector<pair<unsigned int, unsigned int>> byNode = targets;
+    sort(byNode.begin(), byNode.end());
+    unsigned int distinctTargets = 0;
+    for (size_t i = 0; i < stops; i++)
+        if (i == 0 || byNode[i].first != byNode[i - 1].first)
+            distinctTargets++;
+
+    //One single-source search per stop instead of a route per pair; rows are
+    //independent and each thread searches with its own context
+    vector<RouteMetrics> rowCounts(stops);
+    auto row = [&](size_t i) {
+        distancesFrom(targets[i].first, byNode, distinctTargets, matrix[i]);
+        rowCounts[i].searches = 1;
+        rowCounts[i].nodesExpanded = searchContext().m_expanded;
+        rowCounts[i].heapPushes = searchContext().m_pushes;
+    };
+    if (m_pool != nullptr)
+        m_pool->parallelFor(stops, row);
+    else
+        for (size_t i = 0; i < stops; i++)
+            row(i);
+    for (size_t i = 0; i < stops; i++)
+        counts.add(rowCounts[i]);
+    DeliveryResult result = DELIVERY_SUCCESS;
+    for (size_t i = 0; i < stops; i++) {
+        for (size_t j = 0; j < stops; j++)
+            if (matrix[i][j] == numeric_limits<double>::infinity())
+                result = NO_ROUTE;
+    }
+    return result;
+}
+
+void PointToPointRouterImpl::distancesFrom(unsigned int origin, const vector<pair<unsigned int, unsigned int>>& targets,
+    unsigned int distinctTargets, vector<double>& row) const
+{
+    //Dijkstra, stopped as soon as every target node is settled
+    SearchContext& ctx = searchContext();
+    ctx.begin(m_sm->nodeCount());
+    IndexedHeap& openSet = ctx.m_openSet;
+    openSet.pushOrDecrease(origin, 0);
+    ctx.m_pushes++;
+    ctx.record(origin, 0, origin, nullptr);
+    unsigned int remaining = distinctTargets;
+    while (!openSet.empty()) {
+        unsigned int current = openSet.pop();
+        ctx.close(current);
+        ctx.m_expanded++;
+        double currentG = ctx.m_gScore[current];
+        auto hit = equal_range(targets.begin(), targets.end(), make_pair(current, 0u),
+            [](const pair<unsigned int, unsigned int>& a, const pair<unsigned int, unsigned int>& b) { return a.first < b.first; });
+        if (hit.first != hit.second) {
+            for (auto it = hit.first; it != hit.second; it++)
+                row[it->second] = currentG;
+            if (--remaining == 0)
+                break;
+        }
+        for (const StreetEdge& neighbor : m_sm->edgesFrom(current)) {
+            if (ctx.closed(neighbor.target))
+                continue;
+            double tentative_gScore = currentG + neighbor.length;
+            if (!ctx.seen(neighbor.target) || tentative_gScore < ctx.m_gScore[neighbor.target]) {
+                ctx.record(neighbor.target, tentative_gScore, current, &neighbor);
+                openSet.pushOrDecrease(neighbor.target, tentative_gScore);
+                ctx.m_pushes++;
+            }
+        }
+    }
+    openSet.clear();
 }
 
 //******************** PointToPointRouter functions ***************************
@@ -131,5 +464,57 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const
 {
-    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, nullptr);
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteMetrics& metrics) const
+{
+    return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled, &metrics);
+}
+
+DeliveryResult PointToPointRouter::computeDistanceMatrix(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        vector<vector<double>>& matrix) const
+{
+    return m_impl->computeDistanceMatrix(depot, deliveries, matrix, nullptr);
+}
+
+DeliveryResult PointToPointRouter::computeDistanceMatrix(
+        const GeoCoord& depot,
+        const vector<DeliveryRequest>& deliveries,
+        vector<vector<double>>& matrix,
+        RouteMetrics& metrics) const
+{
+    return m_impl->computeDistanceMatrix(depot, deliveries, matrix, &metrics);
+}
+
+unsigned int PointToPointRouter::nodesExpanded() const
+{
+    return m_impl->nodesExpanded();
+}
+
+void PointToPointRouter::useContractionHierarchy(const ContractionHierarchy* ch)
+{
+    m_impl->useContractionHierarchy(ch);
+}
+
+void PointToPointRouter::useLandmarks(const LandmarkTable* landmarks)
+{
+    m_impl->useLandmarks(landmarks);
+}
+
+void PointToPointRouter::useLegCache(LegCache* cache)
+{
+    m_impl->useLegCache(cache);
+}
+
+void PointToPointRouter::useThreadPool(ThreadPool* pool)
+{
+    m_impl->useThreadPool(pool);
 }
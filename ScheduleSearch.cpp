@@ -0,0 +1,229 @@
+#include "ScheduleSearch.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+using namespace std;
+
+namespace
+{
+    const double IMPROVEMENT = 1e-10;   // smaller gains are rounding noise and could cycle forever
+    const double NEVER = numeric_limits<double>::infinity();
+}
+
+ScheduleSearch::ScheduleSearch(const vector<vector<double>>& distances, const vector<double>& earliest,
+    const vector<double>& latest, const vector<double>& service, double milesPerHour)
+    : m_n((int)distances.size()), m_minutesPerMile(60 / milesPerHour),
+      m_earliest(earliest), m_latest(latest), m_service(service)
+{
+    m_dist.resize((size_t)m_n * m_n);
+    for (int i = 0; i < m_n; i++)
+        for (int j = 0; j < m_n; j++)
+            m_dist[(size_t)i * m_n + j] = distances[i][j];
+    //The depot is open all day and takes no time
+    m_earliest.resize(m_n, 0);
+    m_latest.resize(m_n, NEVER);
+    m_service.resize(m_n, 0);
+    m_earliest[0] = 0;
+    m_latest[0] = NEVER;
+    m_service[0] = 0;
+    m_deadlines = m_latest;
+
+    m_tour.resize(m_n);
+    iota(m_tour.begin(), m_tour.end(), 0);
+    reschedule();
+}
+
+void ScheduleSearch::reschedule()
+{
+    int positions = (int)m_tour.size();
+    m_start.resize(positions + 1);
+    m_latestStart.resize(positions + 1);
+    m_start[0] = 0;
+    for (int p = 1; p <= positions; p++) {
+        int from = m_tour[p - 1], to = stopAt(p);
+        double arrival = m_start[p - 1] + m_service[from] + minutes(from, to);
+        m_start[p] = p == positions ? arrival : max(arrival, m_earliest[to]);
+    }
+    m_latestStart[positions] = NEVER;
+    for (int p = positions - 1; p >= 0; p--) {
+        int stop = m_tour[p];
+        m_latestStart[p] = min(m_latest[stop], m_latestStart[p + 1] - m_service[stop] - minutes(stop, stopAt(p + 1)));
+    }
+}
+
+bool ScheduleSearch::fits(int after, const int* run, int runLength, int before) const
+{
+    //Leave position after on its schedule, serve the run in order, and reach position
+    //before in time for the rest of the tour
+    int from = m_tour[after];
+    double time = m_start[after] + m_service[from];
+    for (int i = 0; i < runLength; i++) {
+        int stop = run[i];
+        double begin = max(time + minutes(from, stop), m_earliest[stop]);
+        if (begin > m_latest[stop])
+            return false;
+        time = begin + m_service[stop];
+        from = stop;
+    }
+    return time + minutes(from, stopAt(before)) <= m_latestStart[before];
+}
+
+bool ScheduleSearch::onTime() const
+{
+    for (int p = 1; p < (int)m_tour.size(); p++)
+        if (m_start[p] > m_latest[m_tour[p]])
+            return false;
+    return true;
+}
+
+double ScheduleSearch::length() const
+{
+    double total = 0;
+    for (int p = 0; p < (int)m_tour.size(); p++)
+        total += distance(m_tour[p], stopAt(p + 1));
+    return total;
+}
+
+int ScheduleSearch::cheapestFit(int stop) const
+{
+    //Tour position to put stop after that adds least distance and keeps everyone on time, or -1
+    int best = -1;
+    double bestCost = 0;
+    for (int p = 0; p < (int)m_tour.size(); p++) {
+        int next = stopAt(p + 1);
+        double cost = distance(m_tour[p], stop) + distance(stop, next) - distance(m_tour[p], next);
+        if ((best == -1 || cost < bestCost) && fits(p, &stop, 1, p + 1)) {
+            best = p;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+void ScheduleSearch::insertInOrder(const vector<int>& order)
+{
+    m_tour.assign(1, 0);
+    m_late.clear();
+    reschedule();
+    for (int stop : order) {
+        for (int attempt = 0; attempt < 2; attempt++) {
+            int best = cheapestFit(stop);
+            if (best != -1) {
+                m_tour.insert(m_tour.begin() + best + 1, stop);
+                reschedule();
+                break;
+            }
+            //Fits nowhere: give up on its deadline; just before the return always fits then
+            m_late.push_back(stop);
+            m_latest[stop] = NEVER;
+        }
+    }
+}
+
+void ScheduleSearch::insertAll()
+{
+    //Stops go in by closing time, by opening time, and by the middle of their windows,
+    //each while there is most room left for them; the order leaving fewest late, then
+    //the shortest tour, is kept
+    vector<int> byStop(m_n - 1);
+    iota(byStop.begin(), byStop.end(), 1);
+    vector<int> bestTour, bestLate;
+    double bestLength = 0;
+    for (int key = 0; key < 3; key++) {
+        auto rank = [&](int stop) {
+            if (key == 0)
+                return m_deadlines[stop];
+            if (key == 1)
+                return m_earliest[stop];
+            return m_deadlines[stop] == NEVER ? NEVER : (m_earliest[stop] + m_deadlines[stop]) / 2;
+        };
+        vector<int> order = byStop;
+        stable_sort(order.begin(), order.end(), [&](int x, int y) { return rank(x) < rank(y); });
+        m_latest = m_deadlines;
+        insertInOrder(order);
+        if (key == 0 || m_late.size() < bestLate.size() || (m_late.size() == bestLate.size() && length() < bestLength)) {
+            bestTour = m_tour;
+            bestLate = m_late;
+            bestLength = length();
+        }
+    }
+    m_tour = bestTour;
+    m_late = bestLate;
+    m_latest = m_deadlines;
+    for (int stop : m_late)
+        m_latest[stop] = NEVER;
+    reschedule();
+}
+
+bool ScheduleSearch::improveOnce()
+{
+    //First move of a run of 1 to 3 stops, from positions s .. e to just after position k,
+    //that shortens the tour and keeps everyone on time
+    int n = (int)m_tour.size();
+    for (int length = 1; length <= 3; length++) {
+        for (int s = 1; s + length - 1 <= n - 1; s++) {
+            int e = s + length - 1;
+            int before = m_tour[s - 1], after = stopAt(e + 1);
+            double removed = distance(before, m_tour[s]) + distance(m_tour[e], after) - distance(before, after);
+            for (int k = 0; k < n; k++) {
+                if (k >= s - 1 && k <= e)
+                    continue;
+                int kNext = stopAt(k + 1);
+                double delta = distance(m_tour[k], m_tour[s]) + distance(m_tour[e], kNext)
+                             - distance(m_tour[k], kNext) - removed;
+                if (delta >= -IMPROVEMENT || !fits(k, &m_tour[s], length, k + 1))
+                    continue;
+                if (k > e)
+                    rotate(m_tour.begin() + s, m_tour.begin() + e + 1, m_tour.begin() + k + 1);
+                else
+                    rotate(m_tour.begin() + k + 1, m_tour.begin() + s, m_tour.begin() + e + 1);
+                reschedule();
+                if (onTime())
+                    return true;
+                //Only distances that break the triangle inequality get here; put the run back
+                if (k > e)
+                    rotate(m_tour.begin() + s, m_tour.begin() + k - length + 1, m_tour.begin() + k + 1);
+                else
+                    rotate(m_tour.begin() + k + 1, m_tour.begin() + k + 1 + length, m_tour.begin() + e + 1);
+                reschedule();
+            }
+        }
+    }
+    return false;
+}
+
+bool ScheduleSearch::rescueLate()
+{
+    //The tour has changed since the late stops were given up on; see whether any of
+    //them now fits somewhere on time after all
+    bool rescued = false;
+    for (size_t i = 0; i < m_late.size(); i++) {
+        int stop = m_late[i];
+        vector<int> kept = m_tour;
+        m_tour.erase(find(m_tour.begin(), m_tour.end(), stop));
+        m_latest[stop] = m_deadlines[stop];
+        reschedule();
+        //Taking a stop out only makes others late when distances break the triangle inequality
+        int best = onTime() ? cheapestFit(stop) : -1;
+        if (best != -1) {
+            m_tour.insert(m_tour.begin() + best + 1, stop);
+            m_late.erase(m_late.begin() + i--);
+            rescued = true;
+        }
+        else {
+            m_latest[stop] = NEVER;
+            m_tour = kept;
+        }
+        reschedule();
+    }
+    return rescued;
+}
+
+double ScheduleSearch::improve()
+{
+    do {
+        while (improveOnce())
+            ;
+    } while (!m_late.empty() && rescueLate());
+    return length();
+}
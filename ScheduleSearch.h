@@ -0,0 +1,74 @@
+// ScheduleSearch.h
+
+// Orders a tour, as TourSearch does, when stops may only be served within a
+// window of time.  Times are minutes after leaving the depot, stop 0; each
+// stop has an earliest and latest time service may start there and a service
+// duration, and travel takes distance / speed.  Arriving early means waiting.
+//
+// The schedule of the current tour is kept in two arrays:
+//   start[p]   when service at tour position p starts, going forwards from the
+//              depot, waiting for windows to open
+//   latest[p]  the latest service could start at position p and every stop
+//              after it still be on time, going backwards from the end
+// A stop k fits between positions p and p+1 if it can start by its own latest
+// time when leaving p at start[p], and the vehicle then reaches p+1 by
+// latest[p+1].  That check is O(1) and covers runs of a few stops as well.
+//
+// The tour is built by inserting the stops one by one, each where it adds the
+// least distance while keeping everyone on time, trying a few orders (by
+// closing time, opening time, middle of the window) and keeping the best; then
+// shortened by moving runs of one to three stops elsewhere, again only where
+// they fit.  A stop that fits nowhere has its deadline ignored, and is
+// reported by late(), unless a later tour turns out to have room for it.
+//
+// The fit test for a move uses the schedule from before the move.  Taking a
+// run out never makes anyone later when distances obey the triangle
+// inequality, as shortest road distances do, so the test can only turn down
+// moves that would in fact fit, never accept ones that don't.  For distances
+// that do not, each move is checked again once made, and undone if need be.
+
+#ifndef SCHEDULESEARCH_INCLUDED
+#define SCHEDULESEARCH_INCLUDED
+
+#include <vector>
+#include <cstddef>
+
+class ScheduleSearch
+{
+public:
+      // earliest, latest and service are per stop; the depot's are ignored
+    ScheduleSearch(const std::vector<std::vector<double>>& distances, const std::vector<double>& earliest,
+        const std::vector<double>& latest, const std::vector<double>& service, double milesPerHour);
+
+    void insertAll();                                // build the tour from scratch
+    double improve();                                // to a local optimum, returns the new length
+    const std::vector<int>& tour() const { return m_tour; }
+    double length() const;
+    const std::vector<int>& late() const { return m_late; }   // stops whose deadlines were given up
+    double finish() const { return m_start.back(); }          // when the vehicle is back at the depot
+private:
+    double distance(int from, int to) const { return m_dist[(size_t)from * m_n + to]; }
+    double minutes(int from, int to) const { return distance(from, to) * m_minutesPerMile; }
+    int stopAt(int position) const { return position == (int)m_tour.size() ? 0 : m_tour[position]; }
+    void reschedule();
+    int cheapestFit(int stop) const;
+    void insertInOrder(const std::vector<int>& order);
+    bool rescueLate();
+    bool fits(int after, const int* run, int runLength, int before) const;
+    bool onTime() const;
+    bool improveOnce();
+
+    int m_n;
+    double m_minutesPerMile;
+    std::vector<double> m_dist;                 // m_n x m_n, row-major
+    std::vector<double> m_earliest;
+    std::vector<double> m_latest;               // as given, or infinity once a stop is given up on
+    std::vector<double> m_deadlines;            // as given
+    std::vector<double> m_service;
+    std::vector<int> m_tour;                    // stops in order, depot first
+    std::vector<double> m_start;                // by tour position; the last is the return to the depot
+    std::vector<double> m_latestStart;          // likewise
+    std::vector<int> m_late;
+};
+
+#endif // SCHEDULESEARCH_INCLUDED
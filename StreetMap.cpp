@@ -1,16 +1,126 @@
 #include "provided.h"
-#include "ExpandableHashMap.h"
+#include "FlatHashMap.h"
+#include "MappedFile.h"
+#include "CoordKey.h"
+#include "MapParser.h"
+#include "ThreadPool.h"
+#include "Logger.h"
+#include "Haversine.h"
 #include <string>
 #include <vector>
 #include <iterator>
 #include <functional>
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
 using namespace std;
 
-unsigned int hasher(const GeoCoord& g)
+unsigned int hasher(const string& s)
 {
-    return std::hash<string>()(g.latitudeText + g.longitudeText);
+    return std::hash<string>()(s);
+}
+
+//******************** Graph layout *******************************************
+
+// The map is a directed graph whose nodes are the distinct coordinates, numbered
+// densely from 0 in the order they are first read.  Edges are kept in
+// compressed-sparse-row form: the edges leaving node n are
+// edges[edgeOffsets[n]] .. edges[edgeOffsets[n + 1] - 1].
+//
+// A snapshot is a 64 byte header followed by those same arrays as 8-byte aligned
+// sections, so a mapped file can be queried in place:
+//   double    coords[2 * nodeCount]         latitude, longitude per node
+//   CoordKey  keys[nodeCount]               fixed-point coordinate per node
+//   uint32_t  textOffsets[nodeCount + 1]    into text, "lat\0lon\0" per node
+//   uint32_t  edgeOffsets[nodeCount + 1]    CSR row starts into edges
+//   StreetEdge edges[edgeCount]
+//   uint32_t  nameOffsets[nameCount + 1]    into names, NUL terminated
+//   char      names[nameBytes]
+//   char      text[textBytes]               only used to print coordinates
+//   uint32_t  index[indexSlots]             open-addressed CoordKey -> node table
+
+namespace
+{
+    const char SNAPSHOT_MAGIC[8] = { 'S', 'M', 'A', 'P', 'S', 'N', 'P', '\0' };
+    const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+    const uint32_t SNAPSHOT_VERSION = 2;
+    const uint32_t EMPTY_SLOT = 0xffffffff;
+    const size_t READ_BLOCK_BYTES = 16 << 20;
+    const size_t TAIL_SEARCH_BYTES = 64 << 10;  // records are far shorter, so the last one starts within this
+    const unsigned int PIECES_PER_THREAD = 4;
+    const size_t MAX_REPORTED_ERRORS = 20;
+    const size_t PREFETCH_AHEAD = 8;
+    const size_t BYTES_PER_NODE = 64;           // roughly, in map files; for sizing tables up front
+
+    struct SnapshotHeader
+    {
+        char     magic[8];
+        uint32_t byteOrder;
+        uint32_t version;
+        uint32_t nodeCount;
+        uint32_t edgeCount;
+        uint32_t nameCount;
+        uint32_t indexSlots;
+        uint64_t nameBytes;
+        uint64_t textBytes;
+        uint64_t payloadBytes;
+        uint64_t checksum;
+    };
+
+    static_assert(sizeof(StreetEdge) == 16 && sizeof(unsigned int) == sizeof(uint32_t),
+                  "snapshots store StreetEdge records as they are laid out in memory");
+
+    struct SnapshotLayout
+    {
+        size_t coords, keys, textOffsets, edgeOffsets, edges, nameOffsets, names, text, index, end;
+    };
+
+    inline size_t alignUp(size_t n)
+    {
+        return (n + 7) & ~(size_t)7;
+    }
+
+    SnapshotLayout layoutFor(const SnapshotHeader& h)
+    {
+        SnapshotLayout l;
+        l.coords = 0;
+        l.keys = alignUp(l.coords + sizeof(double) * 2 * h.nodeCount);
+        l.textOffsets = alignUp(l.keys + sizeof(CoordKey) * h.nodeCount);
+        l.edgeOffsets = alignUp(l.textOffsets + sizeof(uint32_t) * (h.nodeCount + (size_t)1));
+        l.edges = alignUp(l.edgeOffsets + sizeof(uint32_t) * (h.nodeCount + (size_t)1));
+        l.nameOffsets = alignUp(l.edges + sizeof(StreetEdge) * h.edgeCount);
+        l.names = alignUp(l.nameOffsets + sizeof(uint32_t) * (h.nameCount + (size_t)1));
+        l.text = alignUp(l.names + h.nameBytes);
+        l.index = alignUp(l.text + h.textBytes);
+        l.end = alignUp(l.index + sizeof(uint32_t) * h.indexSlots);
+        return l;
+    }
+
+    static_assert(sizeof(CoordKey) == 8, "snapshots store CoordKeys as raw 64-bit words");
+
+      // Read-only view of the graph arrays, pointing either at StreetMapImpl's
+      // own vectors or into a mapped snapshot
+    struct StreetGraph
+    {
+        const double*     coords;
+        const CoordKey*   keys;
+        const uint32_t*   textOffsets;
+        const uint32_t*   edgeOffsets;
+        const StreetEdge* edges;
+        const uint32_t*   nameOffsets;
+        const char*       names;
+        const char*       text;
+        const uint32_t*   index;
+        uint32_t          nodeCount;
+        uint32_t          edgeCount;
+        uint32_t          nameCount;
+        uint32_t          indexSlots;
+        uint64_t          nameBytes;
+        uint64_t          textBytes;
+    };
 }
 
 class StreetMapImpl
@@ -20,77 +130,457 @@ public:
     ~StreetMapImpl();
     bool load(string mapFile);
     bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    bool saveSnapshot(string snapshotFile) const;
+    bool loadSnapshot(string snapshotFile, bool verify);
+    bool findNode(const GeoCoord& gc, uint32_t& node) const;
+    uint32_t nodeCount() const { return m_graph.nodeCount; }
+    StreetEdgeRange edgesFrom(uint32_t node) const
+    {
+        StreetEdgeRange range = { m_graph.edges + m_graph.edgeOffsets[node], m_graph.edges + m_graph.edgeOffsets[node + 1] };
+        return range;
+    }
+    GeoCoord nodeCoord(uint32_t node) const;
+    double nodeLatitude(uint32_t node) const { return m_graph.coords[2 * node]; }
+    double nodeLongitude(uint32_t node) const { return m_graph.coords[2 * node + 1]; }
+    const RadianCoords& nodeRadians() const;
+    const char* streetName(uint32_t nameId) const { return m_graph.names + m_graph.nameOffsets[nameId]; }
+    uint64_t graphFingerprint() const;
+    uint64_t generation() const { return m_generation; }
+    void useThreadPool(ThreadPool* pool) { m_pool = pool; }
 private:
-    void findHashNode(GeoCoord startCoord, GeoCoord endCoord, string s);
-    ExpandableHashMap<GeoCoord, vector<StreetSegment>> m_segments;
+    //Directed edge read from the map, before edges are sorted into rows
+    struct RawEdge { uint32_t source; StreetEdge edge; };
+    void clear();
+    size_t lastRecordStart(const char* text, size_t size) const;
+    void merge(const MapPiece& piece, FlatHashMap<CoordKey, uint32_t>& nodeIds,
+        FlatHashMap<string, uint32_t>& nameIds, vector<RawEdge>& raw);
+    uint32_t internNode(const MapNode& node);
+    uint32_t internName(const string& name);
+    void buildIndex();
+    void useOwnedStorage();
+    void dropRadians();
+
+    StreetGraph m_graph;
+    //Owned storage, filled by load()
+    vector<double> m_coords;
+    vector<CoordKey> m_keys;
+    vector<uint32_t> m_textOffsets;
+    vector<uint32_t> m_edgeOffsets;
+    vector<StreetEdge> m_edges;
+    vector<uint32_t> m_nameOffsets;
+    string m_names;
+    string m_text;
+    vector<uint32_t> m_index;
+    //Node coordinates for batch distances, built on first use after each load so that
+    //loadSnapshot() stays a mapping with nothing per node
+    mutable RadianCoords m_radians;
+    mutable atomic<bool> m_radiansBuilt;
+    mutable mutex m_radiansMutex;
+    //Storage behind m_graph after loadSnapshot()
+    MappedFile m_snapshotFile;
+    ThreadPool* m_pool;         // parses pieces of the map in parallel when set
+    uint64_t m_generation;      // new on every clear(), unique across all StreetMaps
 };
 
 StreetMapImpl::StreetMapImpl()
+    : m_radiansBuilt(false), m_pool(nullptr)
 {
+    clear();
 }
 
 StreetMapImpl::~StreetMapImpl()
 {
 }
 
+void StreetMapImpl::clear()
+{
+    m_coords.clear();
+    m_keys.clear();
+    m_textOffsets.assign(1, 0);
+    m_edgeOffsets.assign(1, 0);
+    m_edges.clear();
+    m_nameOffsets.assign(1, 0);
+    m_names.clear();
+    m_text.clear();
+    m_index.clear();
+    m_snapshotFile.close();
+    buildIndex();
+    useOwnedStorage();
+    static atomic<uint64_t> lastGeneration(0);
+    m_generation = ++lastGeneration;
+}
+
 bool StreetMapImpl::load(string mapFile)
 {
-    m_segments.reset(); //makes sure hashmap is empty
-    ifstream infile(mapFile);
+    clear(); //makes sure graph is empty
+    ifstream infile(mapFile, ios::binary);
     if (!infile)		        // Did opening the file fail?
     {
-        cerr << "Error: Cannot open data.txt!" << endl;
+        LOG_ERROR("Cannot open " << mapFile);
         return false;
     }
-    std::string s;  //street name in here
-    // getline returns infile; the while tests its success/failure state
-    while (getline(infile, s)) //This will reach O(N) despite the nested loop since the loop takes in the succeeding lines of Coords
-    {
-        cerr << "Getting street " << s << endl;
-        int numsSeg;
-        infile >> numsSeg;
-        infile.ignore(10000, '\n');
-        for (int i = 0; i < numsSeg; i++) { //This will always be lower than N and will reduce the amount of times the getline is called in the while loop
-            //start Coordinates
-            string lat, lon;
-            infile >> lat;
-            infile >> lon;
-            GeoCoord startCoord(lat, lon);
-            //end Coordinates
-            infile >> lat;
-            infile >> lon;
-            GeoCoord endCoord(lat, lon);
-            findHashNode(startCoord, endCoord, s); //either associates (creates) a HashNode if not found or pushes to the vector the segment
-            findHashNode(endCoord, startCoord, s);
-            infile.ignore(10000, '\n'); //Proceeds to next line
-        }
-        cerr << "Obtained numsSeg " << numsSeg << endl;
+    //Directed edges in file order; sorted into CSR rows once everything is read
+    vector<RawEdge> raw;
+    FlatHashMap<CoordKey, uint32_t> nodeIds;
+    FlatHashMap<string, uint32_t> nameIds;
+    //Sized from the file when it can be measured; a pipe or FIFO just grows as it is read
+    infile.seekg(0, ios::end);
+    streamoff fileSize = infile.tellg();
+    if (fileSize != -1) {
+        nodeIds.reserve((unsigned int)(fileSize / BYTES_PER_NODE));
+        raw.reserve((size_t)fileSize / BYTES_PER_NODE * 4);
+        infile.seekg(0, ios::beg);
     }
+    else
+        infile.clear();
+    vector<MapError> errors;
+    uint32_t lineBase = 0;      //lines before buffer[0]
+    vector<char> buffer;
+    size_t filled = 0;          //bytes of buffer read but not yet parsed
+    vector<MapPiece> pieces;
+    bool atEnd;
+    do {
+        //Tops up whatever was left after the last whole record with another block
+        buffer.resize(filled + READ_BLOCK_BYTES);
+        infile.read(&buffer[filled], READ_BLOCK_BYTES);
+        filled += (size_t)infile.gcount();
+        atEnd = !infile;
+        const char* text = buffer.data();
+        size_t cut = atEnd ? filled : lastRecordStart(text, filled);
+        if (cut == 0)
+            continue;  //one record longer than a block, or nothing read
+        //Pieces of the parsed part start at record starts, a few per thread
+        vector<size_t> bounds(1, 0);
+        unsigned int pieceCount = m_pool != nullptr ? m_pool->threadCount() * PIECES_PER_THREAD : 1;
+        for (unsigned int i = 1; i < pieceCount; i++) {
+            size_t bound = findRecordStart(text, filled, cut / pieceCount * i, atEnd);
+            if (bound > bounds.back() && bound < cut)
+                bounds.push_back(bound);
+        }
+        bounds.push_back(cut);
+        pieces.resize(bounds.size() - 1);
+        auto parse = [&](size_t i) {
+            parseMapPiece(text, bounds[i], bounds[i + 1], filled, atEnd, pieces[i]);
+        };
+        if (m_pool != nullptr)
+            m_pool->parallelFor(pieces.size(), parse);
+        else
+            parse(0);
+        //Merged in file order, so nodes and names get the IDs a single pass would give them
+        for (size_t i = 0; i < pieces.size(); i++) {
+            merge(pieces[i], nodeIds, nameIds, raw);
+            for (MapError& error : pieces[i].errors) {
+                error.line += lineBase + 1;
+                errors.push_back(error);
+            }
+            lineBase += pieces[i].lines;
+        }
+        copy(buffer.begin() + cut, buffer.begin() + filled, buffer.begin());
+        filled -= cut;
+    } while (!atEnd);
+    for (size_t i = 0; i < errors.size() && i < MAX_REPORTED_ERRORS; i++)
+        LOG_WARNING(mapFile << ":" << errors[i].line << ": " << errors[i].message);
+    if (errors.size() > MAX_REPORTED_ERRORS)
+        LOG_WARNING(mapFile << ": " << errors.size() - MAX_REPORTED_ERRORS << " more errors");
+
+    //Counting sort by source node, stable so each row keeps file order
+    uint32_t nodeCount = (uint32_t)m_coords.size() / 2;
+    m_edgeOffsets.assign(nodeCount + 1, 0);
+    for (size_t i = 0; i < raw.size(); i++)
+        m_edgeOffsets[raw[i].source + 1]++;
+    for (uint32_t n = 0; n < nodeCount; n++)
+        m_edgeOffsets[n + 1] += m_edgeOffsets[n];
+    m_edges.resize(raw.size());
+    vector<uint32_t> next(m_edgeOffsets.begin(), m_edgeOffsets.end() - 1);
+    for (size_t i = 0; i < raw.size(); i++)
+        m_edges[next[raw[i].source]++] = raw[i].edge;
+    buildIndex();
+    useOwnedStorage();
     return true;  //Read file
 }
-void StreetMapImpl::findHashNode(GeoCoord startCoord, GeoCoord endCoord, string s) { //Pushes to vector if found, otherwise creates a HashNode
-    vector<StreetSegment>* vptr = m_segments.find(startCoord);
-    if (vptr == nullptr) { //creates a HashNode for not found start coord
-        vector<StreetSegment> sg1;
-        sg1.push_back(StreetSegment(startCoord, endCoord, s));
-        m_segments.associate(startCoord, sg1);
+
+size_t StreetMapImpl::lastRecordStart(const char* text, size_t size) const
+{
+    //Looks back a little way from the end, further each time none is found there;
+    //0 if the only record start is the first byte
+    for (size_t back = TAIL_SEARCH_BYTES; ; back *= 4) {
+        size_t from = size > back ? size - back : 1;
+        size_t start = findRecordStart(text, size, from, false);
+        if (start < size)
+            return start;
+        if (from == 1)
+            return 0;
     }
-    else { //Pushes new value in address
-        vptr->push_back(StreetSegment(startCoord, endCoord, s));
+}
+
+void StreetMapImpl::merge(const MapPiece& piece, FlatHashMap<CoordKey, uint32_t>& nodeIds,
+    FlatHashMap<string, uint32_t>& nameIds, vector<RawEdge>& raw)
+{
+    //The piece's own street and node indexes, mapped to the map's IDs
+    vector<uint32_t> streets(piece.streets.size());
+    for (size_t i = 0; i < piece.streets.size(); i++) {
+        string name(piece.streets[i].name, piece.streets[i].nameLength);
+        const uint32_t* found = nameIds.find(name);
+        if (found == nullptr) { //first time this street is seen
+            streets[i] = internName(name);
+            nameIds.associate(name, streets[i]);
+        }
+        else
+            streets[i] = *found;
+    }
+    vector<uint32_t> nodes(piece.nodes.size());
+    for (size_t i = 0; i < piece.nodes.size(); i++) {
+        if (i + PREFETCH_AHEAD < piece.nodes.size()) //nodes are spread all over the table
+            nodeIds.prefetch(piece.nodes[i + PREFETCH_AHEAD].key);
+        const uint32_t* found = nodeIds.find(piece.nodes[i].key);
+        if (found == nullptr) {
+            nodes[i] = internNode(piece.nodes[i]);
+            nodeIds.associate(piece.nodes[i].key, nodes[i]);
+        }
+        else
+            nodes[i] = *found;
+    }
+    //Records each segment in both directions
+    for (const MapSegment& segment : piece.segments) {
+        uint32_t start = nodes[segment.ends[0]], end = nodes[segment.ends[1]];
+        RawEdge forward = { start, { end, streets[segment.street], segment.length } };
+        RawEdge backward = { end, { start, streets[segment.street], segment.length } };
+        raw.push_back(forward);
+        raw.push_back(backward);
     }
 }
 
+uint32_t StreetMapImpl::internNode(const MapNode& node)
+{
+    //Appends a node's position and text, returns its new ID
+    uint32_t id = (uint32_t)m_coords.size() / 2;
+    m_coords.push_back(node.latitude);
+    m_coords.push_back(node.longitude);
+    m_keys.push_back(node.key);
+    m_text.append(node.latitudeText, node.latitudeLength);
+    m_text += '\0';
+    m_text.append(node.longitudeText, node.longitudeLength);
+    m_text += '\0';
+    m_textOffsets.push_back((uint32_t)m_text.size());
+    return id;
+}
+
+uint32_t StreetMapImpl::internName(const string& name)
+{
+    uint32_t id = (uint32_t)m_nameOffsets.size() - 1;
+    m_names += name;
+    m_names += '\0';
+    m_nameOffsets.push_back((uint32_t)m_names.size());
+    return id;
+}
+
+void StreetMapImpl::buildIndex()
+{
+    //Index sized to a power of two at least twice the node count
+    uint32_t nodeCount = (uint32_t)m_coords.size() / 2;
+    uint32_t slots = 16;
+    while (slots < 2 * nodeCount)
+        slots *= 2;
+    m_index.assign(slots, EMPTY_SLOT);
+    for (uint32_t n = 0; n < nodeCount; n++) {
+        uint32_t slot = hasher(m_keys[n]) & (slots - 1);
+        while (m_index[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & (slots - 1);
+        m_index[slot] = n;
+    }
+}
+
+void StreetMapImpl::useOwnedStorage()
+{
+    m_graph.coords = m_coords.data();
+    m_graph.keys = m_keys.data();
+    m_graph.textOffsets = m_textOffsets.data();
+    m_graph.edgeOffsets = m_edgeOffsets.data();
+    m_graph.edges = m_edges.data();
+    m_graph.nameOffsets = m_nameOffsets.data();
+    m_graph.names = m_names.data();
+    m_graph.text = m_text.data();
+    m_graph.index = m_index.data();
+    m_graph.nodeCount = (uint32_t)m_coords.size() / 2;
+    m_graph.edgeCount = (uint32_t)m_edges.size();
+    m_graph.nameCount = (uint32_t)m_nameOffsets.size() - 1;
+    m_graph.indexSlots = (uint32_t)m_index.size();
+    m_graph.nameBytes = m_names.size();
+    m_graph.textBytes = m_text.size();
+    dropRadians();
+}
+
+void StreetMapImpl::dropRadians()
+{
+    m_radians = RadianCoords();
+    m_radiansBuilt.store(false, memory_order_release);
+}
+
+const RadianCoords& StreetMapImpl::nodeRadians() const
+{
+    //Double-checked, since routers on several threads may ask at once
+    if (!m_radiansBuilt.load(memory_order_acquire)) {
+        lock_guard<mutex> lock(m_radiansMutex);
+        if (!m_radiansBuilt.load(memory_order_relaxed)) {
+            m_radians.reserve(m_graph.nodeCount);
+            for (uint32_t n = 0; n < m_graph.nodeCount; n++)
+                m_radians.add(nodeLatitude(n), nodeLongitude(n));
+            m_radiansBuilt.store(true, memory_order_release);
+        }
+    }
+    return m_radians;
+}
+
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
-    const vector<StreetSegment>* vptr = m_segments.find(gc); //Finds start Coordinate
-    if (vptr != nullptr) {
-        segs.clear(); //start with empty vector if found
-        for (auto ptr = vptr->cbegin(); ptr != vptr->cend(); ptr++) { //Pushes entire vector to segs
-            segs.push_back(*ptr);
+    uint32_t node;
+    if (!findNode(gc, node)) //Finds start Coordinate
+        return false;  //unchanged vector, no such coord
+    segs.clear(); //start with empty vector if found
+    GeoCoord start = nodeCoord(node);
+    for (const StreetEdge& edge : edgesFrom(node)) //Pushes entire row to segs
+        segs.push_back(StreetSegment(start, nodeCoord(edge.target), streetName(edge.nameId)));
+    return true;
+}
+
+bool StreetMapImpl::findNode(const GeoCoord& gc, uint32_t& node) const
+{
+    CoordKey key = makeCoordKey(gc);
+    uint32_t mask = m_graph.indexSlots - 1;
+    uint32_t slot = hasher(key) & mask;
+    while (m_graph.index[slot] != EMPTY_SLOT) { //linear probing, table is at most half full
+        uint32_t candidate = m_graph.index[slot];
+        if (m_graph.keys[candidate] == key) {
+            node = candidate;
+            return true;
         }
-        return true;
+        slot = (slot + 1) & mask;
+    }
+    return false;
+}
+
+GeoCoord StreetMapImpl::nodeCoord(uint32_t node) const
+{
+    //Fills the fields directly, the GeoCoord(string, string) constructor would reparse the text
+    GeoCoord gc;
+    const char* text = m_graph.text + m_graph.textOffsets[node];
+    gc.latitudeText = text;
+    gc.longitudeText = text + gc.latitudeText.size() + 1;
+    gc.latitude = m_graph.coords[2 * node];
+    gc.longitude = m_graph.coords[2 * node + 1];
+    return gc;
+}
+
+bool StreetMapImpl::saveSnapshot(string snapshotFile) const
+{
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.version = SNAPSHOT_VERSION;
+    header.nodeCount = m_graph.nodeCount;
+    header.edgeCount = m_graph.edgeCount;
+    header.nameCount = m_graph.nameCount;
+    header.indexSlots = m_graph.indexSlots;
+    header.nameBytes = m_graph.nameBytes;
+    header.textBytes = m_graph.textBytes;
+    SnapshotLayout layout = layoutFor(header);
+    header.payloadBytes = layout.end;
+
+    //The in-memory arrays are already in snapshot form, so this is a straight copy
+    vector<char> payload(layout.end, 0);
+    memcpy(&payload[layout.coords], m_graph.coords, sizeof(double) * 2 * m_graph.nodeCount);
+    memcpy(&payload[layout.keys], m_graph.keys, sizeof(CoordKey) * m_graph.nodeCount);
+    memcpy(&payload[layout.textOffsets], m_graph.textOffsets, sizeof(uint32_t) * (m_graph.nodeCount + (size_t)1));
+    memcpy(&payload[layout.edgeOffsets], m_graph.edgeOffsets, sizeof(uint32_t) * (m_graph.nodeCount + (size_t)1));
+    memcpy(&payload[layout.edges], m_graph.edges, sizeof(StreetEdge) * m_graph.edgeCount);
+    memcpy(&payload[layout.nameOffsets], m_graph.nameOffsets, sizeof(uint32_t) * (m_graph.nameCount + (size_t)1));
+    memcpy(&payload[layout.names], m_graph.names, m_graph.nameBytes);
+    memcpy(&payload[layout.text], m_graph.text, m_graph.textBytes);
+    memcpy(&payload[layout.index], m_graph.index, sizeof(uint32_t) * m_graph.indexSlots);
+    header.checksum = checksumBytes(payload.data(), payload.size());
+
+    ofstream outfile(snapshotFile, ios::binary | ios::trunc);
+    if (!outfile)
+    {
+        LOG_ERROR("Cannot open " << snapshotFile << " for writing");
+        return false;
+    }
+    outfile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outfile.write(payload.data(), payload.size());
+    return (bool)outfile;
+}
+
+bool StreetMapImpl::loadSnapshot(string snapshotFile, bool verify)
+{
+    clear();
+    if (!m_snapshotFile.open(snapshotFile))
+    {
+        LOG_ERROR("Cannot open " << snapshotFile);
+        return false;
+    }
+    //Rejects anything that isn't a complete snapshot written by this version on this byte order
+    const char* data = m_snapshotFile.data();
+    SnapshotHeader header;
+    if (m_snapshotFile.size() < sizeof(header)) {
+        LOG_ERROR(snapshotFile << " is too small to be a snapshot");
+        m_snapshotFile.close();
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    const char* payload = data + sizeof(header);
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.byteOrder != SNAPSHOT_BYTE_ORDER
+        || header.version != SNAPSHOT_VERSION) {
+        LOG_ERROR(snapshotFile << " is not a version " << SNAPSHOT_VERSION << " snapshot");
+        m_snapshotFile.close();
+        return false;
     }
-    return false;  //unchanged vector, no such coord
+    SnapshotLayout layout = layoutFor(header);
+    if (header.payloadBytes != m_snapshotFile.size() - sizeof(header) || layout.end != header.payloadBytes
+        || header.indexSlots == 0 || (header.indexSlots & (header.indexSlots - 1)) != 0 || header.indexSlots <= header.nodeCount) {
+        LOG_ERROR(snapshotFile << " is truncated or has a bad layout");
+        m_snapshotFile.close();
+        return false;
+    }
+    //Row and name ends are the only values read here; the checksum reads every page, so it is
+    //left to callers that ask for it, and a snapshot loads in time independent of its size
+    const uint32_t* edgeOffsets = reinterpret_cast<const uint32_t*>(payload + layout.edgeOffsets);
+    const uint32_t* nameOffsets = reinterpret_cast<const uint32_t*>(payload + layout.nameOffsets);
+    if (edgeOffsets[header.nodeCount] != header.edgeCount || nameOffsets[header.nameCount] > header.nameBytes) {
+        LOG_ERROR(snapshotFile << " has a bad layout");
+        m_snapshotFile.close();
+        return false;
+    }
+    if (verify && checksumBytes(payload, header.payloadBytes) != header.checksum) {
+        LOG_ERROR(snapshotFile << " failed its checksum");
+        m_snapshotFile.close();
+        return false;
+    }
+    m_graph.coords = reinterpret_cast<const double*>(payload + layout.coords);
+    m_graph.keys = reinterpret_cast<const CoordKey*>(payload + layout.keys);
+    m_graph.textOffsets = reinterpret_cast<const uint32_t*>(payload + layout.textOffsets);
+    m_graph.edgeOffsets = reinterpret_cast<const uint32_t*>(payload + layout.edgeOffsets);
+    m_graph.edges = reinterpret_cast<const StreetEdge*>(payload + layout.edges);
+    m_graph.nameOffsets = reinterpret_cast<const uint32_t*>(payload + layout.nameOffsets);
+    m_graph.names = payload + layout.names;
+    m_graph.text = payload + layout.text;
+    m_graph.index = reinterpret_cast<const uint32_t*>(payload + layout.index);
+    m_graph.nodeCount = header.nodeCount;
+    m_graph.edgeCount = header.edgeCount;
+    m_graph.nameCount = header.nameCount;
+    m_graph.indexSlots = header.indexSlots;
+    m_graph.nameBytes = header.nameBytes;
+    m_graph.textBytes = header.textBytes;
+    dropRadians();
+    return true;
+}
+
+uint64_t StreetMapImpl::graphFingerprint() const
+{
+    //Row starts and edges together fix the graph; coordinates and names do not affect distances
+    uint64_t rows = checksumBytes(reinterpret_cast<const char*>(m_graph.edgeOffsets), sizeof(uint32_t) * (m_graph.nodeCount + (size_t)1));
+    uint64_t edges = checksumBytes(reinterpret_cast<const char*>(m_graph.edges), sizeof(StreetEdge) * m_graph.edgeCount);
+    return rows ^ (edges * 0x9e3779b97f4a7c15ULL);
 }
 
 //******************** StreetMap functions ************************************
@@ -113,8 +603,77 @@ bool StreetMap::load(string mapFile)
     return m_impl->load(mapFile);
 }
 
+void StreetMap::useThreadPool(ThreadPool* pool)
+{
+    m_impl->useThreadPool(pool);
+}
+
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
 
+bool StreetMap::findNode(const GeoCoord& gc, unsigned int& node) const
+{
+    return m_impl->findNode(gc, node);
+}
+
+unsigned int StreetMap::nodeCount() const
+{
+    return m_impl->nodeCount();
+}
+
+StreetEdgeRange StreetMap::edgesFrom(unsigned int node) const
+{
+    return m_impl->edgesFrom(node);
+}
+
+GeoCoord StreetMap::nodeCoord(unsigned int node) const
+{
+    return m_impl->nodeCoord(node);
+}
+
+double StreetMap::nodeLatitude(unsigned int node) const
+{
+    return m_impl->nodeLatitude(node);
+}
+
+double StreetMap::nodeLongitude(unsigned int node) const
+{
+    return m_impl->nodeLongitude(node);
+}
+
+const RadianCoords& StreetMap::nodeRadians() const
+{
+    return m_impl->nodeRadians();
+}
+
+const char* StreetMap::streetName(unsigned int nameId) const
+{
+    return m_impl->streetName(nameId);
+}
+
+StreetSegment StreetMap::segmentFor(unsigned int node, const StreetEdge& edge) const
+{
+    return StreetSegment(m_impl->nodeCoord(node), m_impl->nodeCoord(edge.target), m_impl->streetName(edge.nameId));
+}
+
+unsigned long long StreetMap::graphFingerprint() const
+{
+    return m_impl->graphFingerprint();
+}
+
+unsigned long long StreetMap::generation() const
+{
+    return m_impl->generation();
+}
+
+bool StreetMap::saveSnapshot(string snapshotFile) const
+{
+    return m_impl->saveSnapshot(snapshotFile);
+}
+
+bool StreetMap::loadSnapshot(string snapshotFile, bool verify)
+{
+    return m_impl->loadSnapshot(snapshotFile, verify);
+}
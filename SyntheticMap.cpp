@@ -0,0 +1,238 @@
+#include "SyntheticMap.h"
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+namespace
+{
+    const int64_t ORIGIN_LAT = 340000000;       // 34.0, in 1e-7 degrees
+    const int64_t ORIGIN_LON = -1180000000;     // -118.0
+    const int64_t LAT_SPACING = 10000;          // 0.001 degrees
+    const int64_t LON_SPACING = 12000;          // about as far as LAT_SPACING at this latitude
+    const unsigned int BLOCKS_PER_RECORD = 8;
+    const unsigned int DIAGONAL_EVERY = 16;
+    const uint64_t DROP_ONE_IN = 10;
+
+      // splitmix64's finalizer over the seed and up to three values, so each choice
+      // depends only on what it is about
+    uint64_t hashOf(uint64_t seed, uint64_t a, uint64_t b = 0, uint64_t c = 0)
+    {
+        uint64_t x = seed ^ (a * 0x9e3779b97f4a7c15ULL) ^ (b * 0xc2b2ae3d27d4eb4fULL) ^ (c * 0x165667b19e3779f9ULL);
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    struct Point
+    {
+        int64_t lat;
+        int64_t lon;
+    };
+
+    Point intersection(const SyntheticMapOptions& options, unsigned int row, unsigned int col)
+    {
+        Point p = { ORIGIN_LAT + row * LAT_SPACING, ORIGIN_LON + col * LON_SPACING };
+        if (options.layout == SyntheticMapOptions::LAYOUT_STREETS) {
+            uint64_t h = hashOf(options.seed, row, col);
+            p.lat += (int64_t)(h % (LAT_SPACING * 3 / 5 + 1)) - LAT_SPACING * 3 / 10;
+            p.lon += (int64_t)((h >> 32) % (LON_SPACING * 3 / 5 + 1)) - LON_SPACING * 3 / 10;
+        }
+        return p;
+    }
+
+      // units of 1e-7 degrees as a decimal with seven places, the way the sample map has them;
+      // returns where the text starts, ending at end
+    char* formatCoord(int64_t units, char* end)
+    {
+        char* p = end;
+        uint64_t magnitude = units < 0 ? (uint64_t)-units : (uint64_t)units;
+        for (int place = 0; place < 7; place++) {
+            *--p = (char)('0' + magnitude % 10);
+            magnitude /= 10;
+        }
+        *--p = '.';
+        do {
+            *--p = (char)('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (units < 0)
+            *--p = '-';
+        return p;
+    }
+
+    string coordText(int64_t units)
+    {
+        char text[32];
+        char* start = formatCoord(units, text + sizeof(text));
+        return string(start, text + sizeof(text));
+    }
+
+    class MapWriter
+    {
+    public:
+        MapWriter(const string& path, const SyntheticMapOptions& options)
+         : m_out(path, ios::binary | ios::trunc), m_options(options), m_side(syntheticMapSide(options)), m_segments(0)
+        {
+            m_buffer.reserve(BUFFER_BYTES + 4096);
+        }
+        bool write(size_t& segmentsWritten);
+    private:
+        static const size_t BUFFER_BYTES = 1 << 20;
+
+        bool perturbed() const { return m_options.layout == SyntheticMapOptions::LAYOUT_STREETS; }
+        Point at(unsigned int row, unsigned int col) const { return intersection(m_options, row, col); }
+        bool keepColumnBlock(unsigned int row, unsigned int col) const;
+        void writeStreet(const string& name, const vector<Point>& points, const vector<bool>& kept);
+        void writeCoord(int64_t units);
+        void writeText(const char* text, size_t length);
+        void flush();
+
+        ofstream m_out;
+        SyntheticMapOptions m_options;
+        unsigned int m_side;
+        size_t m_segments;
+        string m_buffer;
+    };
+
+    bool MapWriter::keepColumnBlock(unsigned int row, unsigned int col) const
+    {
+        //The outer columns hold every row together, so only inner blocks go
+        if (!perturbed() || col == 0 || col + 1 == m_side)
+            return true;
+        return hashOf(m_options.seed, row, col, 1) % DROP_ONE_IN != 0;
+    }
+
+    bool MapWriter::write(size_t& segmentsWritten)
+    {
+        if (!m_out)
+            return false;
+        vector<Point> points;
+        vector<bool> kept;
+        for (unsigned int row = 0; row < m_side; row++) {
+            points.clear();
+            for (unsigned int col = 0; col < m_side; col++)
+                points.push_back(at(row, col));
+            kept.assign(m_side - 1, true);
+            writeStreet("Street " + to_string(row + 1), points, kept);
+        }
+        for (unsigned int col = 0; col < m_side; col++) {
+            points.clear();
+            kept.clear();
+            for (unsigned int row = 0; row < m_side; row++) {
+                points.push_back(at(row, col));
+                if (row + 1 < m_side)
+                    kept.push_back(keepColumnBlock(row, col));
+            }
+            writeStreet("Avenue " + to_string(col + 1), points, kept);
+        }
+        if (perturbed()) {
+            for (unsigned int start = DIAGONAL_EVERY / 2; start + 1 < m_side; start += DIAGONAL_EVERY) {
+                points.clear();
+                for (unsigned int k = 0; start + k < m_side; k++)
+                    points.push_back(at(start + k, k));
+                kept.assign(points.size() - 1, true);
+                writeStreet("Diagonal " + to_string(start / DIAGONAL_EVERY + 1), points, kept);
+            }
+        }
+        flush();
+        segmentsWritten = m_segments;
+        return (bool)m_out;
+    }
+
+      // The kept blocks between consecutive points, a few to a record; a left out
+      // block ends a record early
+    void MapWriter::writeStreet(const string& name, const vector<Point>& points, const vector<bool>& kept)
+    {
+        size_t block = 0;
+        while (block < kept.size()) {
+            if (!kept[block]) {
+                block++;
+                continue;
+            }
+            size_t end = block;
+            while (end < kept.size() && kept[end] && end - block < BLOCKS_PER_RECORD)
+                end++;
+            string header = name + "\n" + to_string(end - block) + "\n";
+            writeText(header.data(), header.size());
+            for (; block < end; block++) {
+                writeCoord(points[block].lat);
+                writeText(" ", 1);
+                writeCoord(points[block].lon);
+                writeText(" ", 1);
+                writeCoord(points[block + 1].lat);
+                writeText(" ", 1);
+                writeCoord(points[block + 1].lon);
+                writeText("\n", 1);
+                m_segments++;
+            }
+            if (m_buffer.size() >= BUFFER_BYTES)
+                flush();
+        }
+    }
+
+    void MapWriter::writeCoord(int64_t units)
+    {
+        char text[32];
+        char* start = formatCoord(units, text + sizeof(text));
+        writeText(start, text + sizeof(text) - start);
+    }
+
+    void MapWriter::writeText(const char* text, size_t length)
+    {
+        m_buffer.append(text, length);
+    }
+
+    void MapWriter::flush()
+    {
+        m_out.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+}
+
+unsigned int syntheticMapSide(const SyntheticMapOptions& options)
+{
+    //2n(n - 1) segments for a side of n
+    double side = (1 + sqrt(1 + 2.0 * options.segments)) / 2;
+    return max(2u, (unsigned int)llround(side));
+}
+
+bool writeSyntheticMap(const string& path, const SyntheticMapOptions& options, size_t& segmentsWritten)
+{
+    MapWriter writer(path, options);
+    return writer.write(segmentsWritten);
+}
+
+bool writeSyntheticDeliveries(const string& path, const SyntheticMapOptions& options,
+    unsigned int count, unsigned int radius, uint64_t seed)
+{
+    ofstream outfile(path, ios::trunc);
+    if (!outfile)
+        return false;
+    unsigned int side = syntheticMapSide(options);
+    unsigned int depotRow = (unsigned int)(hashOf(seed, 0, 1) % side);
+    unsigned int depotCol = (unsigned int)(hashOf(seed, 0, 2) % side);
+    Point depot = intersection(options, depotRow, depotCol);
+    outfile << coordText(depot.lat) << " " << coordText(depot.lon) << "\n";
+    for (unsigned int i = 1; i <= count; i++) {
+        unsigned int row, col;
+        if (radius == 0) {
+            row = (unsigned int)(hashOf(seed, i, 1) % side);
+            col = (unsigned int)(hashOf(seed, i, 2) % side);
+        } else {
+            //Within the square of radius blocks around the depot, cut off at the edges of the map
+            int64_t span = 2 * (int64_t)radius + 1;
+            int64_t r = (int64_t)depotRow + (int64_t)(hashOf(seed, i, 1) % span) - radius;
+            int64_t c = (int64_t)depotCol + (int64_t)(hashOf(seed, i, 2) % span) - radius;
+            row = (unsigned int)min<int64_t>(max<int64_t>(r, 0), side - 1);
+            col = (unsigned int)min<int64_t>(max<int64_t>(c, 0), side - 1);
+        }
+        Point p = intersection(options, row, col);
+        outfile << coordText(p.lat) << " " << coordText(p.lon) << ":item " << i << "\n";
+    }
+    return (bool)outfile;
+}
@@ -0,0 +1,57 @@
+// SyntheticMap.h
+
+// Deterministic street maps of any size, written in the same text format as
+// mapdata.txt, so the loader, router and planner can be measured on cities far
+// larger than the sample data.  The same options and seed always write the
+// same bytes, on any platform, so results from different commits compare.
+//
+// Both layouts start from a square lattice of intersections, n by n, with a
+// street along every row and every column, about 0.001 degrees (a tenth of a
+// kilometre) apart; that is 2n(n - 1) segments, so n is picked to come close
+// to the number asked for.  Each street is written as records of a few blocks
+// each under the same name, the way the sample map splits its streets.
+//   LAYOUT_GRID     the lattice as is
+//   LAYOUT_STREETS  a perturbed street network: every intersection moved by up
+//                   to 30% of the spacing, one in ten blocks of the inner
+//                   columns left out, and a diagonal avenue every 16 rows
+//                   cutting across the blocks.  The rows and the outer columns
+//                   are always kept, so every intersection stays reachable.
+//
+// Coordinates are kept as whole multiples of 1e-7 degrees, the precision they
+// are printed with, and every random choice is a hash of the seed and the
+// intersection or block it is about rather than a step of a shared generator.
+// That makes the map cheap to stream, a block at a time, and lets
+// writeSyntheticDeliveries() pick intersections on the map without reading it.
+
+#ifndef SYNTHETICMAP_INCLUDED
+#define SYNTHETICMAP_INCLUDED
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct SyntheticMapOptions
+{
+    enum Layout { LAYOUT_GRID, LAYOUT_STREETS };
+
+    SyntheticMapOptions()
+     : layout(LAYOUT_GRID), segments(10000), seed(1)
+    {}
+    Layout   layout;
+    size_t   segments;      // roughly how many to write
+    uint64_t seed;
+};
+
+  // intersections along each side of the lattice for these options
+unsigned int syntheticMapSide(const SyntheticMapOptions& options);
+
+  // writes the map, setting how many segments went into it, or returns false if
+  // the file could not be written
+bool writeSyntheticMap(const std::string& path, const SyntheticMapOptions& options, size_t& segmentsWritten);
+
+  // a depot and count deliveries at intersections of that map, in the format main.cpp
+  // reads; the deliveries lie within radius blocks of the depot, 0 for anywhere
+bool writeSyntheticDeliveries(const std::string& path, const SyntheticMapOptions& options,
+    unsigned int count, unsigned int radius, uint64_t seed);
+
+#endif // SYNTHETICMAP_INCLUDED
@@ -0,0 +1,129 @@
+#include "ThreadPool.h"
+using namespace std;
+
+namespace
+{
+      // Which pool and queue the current thread works for, if any
+    thread_local const ThreadPool* t_pool = nullptr;
+    thread_local unsigned int t_queue = 0;
+}
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+    : m_queued(0), m_nextQueue(0), m_stopping(false)
+{
+    if (threadCount == 0)
+        threadCount = thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+    m_threadCount = threadCount;
+    //The calling thread is the last pair of hands, so one thread needs no workers at all
+    unsigned int workers = threadCount - 1;
+    for (unsigned int i = 0; i < (workers > 0 ? workers : 1); i++)
+        m_queues.push_back(new WorkQueue);
+    for (unsigned int i = 0; i < workers; i++)
+        m_workers.push_back(thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_workers.size(); i++)
+        m_workers[i].join();
+    for (size_t i = 0; i < m_queues.size(); i++)
+        delete m_queues[i];
+}
+
+bool ThreadPool::popBack(unsigned int queue, Task& task)
+{
+    WorkQueue& q = *m_queues[queue];
+    lock_guard<mutex> lock(q.m_mutex);
+    if (q.m_tasks.empty())
+        return false;
+    task = q.m_tasks.back();
+    q.m_tasks.pop_back();
+    m_queued--;
+    return true;
+}
+
+bool ThreadPool::stealFront(unsigned int queue, Task& task)
+{
+    WorkQueue& q = *m_queues[queue];
+    lock_guard<mutex> lock(q.m_mutex);
+    if (q.m_tasks.empty())
+        return false;
+    task = q.m_tasks.front();
+    q.m_tasks.pop_front();
+    m_queued--;
+    return true;
+}
+
+bool ThreadPool::runOne(unsigned int preferred)
+{
+    //Own queue newest-first while its data is still warm, then other queues oldest-first
+    Task task;
+    bool found = popBack(preferred, task);
+    for (unsigned int i = 1; !found && i < m_queues.size(); i++)
+        found = stealFront((preferred + i) % m_queues.size(), task);
+    if (!found)
+        return false;
+    Batch* batch = task.m_batch;
+    (*batch->m_body)(task.m_index);
+    if (--batch->m_remaining == 0) { //the thread waiting on this batch may be asleep
+        lock_guard<mutex> lock(m_mutex);
+        m_wake.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(unsigned int worker)
+{
+    t_pool = this;
+    t_queue = worker;
+    for (;;) {
+        if (runOne(worker))
+            continue;
+        unique_lock<mutex> lock(m_mutex);
+        m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+        if (m_stopping)
+            return;
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)>& body)
+{
+    if (count == 0)
+        return;
+    if (m_workers.empty() || count == 1) { //nobody to share with
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+    Batch batch;
+    batch.m_body = &body;
+    batch.m_remaining = count;
+    //Deal the pieces out across the queues, starting with our own if we are a worker
+    unsigned int home = t_pool == this ? t_queue : m_nextQueue++ % m_queues.size();
+    for (size_t i = 0; i < count; i++) {
+        WorkQueue& q = *m_queues[(home + i) % m_queues.size()];
+        lock_guard<mutex> lock(q.m_mutex);
+        Task task = { &batch, i };
+        q.m_tasks.push_back(task);
+        m_queued++;
+    }
+    {
+        lock_guard<mutex> lock(m_mutex);
+    }
+    m_wake.notify_all();
+
+    //Help until the batch is done; tasks run here may belong to other batches too
+    while (batch.m_remaining > 0) {
+        if (runOne(home))
+            continue;
+        unique_lock<mutex> lock(m_mutex);
+        m_wake.wait(lock, [&] { return batch.m_remaining == 0 || m_queued > 0; });
+    }
+}
@@ -0,0 +1,65 @@
+// ThreadPool.h
+
+// Fixed set of worker threads for running independent pieces of one job in
+// parallel, such as the legs of a delivery plan or the rows of a distance
+// matrix.  Each worker has its own task deque: it takes its newest task from
+// the back and, when that runs dry, steals the oldest task from another
+// worker's front, so uneven pieces still keep every core busy.
+//
+// parallelFor() does not block idly: while its pieces are outstanding the
+// calling thread runs queued tasks itself.  A task may therefore call
+// parallelFor() again on the same pool without deadlocking, and a pool of one
+// thread simply runs everything on the caller.
+
+#ifndef THREADPOOL_INCLUDED
+#define THREADPOOL_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned int threadCount = 0);   // 0 means one per hardware thread
+    ~ThreadPool();
+    unsigned int threadCount() const { return m_threadCount; }   // workers plus the calling thread
+      // runs body(i) for every i in [0, count), possibly concurrently, and returns when all are done
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+      // We prevent a ThreadPool object from being copied or assigned.
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+private:
+    struct Batch {
+        const std::function<void(size_t)>* m_body;
+        std::atomic<size_t> m_remaining;
+    };
+    struct Task {
+        Batch* m_batch;
+        size_t m_index;
+    };
+    struct WorkQueue {
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+    void workerLoop(unsigned int worker);
+    bool runOne(unsigned int preferred);
+    bool popBack(unsigned int queue, Task& task);
+    bool stealFront(unsigned int queue, Task& task);
+
+    unsigned int m_threadCount;
+    std::vector<WorkQueue*> m_queues;       // one per worker; callers from outside share them round-robin
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;                     // guards sleeping and waking, not the queues
+    std::condition_variable m_wake;
+    std::atomic<size_t> m_queued;
+    std::atomic<unsigned int> m_nextQueue;
+    bool m_stopping;
+};
+
+#endif // THREADPOOL_INCLUDED
@@ -0,0 +1,210 @@
+#include "TourSearch.h"
+#include <algorithm>
+#include <limits>
+using namespace std;
+
+namespace
+{
+    const double IMPROVEMENT = 1e-10;   // smaller gains are rounding noise and could cycle forever
+}
+
+TourSearch::TourSearch(const vector<vector<double>>& distances, unsigned int neighbourCount)
+{
+    m_n = (int)distances.size();
+    m_moves = ALL_MOVES;
+    shared_ptr<vector<double>> dist = make_shared<vector<double>>((size_t)m_n * m_n);
+    for (int i = 0; i < m_n; i++)
+        for (int j = 0; j < m_n; j++)
+            (*dist)[(size_t)i * m_n + j] = distances[i][j];
+    m_dist = dist;
+
+    //Nearest by the round trip, since a move may join two stops either way round
+    shared_ptr<vector<vector<int>>> neighbours = make_shared<vector<vector<int>>>(m_n);
+    vector<int> others;
+    for (int a = 0; a < m_n; a++) {
+        others.clear();
+        for (int c = 0; c < m_n; c++)
+            if (c != a)
+                others.push_back(c);
+        size_t keep = min((size_t)neighbourCount, others.size());
+        partial_sort(others.begin(), others.begin() + keep, others.end(), [&](int x, int y) {
+            return distance(a, x) + distance(x, a) < distance(a, y) + distance(y, a);
+        });
+        (*neighbours)[a].assign(others.begin(), others.begin() + keep);
+    }
+    m_neighbours = neighbours;
+
+    vector<int> identity(m_n);
+    for (int i = 0; i < m_n; i++)
+        identity[i] = i;
+    setTour(identity);
+}
+
+void TourSearch::setTour(const vector<int>& tour)
+{
+    m_tour = tour;
+    m_position.resize(m_n);
+    for (int p = 0; p < m_n; p++)
+        m_position[m_tour[p]] = p;
+    rebuildSums();
+}
+
+void TourSearch::rebuildSums()
+{
+    m_forward.resize(m_n);
+    m_backward.resize(m_n);
+    m_forward[0] = 0;
+    m_backward[0] = 0;
+    for (int p = 1; p < m_n; p++) {
+        m_forward[p] = m_forward[p - 1] + at(p - 1, p);
+        m_backward[p] = m_backward[p - 1] + at(p, p - 1);
+    }
+}
+
+double TourSearch::length() const
+{
+    return m_forward[m_n - 1] + at(m_n - 1, 0);
+}
+
+double TourSearch::lowerBound() const
+{
+    //Every stop is left once and entered once, so half of its cheapest way out plus
+    //half of its cheapest way in, summed over the stops, is at most any tour's length
+    if (m_n < 2)
+        return 0;
+    double bound = 0;
+    for (int a = 0; a < m_n; a++) {
+        double out = numeric_limits<double>::infinity(), in = out;
+        for (int c = 0; c < m_n; c++) {
+            if (c != a) {
+                out = min(out, distance(a, c));
+                in = min(in, distance(c, a));
+            }
+        }
+        bound += (out + in) / 2;
+    }
+    return bound;
+}
+
+double TourSearch::twoOptDelta(int p, int q) const
+{
+    //Edges p -> p+1 and q -> q+1 become p -> q and p+1 -> q+1, and the stretch between runs backwards
+    int after = next(q);
+    double inside = (m_backward[q] - m_backward[p + 1]) - (m_forward[q] - m_forward[p + 1]);
+    return at(p, q) + at(p + 1, after) - at(p, p + 1) - at(q, after) + inside;
+}
+
+void TourSearch::applyTwoOpt(int p, int q)
+{
+    reverse(m_tour.begin() + p + 1, m_tour.begin() + q + 1);
+    for (int i = p + 1; i <= q; i++)
+        m_position[m_tour[i]] = i;
+    rebuildSums();
+}
+
+double TourSearch::moveDelta(int s, int e, int k) const
+{
+    //The run s..e is cut out, its neighbours joined, and it is spliced in between k and k+1
+    int before = s - 1;
+    int after = next(e);
+    int kNext = next(k);
+    return at(before, after) + at(k, s) + at(e, kNext)
+         - at(before, s) - at(e, after) - at(k, kNext);
+}
+
+void TourSearch::applyMove(int s, int e, int k)
+{
+    int first, last;
+    if (k > e) {
+        rotate(m_tour.begin() + s, m_tour.begin() + e + 1, m_tour.begin() + k + 1);
+        first = s;
+        last = k;
+    }
+    else {
+        rotate(m_tour.begin() + k + 1, m_tour.begin() + s, m_tour.begin() + e + 1);
+        first = k + 1;
+        last = e;
+    }
+    for (int i = first; i <= last; i++)
+        m_position[m_tour[i]] = i;
+    rebuildSums();
+}
+
+void TourSearch::wake(int position)
+{
+    int stop = m_tour[position];
+    if (!m_active[stop]) {
+        m_active[stop] = 1;
+        m_queue.push_back(stop);
+    }
+}
+
+bool TourSearch::improveStop(int stop)
+{
+    //First improving move that joins stop to one of its neighbours
+    int i = m_position[stop];
+    for (int c : (*m_neighbours)[stop]) {
+        int j = m_position[c];
+
+        //2-opt: either new edge out of the earlier of the two, or into the later
+        int lo = min(i, j), hi = max(i, j);
+        int pairs[2][2] = { { lo, hi }, { lo - 1, hi - 1 } };
+        for (int t = 0; t < 2 && (m_moves & TWO_OPT); t++) {
+            int p = pairs[t][0], q = pairs[t][1];
+            if (p < 0 || q - p < 2)
+                continue;
+            if (twoOptDelta(p, q) < -IMPROVEMENT) {
+                int touched[4] = { p, p + 1, q, next(q) };
+                applyTwoOpt(p, q);
+                for (int position : touched)
+                    wake(position);
+                return true;
+            }
+        }
+
+        //Or-opt and relocate: a run of 1 to 3 stops starting or ending at stop,
+        //put just after c or just before it
+        for (int length = 1; length <= 3; length++) {
+            if (!(m_moves & (length == 1 ? RELOCATE : OR_OPT)))
+                continue;
+            for (int end = 0; end < 2; end++) {
+                int s = end == 0 ? i : i - length + 1;
+                int e = s + length - 1;
+                if (s < 1 || e > m_n - 1 || (length == 1 && end == 1))
+                    continue;
+                int targets[2] = { j, j == 0 ? m_n - 1 : j - 1 };
+                for (int k : targets) {
+                    if (k >= s - 1 && k <= e)
+                        continue;
+                    if (moveDelta(s, e, k) < -IMPROVEMENT) {
+                        int touched[6] = { s - 1, s, e, next(e), k, next(k) };
+                        int stops[6];
+                        for (int x = 0; x < 6; x++)
+                            stops[x] = m_tour[touched[x]];
+                        applyMove(s, e, k);
+                        for (int x = 0; x < 6; x++)
+                            wake(m_position[stops[x]]);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+double TourSearch::improve()
+{
+    m_active.assign(m_n, 1);
+    m_queue.clear();
+    for (int p = 0; p < m_n; p++)
+        m_queue.push_back(m_tour[p]);
+    while (!m_queue.empty()) {
+        int stop = m_queue.front();
+        m_queue.pop_front();
+        m_active[stop] = 0;
+        if (improveStop(stop))
+            wake(m_position[stop]); //its surroundings changed, try it again
+    }
+    return length();
+}
@@ -0,0 +1,73 @@
+// TourSearch.h
+
+// Local search over delivery tours using a precomputed distance matrix.  A
+// tour is a cycle of stop numbers that starts at the depot, stop 0, which
+// never moves.  Three kinds of move are tried:
+//   2-opt     reverse a stretch of the tour, replacing two edges
+//   Or-opt    move a run of two or three consecutive stops elsewhere
+//   relocate  move a single stop elsewhere
+// Road distances are not symmetric, so reversing a stretch also changes the
+// cost of every edge inside it.  Running sums of the tour's edges in both
+// directions make that, and so every move's change in length, O(1) to
+// evaluate; applying a move is O(n).
+//
+// improve() only tries moves that join a stop to one of its nearest
+// neighbours, and skips stops whose neighbourhood has not changed since they
+// last failed to improve ("don't-look bits"), so a pass costs about n times
+// the neighbour count instead of n squared.
+//
+// Copies share the distance matrix and neighbour lists, which never change,
+// so several searches over one matrix can run side by side on their own
+// copies.
+
+#ifndef TOURSEARCH_INCLUDED
+#define TOURSEARCH_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+#include <memory>
+
+class TourSearch
+{
+public:
+    enum Move { TWO_OPT = 1, OR_OPT = 2, RELOCATE = 4, ALL_MOVES = 7 };
+
+    TourSearch(const std::vector<std::vector<double>>& distances, unsigned int neighbourCount = 10);
+    void setMoves(unsigned int moves) { m_moves = moves; }     // Move bits improve() may use
+    void setTour(const std::vector<int>& tour);     // tour[0] must be 0, the depot
+    const std::vector<int>& tour() const { return m_tour; }
+    double length() const;
+    double improve();                               // to a local optimum, returns the new length
+
+      // change in length from reversing tour positions p+1 .. q, for 0 <= p, p + 1 < q < stops
+    double twoOptDelta(int p, int q) const;
+    void applyTwoOpt(int p, int q);
+      // change in length from moving positions s .. e (1 <= s <= e) to just after position k,
+      // which must lie outside s - 1 .. e
+    double moveDelta(int s, int e, int k) const;
+    void applyMove(int s, int e, int k);
+
+    int stops() const { return m_n; }
+    double distance(int from, int to) const { return (*m_dist)[(size_t)from * m_n + to]; }
+    double lowerBound() const;                      // no tour of these stops is shorter
+private:
+    int next(int position) const { return position + 1 == m_n ? 0 : position + 1; }
+    double at(int p, int q) const { return distance(m_tour[p], m_tour[q]); }
+    void rebuildSums();
+    bool improveStop(int stop);
+    void wake(int position);
+
+    int m_n;
+    unsigned int m_moves;
+    std::shared_ptr<const std::vector<double>> m_dist;                // m_n x m_n, row-major
+    std::shared_ptr<const std::vector<std::vector<int>>> m_neighbours; // nearest stops first, either direction
+    std::vector<int> m_tour;
+    std::vector<int> m_position;                // tour position of each stop
+    std::vector<double> m_forward;              // m_forward[k]: length of tour positions 0 .. k
+    std::vector<double> m_backward;             // the same stretch walked in reverse
+    std::vector<char> m_active;                 // don't-look bits inverted: set while a stop is queued
+    std::deque<int> m_queue;                    // stops to try improving around
+};
+
+#endif // TOURSEARCH_INCLUDED
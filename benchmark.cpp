@@ -0,0 +1,1293 @@
+// benchmark.cpp
+
+// Standalone benchmarks.  Like testHashMap.cpp this has its own main and is
+// built separately from main.cpp, together with the other .cpp files:
+//   benchmark hashmap mapdata.txt     hash map variants over the map's coordinate keys
+//   benchmark router mapdata.txt      A* node expansions, lazy open set vs indexed heap
+//   benchmark ch mapdata.txt          contraction hierarchy build, save/load, and queries vs A*
+//   benchmark alt mapdata.txt         landmark heuristic, settled nodes and queries vs great-circle A*
+//   benchmark matrix mapdata.txt      distance matrix from one search per stop vs a route per pair
+//   benchmark threads mapdata.txt     64-stop matrix and plan on thread pools of 1, 2, 4 and 8 threads
+//   benchmark optimizer mapdata.txt   tour length and time, local search vs the original random-swap annealing,
+//                                     and seeded annealing over time and iteration budgets and multiple starts
+//   benchmark plans mapdata.txt       plans per second, a planner per plan vs one generateDeliveryPlans batch,
+//                                     without and with a shared leg cache
+//   benchmark fleet mapdata.txt       splitting 200 and 2000 weighted stops among capacity-limited vans
+//   benchmark load mapdata.txt        parsing the map file on its own and on thread pools of 2, 4 and 8 threads
+//   benchmark snapshot mapdata.txt    parsing the map file vs saving it as a snapshot and loading that,
+//                                     with and without verifying the snapshot's checksum
+//   benchmark metrics mapdata.txt     one plan's phase times and search counts, the cost of the metrics
+//                                     registry, and its JSON and Prometheus dumps
+//   benchmark haversine mapdata.txt   all-pairs great-circle distances among the map's nodes, one
+//                                     distanceEarthMiles call at a time vs each batch kernel
+//   benchmark generate grid|streets segments seed map.txt [deliveries.txt count radius]
+//                                     writes a synthetic map, and optionally a delivery file for it
+//   benchmark suite map.txt results.json [queries]
+//                                     load time, route latency percentiles over random pairs (200 by
+//                                     default), tour length against optimizer budget, and plans per
+//                                     second, printed and written to results.json to compare commits
+
+#include "ExpandableHashMap.h"
+#include "FlatHashMap.h"
+#include "CoordKey.h"
+#include "ThreadPool.h"
+#include "TourSearch.h"
+#include "Metrics.h"
+#include "SyntheticMap.h"
+#include "Haversine.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <map>
+#include <cstdint>
+#include <queue>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <filesystem>
+using namespace std;
+
+namespace
+{
+    double secondsSince(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+      // A file in the system's temporary directory, removed when this goes out of scope,
+      // so the preprocessed files the benchmarks save and reload leave nothing behind
+    class TempFile
+    {
+    public:
+        TempFile(string extension)
+        {
+            random_device entropy;
+            string name = "benchmark-" + to_string(entropy()) + "-" + to_string(entropy()) + extension;
+            m_path = (filesystem::temp_directory_path() / name).string();
+        }
+        ~TempFile() { remove(m_path.c_str()); }
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+        const string& path() const { return m_path; }
+    private:
+        string m_path;
+    };
+
+      // Every distinct coordinate in a map file, in file order
+    bool loadCoordKeys(string mapFile, vector<CoordKey>& keys)
+    {
+        ifstream infile(mapFile);
+        if (!infile)
+            return false;
+        FlatHashMap<CoordKey, uint32_t> seen;
+        string name;
+        while (getline(infile, name)) {
+            int numsSeg;
+            infile >> numsSeg;
+            infile.ignore(10000, '\n');
+            for (int i = 0; i < numsSeg; i++) {
+                double coords[4];
+                infile >> coords[0] >> coords[1] >> coords[2] >> coords[3];
+                infile.ignore(10000, '\n');
+                for (int c = 0; c < 4; c += 2) {
+                    CoordKey key = makeCoordKey(coords[c], coords[c + 1]);
+                    if (seen.find(key) == nullptr) {
+                        seen.associate(key, (uint32_t)keys.size());
+                        keys.push_back(key);
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    struct StdHasher
+    {
+        size_t operator()(const CoordKey& key) const { return hasher(key); }
+    };
+
+      // std::unordered_map behind the ExpandableHashMap interface
+    struct StdMap
+    {
+        unordered_map<CoordKey, uint32_t, StdHasher> m_map;
+        void associate(const CoordKey& key, uint32_t value) { m_map[key] = value; }
+        const uint32_t* find(const CoordKey& key) const
+        {
+            auto it = m_map.find(key);
+            return it == m_map.end() ? nullptr : &it->second;
+        }
+        void reset() { m_map.clear(); }
+    };
+
+    template<typename Allocator>
+    void emptyMap(ExpandableHashMap<CoordKey, uint32_t, Allocator>& map) { map.reset(); }
+    void emptyMap(FlatHashMap<CoordKey, uint32_t>& map) { map.clear(); }
+    void emptyMap(StdMap& map) { map.reset(); }
+
+      // Build, hit, miss, and the router's pattern of many small maps emptied between queries
+    template<typename Map>
+    void benchMap(const string& label, const vector<CoordKey>& keys, const vector<CoordKey>& misses)
+    {
+        size_t n = keys.size();
+        uint64_t found = 0;
+        Map* map = new Map;
+
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < n; i++)
+            map->associate(keys[i], (uint32_t)i);
+        double insertTime = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        for (int round = 0; round < 10; round++)
+            for (size_t i = 0; i < n; i++)
+                found += *map->find(keys[i]);
+        double hitTime = secondsSince(start);
+
+        start = chrono::steady_clock::now();
+        for (int round = 0; round < 10; round++)
+            for (size_t i = 0; i < n; i++)
+                found += map->find(misses[i]) != nullptr;
+        double missTime = secondsSince(start);
+        delete map;
+
+        const size_t querySize = 2000;
+        const int queries = 200;
+        map = new Map;
+        start = chrono::steady_clock::now();
+        for (int q = 0; q < queries; q++) {
+            emptyMap(*map);
+            size_t first = (q * 7919) % (n - querySize);
+            for (size_t i = first; i < first + querySize; i++)
+                map->associate(keys[i], (uint32_t)i);
+            for (size_t i = first; i < first + querySize; i++)
+                found += *map->find(keys[i]);
+        }
+        double queryTime = secondsSince(start);
+        delete map;
+
+        cout.setf(ios::fixed);
+        cout.precision(1);
+        cout << label << "  insert " << insertTime * 1e9 / n << " ns"
+             << "  hit " << hitTime * 1e9 / (10.0 * n) << " ns"
+             << "  miss " << missTime * 1e9 / (10.0 * n) << " ns"
+             << "  per-query " << queryTime * 1e6 / queries << " us"
+             << "  (" << found % 10 << ")" << endl;
+    }
+
+    int benchHashMaps(string mapFile)
+    {
+        vector<CoordKey> keys;
+        if (!loadCoordKeys(mapFile, keys) || keys.size() < 4000) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        vector<CoordKey> misses;
+        for (size_t i = 0; i < keys.size(); i++) { //one fixed-point step east of every real node
+            CoordKey miss = keys[i];
+            miss.bits ^= 1;
+            misses.push_back(miss);
+        }
+        cout << keys.size() << " distinct coordinates" << endl;
+        benchMap<ExpandableHashMap<CoordKey, uint32_t>>("ExpandableHashMap", keys, misses);
+        benchMap<ExpandableHashMap<CoordKey, uint32_t, ArenaAllocator>>("  with arena     ", keys, misses);
+        benchMap<FlatHashMap<CoordKey, uint32_t>>("FlatHashMap      ", keys, misses);
+        benchMap<StdMap>("unordered_map    ", keys, misses);
+        return 0;
+    }
+
+    double crowMiles(const StreetMap& sm, unsigned int from, unsigned int to)
+    {
+        GeoCoord a, b;
+        a.latitude = sm.nodeLatitude(from);
+        a.longitude = sm.nodeLongitude(from);
+        b.latitude = sm.nodeLatitude(to);
+        b.longitude = sm.nodeLongitude(to);
+        return distanceEarthMiles(a, b);
+    }
+
+      // The router's original open set: a priority_queue that gets a new entry on
+      // every improvement, no closed set, every popped entry expanded again
+    unsigned int legacyExpansions(const StreetMap& sm, unsigned int start, unsigned int end)
+    {
+        typedef pair<double, unsigned int> Entry;
+        priority_queue<Entry, vector<Entry>, greater<Entry>> openSet;
+        vector<double> gScore(sm.nodeCount(), -1);
+        gScore[start] = 0;
+        openSet.push(Entry(crowMiles(sm, start, end), start));
+        unsigned int expanded = 0;
+        while (!openSet.empty()) {
+            unsigned int current = openSet.top().second;
+            if (current == end)
+                break;
+            openSet.pop();
+            expanded++;
+            for (const StreetEdge& edge : sm.edgesFrom(current)) {
+                double g = gScore[current] + edge.length;
+                if (gScore[edge.target] < 0 || g < gScore[edge.target]) {
+                    gScore[edge.target] = g;
+                    openSet.push(Entry(g + crowMiles(sm, edge.target, end), edge.target));
+                }
+            }
+        }
+        return expanded;
+    }
+
+    int benchRouter(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        PointToPointRouter router(&sm);
+        mt19937 rng(12345); //fixed seed, same pairs every run
+        const int queries = 500;
+        uint64_t legacy = 0, indexed = 0;
+        double seconds = 0;
+        int routed = 0;
+        for (int q = 0; q < queries; q++) {
+            unsigned int a = rng() % sm.nodeCount();
+            unsigned int b = rng() % sm.nodeCount();
+            list<StreetSegment> route;
+            double dist;
+            auto start = chrono::steady_clock::now();
+            DeliveryResult result = router.generatePointToPointRoute(sm.nodeCoord(a), sm.nodeCoord(b), route, dist);
+            seconds += secondsSince(start);
+            if (result != DELIVERY_SUCCESS) //unreachable pairs expand the whole component either way
+                continue;
+            routed++;
+            indexed += router.nodesExpanded();
+            legacy += legacyExpansions(sm, a, b);
+        }
+        cout.setf(ios::fixed);
+        cout.precision(1);
+        cout << routed << " routed pairs of " << queries << endl;
+        cout << "nodes expanded per route  lazy priority_queue " << (double)legacy / routed
+             << "  indexed heap + closed set " << (double)indexed / routed << endl;
+        cout.precision(3);
+        cout << "router " << seconds * 1e3 / queries << " ms per query" << endl;
+        return 0;
+    }
+
+    int benchHierarchy(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        cout.setf(ios::fixed);
+        cout.precision(3);
+        ContractionHierarchy built(&sm);
+        auto start = chrono::steady_clock::now();
+        built.build();
+        cout << "build " << secondsSince(start) << " s" << endl;
+        TempFile chFile(".ch");
+        if (!built.save(chFile.path()))
+            return 1;
+        ContractionHierarchy ch(&sm);
+        start = chrono::steady_clock::now();
+        if (!ch.load(chFile.path()))
+            return 1;
+        cout << "load " << secondsSince(start) * 1e3 << " ms" << endl;
+
+        PointToPointRouter astar(&sm);
+        PointToPointRouter hierarchy(&sm);
+        hierarchy.useContractionHierarchy(&ch);
+        mt19937 rng(12345); //fixed seed, same pairs every run
+        const int queries = 500;
+        double astarSeconds = 0, chSeconds = 0;
+        uint64_t astarExpanded = 0, chSettled = 0;
+        int routed = 0, mismatches = 0;
+        for (int q = 0; q < queries; q++) {
+            GeoCoord a = sm.nodeCoord(rng() % sm.nodeCount());
+            GeoCoord b = sm.nodeCoord(rng() % sm.nodeCount());
+            list<StreetSegment> astarRoute, chRoute;
+            double astarDist, chDist;
+            start = chrono::steady_clock::now();
+            DeliveryResult astarResult = astar.generatePointToPointRoute(a, b, astarRoute, astarDist);
+            astarSeconds += secondsSince(start);
+            unsigned int expanded = astar.nodesExpanded(); //per thread, read before the next query
+            start = chrono::steady_clock::now();
+            DeliveryResult chResult = hierarchy.generatePointToPointRoute(a, b, chRoute, chDist);
+            chSeconds += secondsSince(start);
+            if (astarResult != chResult || abs(astarDist - chDist) > 1e-9 * (1 + astarDist)) {
+                mismatches++;
+                continue;
+            }
+            if (astarResult != DELIVERY_SUCCESS)
+                continue;
+            routed++;
+            astarExpanded += expanded;
+            chSettled += hierarchy.nodesExpanded();
+        }
+        cout << routed << " routed pairs of " << queries << ", " << mismatches << " differ from A*" << endl;
+        cout.precision(1);
+        cout << "nodes per route  A* " << (double)astarExpanded / routed
+             << "  hierarchy " << (double)chSettled / routed << endl;
+        cout.precision(3);
+        cout << "A* " << astarSeconds * 1e3 / queries << " ms per query"
+             << "  hierarchy " << chSeconds * 1e3 / queries << " ms per query" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    int benchLandmarks(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        cout.setf(ios::fixed);
+        int mismatches = 0;
+        const unsigned int counts[] = { 4, 8, 16 };
+        for (unsigned int k : counts) {
+            LandmarkTable built(&sm);
+            auto start = chrono::steady_clock::now();
+            built.build(k);
+            double buildSeconds = secondsSince(start);
+            TempFile altFile(".alt");
+            if (!built.save(altFile.path()))
+                return 1;
+            LandmarkTable landmarks(&sm);
+            if (!landmarks.load(altFile.path()))
+                return 1;
+
+            PointToPointRouter crow(&sm);
+            PointToPointRouter alt(&sm);
+            alt.useLandmarks(&landmarks);
+            mt19937 rng(12345); //fixed seed, same pairs every run
+            const int queries = 500;
+            double crowSeconds = 0, altSeconds = 0;
+            uint64_t crowExpanded = 0, altExpanded = 0;
+            int routed = 0;
+            for (int q = 0; q < queries; q++) {
+                GeoCoord a = sm.nodeCoord(rng() % sm.nodeCount());
+                GeoCoord b = sm.nodeCoord(rng() % sm.nodeCount());
+                list<StreetSegment> crowRoute, altRoute;
+                double crowDist, altDist;
+                start = chrono::steady_clock::now();
+                DeliveryResult crowResult = crow.generatePointToPointRoute(a, b, crowRoute, crowDist);
+                crowSeconds += secondsSince(start);
+                unsigned int expanded = crow.nodesExpanded(); //per thread, read before the next query
+                start = chrono::steady_clock::now();
+                DeliveryResult altResult = alt.generatePointToPointRoute(a, b, altRoute, altDist);
+                altSeconds += secondsSince(start);
+                if (crowResult != altResult || abs(crowDist - altDist) > 1e-9 * (1 + crowDist)) {
+                    mismatches++;
+                    continue;
+                }
+                if (crowResult != DELIVERY_SUCCESS)
+                    continue;
+                routed++;
+                crowExpanded += expanded;
+                altExpanded += alt.nodesExpanded();
+            }
+            cout.precision(3);
+            cout << k << " landmarks  build " << buildSeconds << " s";
+            cout.precision(1);
+            cout << "  nodes per route  great-circle " << (double)crowExpanded / routed
+                 << "  landmarks " << (double)altExpanded / routed;
+            cout.precision(3);
+            cout << "  ms per query " << crowSeconds * 1e3 / queries << " vs " << altSeconds * 1e3 / queries << endl;
+        }
+        cout << mismatches << " routes differ from great-circle A*" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    int benchMatrix(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        PointToPointRouter router(&sm);
+        mt19937 rng(12345); //fixed seed, same stops every run
+        cout.setf(ios::fixed);
+        int mismatches = 0;
+        const int sizes[] = { 10, 25, 50 };
+        for (int deliveryCount : sizes) {
+            //Stops drawn until a fully connected set turns up
+            GeoCoord depot;
+            vector<DeliveryRequest> deliveries;
+            vector<vector<double>> matrix;
+            double matrixSeconds = 0;
+            for (;;) {
+                depot = sm.nodeCoord(rng() % sm.nodeCount());
+                deliveries.clear();
+                for (int i = 0; i < deliveryCount; i++)
+                    deliveries.push_back(DeliveryRequest("item", sm.nodeCoord(rng() % sm.nodeCount())));
+                auto start = chrono::steady_clock::now();
+                DeliveryResult result = router.computeDistanceMatrix(depot, deliveries, matrix);
+                matrixSeconds = secondsSince(start);
+                if (result == DELIVERY_SUCCESS)
+                    break;
+            }
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i <= deliveryCount; i++) {
+                for (int j = 0; j <= deliveryCount; j++) {
+                    list<StreetSegment> route;
+                    double dist;
+                    router.generatePointToPointRoute(i == 0 ? depot : deliveries[i - 1].location,
+                        j == 0 ? depot : deliveries[j - 1].location, route, dist);
+                    if (abs(dist - matrix[i][j]) > 1e-9 * (1 + dist))
+                        mismatches++;
+                }
+            }
+            double pairSeconds = secondsSince(start);
+            cout.precision(2);
+            cout << deliveryCount << " deliveries  matrix " << matrixSeconds * 1e3 << " ms"
+                 << "  route per pair " << pairSeconds * 1e3 << " ms" << endl;
+        }
+        cout << mismatches << " entries differ from routed distances" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+      // A depot and deliveries that can all reach one another, drawn with a fixed seed
+    bool connectedStops(const StreetMap& sm, int deliveryCount, GeoCoord& depot, vector<DeliveryRequest>& deliveries)
+    {
+        PointToPointRouter router(&sm);
+        mt19937 rng(12345);
+        vector<vector<double>> matrix;
+        for (int attempt = 0; attempt < 100; attempt++) {
+            depot = sm.nodeCoord(rng() % sm.nodeCount());
+            deliveries.clear();
+            for (int i = 0; i < deliveryCount; i++)
+                deliveries.push_back(DeliveryRequest("item " + to_string(i), sm.nodeCoord(rng() % sm.nodeCount())));
+            if (router.computeDistanceMatrix(depot, deliveries, matrix) == DELIVERY_SUCCESS)
+                return true;
+        }
+        return false;
+    }
+
+    int benchThreads(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        GeoCoord depot;
+        vector<DeliveryRequest> deliveries;
+        if (!connectedStops(sm, 64, depot, deliveries)) {
+            cout << "No connected set of stops found" << endl;
+            return 1;
+        }
+        PointToPointRouter sequential(&sm);
+        vector<vector<double>> expected;
+        sequential.computeDistanceMatrix(depot, deliveries, expected);
+
+        cout.setf(ios::fixed);
+        cout.precision(2);
+        cout << thread::hardware_concurrency() << " hardware threads" << endl;
+        int mismatches = 0;
+        const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+        for (unsigned int threads : threadCounts) {
+            ThreadPool pool(threads);
+            PointToPointRouter router(&sm);
+            router.useThreadPool(&pool);
+            vector<vector<double>> matrix;
+            auto start = chrono::steady_clock::now();
+            router.computeDistanceMatrix(depot, deliveries, matrix);
+            double matrixSeconds = secondsSince(start);
+            if (matrix != expected)
+                mismatches++;
+
+            DeliveryPlanner planner(&sm);
+            planner.useThreadPool(&pool);
+            vector<DeliveryCommand> commands;
+            double miles;
+            start = chrono::steady_clock::now();
+            planner.generateDeliveryPlan(depot, deliveries, commands, miles);
+            double planSeconds = secondsSince(start);
+            cout << threads << " threads  matrix " << matrixSeconds * 1e3 << " ms"
+                 << "  plan " << planSeconds * 1e3 << " ms  (" << miles << " miles)" << endl;
+        }
+        cout << mismatches << " matrices differ from the single-threaded one" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    double tourLength(const vector<int>& tour, const vector<vector<double>>& distances)
+    {
+        double length = 0;
+        for (size_t i = 0; i < tour.size(); i++)
+            length += distances[tour[i]][tour[(i + 1) % tour.size()]];
+        return length;
+    }
+
+      // The optimizer's original search: swap a stop with a random other, recompute the
+      // whole tour, keep the swap if shorter or, with falling probability, anyway
+    double legacyAnneal(vector<int>& tour, const vector<vector<double>>& distances, mt19937& rng)
+    {
+        int n = (int)tour.size() - 1;
+        int heat = n / 2;
+        double currentDist = tourLength(tour, distances);
+        for (int pass = 0; pass < n; pass++) {
+            for (int i = 0; i < n; i++) {
+                int curr = 1 + pass % n;
+                int other = 1 + rng() % n;
+                swap(tour[curr], tour[other]);
+                double newDist = tourLength(tour, distances);
+                if (newDist - currentDist > 0 && (int)(rng() % (n + 1)) >= heat)
+                    swap(tour[curr], tour[other]);
+                else
+                    currentDist = newDist;
+            }
+            heat /= 2;
+        }
+        return currentDist;
+    }
+
+    int benchOptimizer(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        cout.setf(ios::fixed);
+        mt19937 rng(12345);
+        int errors = 0;
+        const int sizes[] = { 20, 50, 100, 200 };
+        for (int stops : sizes) {
+            //Road distances where the map allows, crow-flies distances between random nodes otherwise
+            GeoCoord depot;
+            vector<DeliveryRequest> deliveries;
+            vector<vector<double>> distances;
+            bool road = stops <= 100 && connectedStops(sm, stops, depot, deliveries);
+            if (road)
+                PointToPointRouter(&sm).computeDistanceMatrix(depot, deliveries, distances);
+            else {
+                vector<GeoCoord> coords;
+                for (int i = 0; i <= stops; i++)
+                    coords.push_back(sm.nodeCoord(rng() % sm.nodeCount()));
+                distances.assign(stops + 1, vector<double>(stops + 1));
+                for (int i = 0; i <= stops; i++)
+                    for (int j = 0; j <= stops; j++)
+                        distances[i][j] = distanceEarthMiles(coords[i], coords[j]);
+            }
+            vector<int> tour(stops + 1);
+            for (int i = 0; i <= stops; i++)
+                tour[i] = i;
+            double initial = tourLength(tour, distances);
+
+            vector<int> annealed = tour;
+            auto start = chrono::steady_clock::now();
+            double annealLength = legacyAnneal(annealed, distances, rng);
+            double annealSeconds = secondsSince(start);
+
+            start = chrono::steady_clock::now();
+            TourSearch search(distances);
+            double searchLength = search.improve();
+            double searchSeconds = secondsSince(start);
+            if (abs(searchLength - tourLength(search.tour(), distances)) > 1e-9 * searchLength)
+                errors++;
+
+            cout.precision(2);
+            cout << stops << " stops (" << (road ? "road" : "crow") << ")  start " << initial
+                 << "  annealing " << annealLength << " in " << annealSeconds * 1e3 << " ms"
+                 << "  local search " << searchLength << " in " << searchSeconds * 1e3 << " ms" << endl;
+
+            //Annealing before the local search, over growing budgets; each run is made twice
+            //with the same seed and must come out the same
+            vector<DeliveryRequest> items;
+            for (int i = 1; i <= stops; i++)
+                items.push_back(DeliveryRequest("item " + to_string(i), sm.nodeCoord(i % sm.nodeCount())));
+            DeliveryOptimizer optimizer(&sm);
+            const unsigned long long budgets[] = { 10000, 100000, 1000000 };
+            for (unsigned long long budget : budgets) {
+                OptimizerOptions options;
+                options.iterationBudget = budget;
+                options.seed = 7;
+                optimizer.setOptions(options);
+                vector<DeliveryRequest> first = items, second = items;
+                double oldDistance, newDistance, replayDistance;
+                start = chrono::steady_clock::now();
+                optimizer.optimizeDeliveryOrder(depot, first, distances, oldDistance, newDistance);
+                double seconds = secondsSince(start);
+                optimizer.optimizeDeliveryOrder(depot, second, distances, oldDistance, replayDistance);
+                bool same = replayDistance == newDistance;
+                for (int i = 0; same && i < stops; i++)
+                    same = first[i].item == second[i].item;
+                if (!same)
+                    errors++;
+                cout << "    annealed " << budget << " moves  " << newDistance << " in " << seconds * 1e3 << " ms"
+                     << (same ? "" : "  (replay differs)") << endl;
+            }
+            OptimizerOptions timed;
+            timed.timeBudgetMs = 50;
+            timed.cooling = OptimizerOptions::COOL_LINEAR;
+            optimizer.setOptions(timed);
+            vector<DeliveryRequest> order = items;
+            double oldDistance, newDistance;
+            start = chrono::steady_clock::now();
+            optimizer.optimizeDeliveryOrder(depot, order, distances, oldDistance, newDistance);
+            cout << "    annealed 50 ms, linear cooling  " << newDistance << " in " << secondsSince(start) * 1e3 << " ms" << endl;
+
+            //Several starts sharing the same 50 ms on a pool, and stopping early near the lower bound
+            ThreadPool pool(8);
+            optimizer.useThreadPool(&pool);
+            const unsigned int startCounts[] = { 1, 8 };
+            for (unsigned int count : startCounts) {
+                OptimizerOptions multi = timed;
+                multi.starts = count;
+                optimizer.setOptions(multi);
+                order = items;
+                start = chrono::steady_clock::now();
+                optimizer.optimizeDeliveryOrder(depot, order, distances, oldDistance, newDistance);
+                cout << "    annealed 50 ms, " << count << " starts on 8 threads  " << newDistance
+                     << " in " << secondsSince(start) * 1e3 << " ms" << endl;
+            }
+            OptimizerOptions early = timed;
+            early.starts = 8;
+            early.timeBudgetMs = 1000;
+            early.targetGap = 0.7;
+            optimizer.setOptions(early);
+            order = items;
+            start = chrono::steady_clock::now();
+            optimizer.optimizeDeliveryOrder(depot, order, distances, oldDistance, newDistance);
+            cout << "    8 starts, up to 1 s, stopping within 70% of the lower bound "
+                 << TourSearch(distances).lowerBound() << "  " << newDistance
+                 << " in " << secondsSince(start) * 1e3 << " ms" << endl;
+            optimizer.useThreadPool(nullptr);
+
+            //Time windows around a random order, half an hour wide, at 25 mph with 3 minutes a stop
+            vector<int> hidden(stops);
+            for (int i = 0; i < stops; i++)
+                hidden[i] = i + 1;
+            shuffle(hidden.begin(), hidden.end(), rng);
+            vector<DeliveryRequest> windowed = items;
+            double clock = 0;
+            for (int i = 0; i < stops; i++) {
+                clock += distances[i == 0 ? 0 : hidden[i - 1]][hidden[i]] * 60 / 25;
+                DeliveryRequest& d = windowed[hidden[i] - 1];
+                d.earliest = max(0.0, clock - (double)(rng() % 30));
+                d.latest = d.earliest + 30;
+                d.serviceMinutes = 3;
+                clock += 3;
+            }
+            optimizer.setOptions(OptimizerOptions());
+            start = chrono::steady_clock::now();
+            optimizer.optimizeDeliveryOrder(depot, windowed, distances, oldDistance, newDistance);
+            double windowSeconds = secondsSince(start);
+            int late = 0, at = 0;
+            clock = 0;
+            map<string, int> stopOf;
+            for (int i = 0; i < stops; i++)
+                stopOf[items[i].item] = i + 1;
+            for (const DeliveryRequest& d : windowed) {
+                int stop = stopOf[d.item];
+                clock = max(clock + distances[at][stop] * 60 / 25, d.earliest);
+                late += clock > d.latest;
+                clock += d.serviceMinutes;
+                at = stop;
+            }
+            hidden.insert(hidden.begin(), 0);
+            cout << "    time windows  " << newDistance << " in " << windowSeconds * 1e3 << " ms, " << late
+                 << " late (the order they were made around: " << tourLength(hidden, distances) << ")" << endl;
+        }
+        cout << errors << " tours whose tracked length drifted from the real one or did not replay" << endl;
+        return errors == 0 ? 0 : 1;
+    }
+
+    int benchPlans(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        //A dispatcher's worth of small jobs among stops that can all reach one another:
+        //those with a route to and from one hub are in the hub's strongly connected part
+        GeoCoord hub;
+        vector<DeliveryRequest> candidates, stops;
+        if (!connectedStops(sm, 1, hub, candidates)) {
+            cout << "No connected set of stops found" << endl;
+            return 1;
+        }
+        mt19937 rng(54321);
+        candidates.clear();
+        for (int i = 0; i < 300; i++)
+            candidates.push_back(DeliveryRequest("item " + to_string(i), sm.nodeCoord(rng() % sm.nodeCount())));
+        vector<vector<double>> matrix;
+        PointToPointRouter(&sm).computeDistanceMatrix(hub, candidates, matrix);
+        for (size_t i = 0; i < candidates.size(); i++)
+            if (matrix[0][i + 1] != numeric_limits<double>::infinity() && matrix[i + 1][0] != numeric_limits<double>::infinity())
+                stops.push_back(candidates[i]);
+        vector<DeliveryJob> jobs;
+        const size_t depots = 4, hotspots = 40; //a few depots serving popular stops, so legs recur
+        for (int j = 0; j < 200; j++) {
+            vector<DeliveryRequest> deliveries;
+            int count = 5 + rng() % 11;
+            for (int i = 0; i < count; i++)
+                deliveries.push_back(stops[depots + rng() % min(hotspots, stops.size() - depots)]);
+            jobs.push_back(DeliveryJob(stops[rng() % depots].location, deliveries));
+        }
+
+        cout.setf(ios::fixed);
+        cout.precision(1);
+        auto start = chrono::steady_clock::now();
+        int failed = 0;
+        for (size_t j = 0; j < jobs.size(); j++) { //main.cpp style, everything built per plan
+            DeliveryPlanner planner(&sm);
+            vector<DeliveryCommand> commands;
+            double miles;
+            failed += planner.generateDeliveryPlan(jobs[j].depot, jobs[j].deliveries, commands, miles) != DELIVERY_SUCCESS;
+        }
+        cout << "planner per plan        " << jobs.size() / secondsSince(start) << " plans/s" << endl;
+
+        DeliveryPlanner planner(&sm);
+        vector<DeliveryPlanResult> results;
+        start = chrono::steady_clock::now();
+        planner.generateDeliveryPlans(jobs, results);
+        cout << "batch                   " << jobs.size() / secondsSince(start) << " plans/s" << endl;
+
+        ThreadPool pool;
+        planner.useThreadPool(&pool);
+        start = chrono::steady_clock::now();
+        planner.generateDeliveryPlans(jobs, results);
+        cout << "batch, " << pool.threadCount() << " thread pool   " << jobs.size() / secondsSince(start) << " plans/s" << endl;
+        for (size_t j = 0; j < results.size(); j++)
+            failed += results[j].result != DELIVERY_SUCCESS;
+
+        //Jobs share a few hundred stops, so legs repeat across plans
+        LegCache cache(16 * 1024 * 1024);
+        planner.useLegCache(&cache);
+        for (int round = 0; round < 2; round++) {
+            start = chrono::steady_clock::now();
+            planner.generateDeliveryPlans(jobs, results);
+            cout << "batch + leg cache " << (round == 0 ? "cold" : "warm") << "  "
+                 << jobs.size() / secondsSince(start) << " plans/s" << endl;
+            for (size_t j = 0; j < results.size(); j++)
+                failed += results[j].result != DELIVERY_SUCCESS;
+        }
+        cout << cache.hits() << " hits, " << cache.misses() << " misses, "
+             << cache.bytesUsed() / 1024 << " KB cached" << endl;
+        cout << failed << " plans failed" << endl;
+        return failed == 0 ? 0 : 1;
+    }
+
+    int benchFleet(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        ThreadPool pool;
+        PointToPointRouter router(&sm);
+        router.useThreadPool(&pool);
+        GeoCoord depot;
+        vector<DeliveryRequest> candidates;
+        if (!connectedStops(sm, 1, depot, candidates)) {
+            cout << "No connected set of stops found" << endl;
+            return 1;
+        }
+        cout.setf(ios::fixed);
+        cout.precision(2);
+        mt19937 rng(777);
+        int errors = 0;
+        const int sizes[] = { 200, 2000 };
+        for (int wanted : sizes) {
+            //Stops in the depot's strongly connected part, weighing 1 to 20, vans carrying
+            //up to 150 items or 1000 pounds, enough of them to be about 85% full
+            candidates.clear();
+            for (int i = 0; i < wanted * 5 / 4; i++)
+                candidates.push_back(DeliveryRequest("item " + to_string(i), sm.nodeCoord(rng() % sm.nodeCount()), 1 + rng() % 20));
+            vector<vector<double>> matrix;
+            router.computeDistanceMatrix(depot, candidates, matrix);
+            vector<DeliveryRequest> deliveries;
+            double totalWeight = 0;
+            for (size_t i = 0; i < candidates.size() && (int)deliveries.size() < wanted; i++) {
+                if (matrix[0][i + 1] != numeric_limits<double>::infinity() && matrix[i + 1][0] != numeric_limits<double>::infinity()) {
+                    deliveries.push_back(candidates[i]);
+                    totalWeight += candidates[i].weight;
+                }
+            }
+            size_t vans = max((size_t)ceil(totalWeight / 850), (deliveries.size() + 127) / 128);
+            vector<Vehicle> vehicles(vans, Vehicle(150, 1000));
+
+            auto start = chrono::steady_clock::now();
+            router.computeDistanceMatrix(depot, deliveries, matrix);
+            double matrixSeconds = secondsSince(start);
+            DeliveryOptimizer optimizer(&sm);
+            optimizer.useThreadPool(&pool);
+            vector<vector<DeliveryRequest>> trips;
+            double fleetMiles;
+            start = chrono::steady_clock::now();
+            bool fitted = optimizer.optimizeFleetOrder(depot, deliveries, matrix, vehicles, trips, fleetMiles);
+            double fleetSeconds = secondsSince(start);
+
+            //Every delivery made once, and no van over its limits
+            map<string, int> made;
+            for (size_t v = 0; fitted && v < trips.size(); v++) {
+                double load = 0;
+                for (const DeliveryRequest& d : trips[v]) {
+                    made[d.item]++;
+                    load += d.weight;
+                }
+                if (trips[v].size() > vehicles[v].maxItems || load > vehicles[v].maxWeight)
+                    errors++;
+            }
+            if (!fitted || made.size() != deliveries.size())
+                errors++;
+            for (const auto& count : made)
+                errors += count.second != 1;
+
+            //One trip to every stop, for scale
+            vector<DeliveryRequest> single = deliveries;
+            double before, alone;
+            optimizer.optimizeDeliveryOrder(depot, single, matrix, before, alone);
+
+            DeliveryPlanner planner(&sm);
+            planner.useThreadPool(&pool);
+            vector<VehiclePlan> plans;
+            double planMiles;
+            start = chrono::steady_clock::now();
+            DeliveryResult result = planner.generateFleetPlan(depot, deliveries, vehicles, plans, planMiles);
+            double planSeconds = secondsSince(start);
+            errors += result != DELIVERY_SUCCESS;
+
+            cout << deliveries.size() << " stops, " << vans << " vans  matrix " << matrixSeconds * 1e3 << " ms"
+                 << "  split and order " << fleetSeconds * 1e3 << " ms, " << fleetMiles << " miles"
+                 << " (one van, no limits: " << alone << ")"
+                 << "  whole plan " << planSeconds * 1e3 << " ms" << endl;
+        }
+        cout << errors << " problems with the plans" << endl;
+        return errors == 0 ? 0 : 1;
+    }
+
+    int benchLoad(string mapFile)
+    {
+        //Every load must build the same graph however the file is split up
+        cout.setf(ios::fixed);
+        cout.precision(1);
+        unsigned long long fingerprint = 0;
+        int mismatches = 0;
+        const unsigned int threadCounts[] = { 0, 2, 4, 8 };
+        for (unsigned int threads : threadCounts) {
+            ThreadPool pool(threads == 0 ? 1 : threads);
+            StreetMap sm;
+            if (threads > 0)
+                sm.useThreadPool(&pool);
+            const int runs = 3;
+            double best = 0;
+            for (int run = 0; run < runs; run++) {
+                auto start = chrono::steady_clock::now();
+                if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+                    cout << "Unable to load map data file " << mapFile << endl;
+                    return 1;
+                }
+                double seconds = secondsSince(start);
+                best = run == 0 ? seconds : min(best, seconds);
+            }
+            if (threads == 0)
+                fingerprint = sm.graphFingerprint();
+            else if (sm.graphFingerprint() != fingerprint)
+                mismatches++;
+            if (threads == 0)
+                cout << "no pool   ";
+            else
+                cout << threads << " threads ";
+            cout << " best of " << runs << " " << best * 1e3 << " ms  " << sm.nodeCount() << " nodes" << endl;
+        }
+        cout << mismatches << " loads built a different graph" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    int benchSnapshot(string mapFile)
+    {
+        cout.setf(ios::fixed);
+        cout.precision(3);
+        StreetMap parsed;
+        auto start = chrono::steady_clock::now();
+        if (!parsed.load(mapFile) || parsed.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        cout << "parse     " << secondsSince(start) * 1e3 << " ms  " << parsed.nodeCount() << " nodes" << endl;
+        TempFile snapshotFile(".snap");
+        start = chrono::steady_clock::now();
+        if (!parsed.saveSnapshot(snapshotFile.path()))
+            return 1;
+        cout << "save      " << secondsSince(start) * 1e3 << " ms" << endl;
+
+        //Best of a few, so the page cache is warm for both kinds of load
+        int mismatches = 0;
+        const bool verify[] = { false, true };
+        for (bool checked : verify) {
+            const int runs = 5;
+            double best = 0;
+            for (int run = 0; run < runs; run++) {
+                StreetMap sm;
+                start = chrono::steady_clock::now();
+                if (!sm.loadSnapshot(snapshotFile.path(), checked))
+                    return 1;
+                double seconds = secondsSince(start);
+                best = run == 0 ? seconds : min(best, seconds);
+                if (run == 0 && sm.graphFingerprint() != parsed.graphFingerprint())
+                    mismatches++;
+            }
+            cout << (checked ? "verified  " : "mapped    ") << " best of " << runs << " " << best * 1e3 << " ms" << endl;
+        }
+        cout << mismatches << " snapshots hold a different graph" << endl;
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    int benchMetrics(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        GeoCoord depot;
+        vector<DeliveryRequest> deliveries;
+        if (!connectedStops(sm, 20, depot, deliveries)) {
+            cout << "No connected set of stops found" << endl;
+            return 1;
+        }
+        DeliveryPlanner planner(&sm);
+        vector<DeliveryCommand> commands;
+        vector<DeliveryEta> etas;
+        double miles;
+        PlanMetrics metrics;
+        planner.generateDeliveryPlan(depot, deliveries, commands, etas, miles, metrics);
+        cout.setf(ios::fixed);
+        cout.precision(3);
+        cout << deliveries.size() << " deliveries, " << metrics.legs << " legs, " << metrics.totalSeconds * 1e3 << " ms:"
+             << "  matrix " << metrics.matrixSeconds * 1e3 << "  optimize " << metrics.optimizeSeconds * 1e3
+             << "  route " << metrics.routeSeconds * 1e3 << "  commands " << metrics.commandSeconds * 1e3 << " ms" << endl;
+        cout << metrics.routing.searches << " searches expanded " << metrics.routing.nodesExpanded << " nodes with "
+             << metrics.routing.heapPushes << " heap pushes and " << metrics.routing.nodeLookups << " node lookups" << endl;
+
+        //The same plans with the registry off and on, alternating so neither gets the warmer caches
+        const int plans = 100;
+        double seconds[2] = { 0, 0 };
+        for (int round = 0; round < 4; round++) {
+            int enabled = round % 2;
+            enableMetrics(enabled == 1);
+            auto start = chrono::steady_clock::now();
+            for (int p = 0; p < plans; p++) {
+                vector<DeliveryRequest> some(deliveries.begin(), deliveries.begin() + 5 + p % 16);
+                planner.generateDeliveryPlan(depot, some, commands, miles);
+            }
+            seconds[enabled] += secondsSince(start);
+        }
+        enableMetrics(false);
+        cout << 2 * plans << " plans, registry off " << seconds[0] * 1e3 << " ms, on " << seconds[1] * 1e3 << " ms" << endl;
+        cout << metricsJson() << metricsPrometheus();
+        return 0;
+    }
+
+    int benchHaversine(string mapFile)
+    {
+        StreetMap sm;
+        if (!sm.load(mapFile) || sm.nodeCount() == 0) {
+            cout << "Unable to load map data file " << mapFile << endl;
+            return 1;
+        }
+        //The first thousand nodes, every pair, a few times over
+        size_t count = min((size_t)1000, (size_t)sm.nodeCount());
+        vector<GeoCoord> points;
+        RadianCoords radians;
+        for (unsigned int n = 0; n < count; n++) {
+            points.push_back(sm.nodeCoord(n));
+            radians.add(points.back().latitude, points.back().longitude);
+        }
+        const int rounds = 5;
+        double pairs = (double)rounds * count * count;
+        cout.setf(ios::fixed);
+        cout.precision(2);
+        vector<vector<double>> expected(count, vector<double>(count));
+        auto start = chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++)
+            for (size_t i = 0; i < count; i++)
+                for (size_t j = 0; j < count; j++)
+                    expected[i][j] = distanceEarthMiles(points[i], points[j]);
+        cout << "distanceEarthMiles  " << secondsSince(start) * 1e9 / pairs << " ns a pair" << endl;
+        HaversineKernel original = haversineKernel();
+        const HaversineKernel kernels[] = { HAVERSINE_SCALAR, HAVERSINE_SSE2, HAVERSINE_AVX2 };
+        for (HaversineKernel kernel : kernels) {
+            if (!useHaversineKernel(kernel))
+                continue;
+            vector<vector<double>> miles;
+            start = chrono::steady_clock::now();
+            for (int round = 0; round < rounds; round++)
+                haversineManyToMany(radians, radians, miles);
+            double seconds = secondsSince(start);
+            double worst = 0;
+            for (size_t i = 0; i < count; i++)
+                for (size_t j = 0; j < count; j++)
+                    worst = max(worst, abs(miles[i][j] - expected[i][j]));
+            cout << haversineKernelName(kernel) << (kernel == original ? " (default)" : "") << "  "
+                 << seconds * 1e9 / pairs << " ns a pair, at most " << scientific << worst << fixed << " miles off" << endl;
+        }
+        useHaversineKernel(original);
+        return 0;
+    }
+
+    int benchGenerate(int argc, char* argv[])
+    {
+        //generate grid|streets segments seed map.txt [deliveries.txt count radius]
+        SyntheticMapOptions options;
+        string layout = argv[2];
+        if (layout != "grid" && layout != "streets") {
+            cout << "Layout must be grid or streets" << endl;
+            return 1;
+        }
+        options.layout = layout == "grid" ? SyntheticMapOptions::LAYOUT_GRID : SyntheticMapOptions::LAYOUT_STREETS;
+        options.segments = stoull(argv[3]);
+        options.seed = stoull(argv[4]);
+        auto start = chrono::steady_clock::now();
+        size_t written;
+        if (!writeSyntheticMap(argv[5], options, written)) {
+            cout << "Unable to write " << argv[5] << endl;
+            return 1;
+        }
+        cout.setf(ios::fixed);
+        cout.precision(1);
+        unsigned int side = syntheticMapSide(options);
+        cout << argv[5] << ": " << side << " by " << side << " intersections, " << written << " segments in "
+             << secondsSince(start) * 1e3 << " ms" << endl;
+        if (argc == 9) {
+            if (!writeSyntheticDeliveries(argv[6], options, stoul(argv[7]), stoul(argv[8]), options.seed)) {
+                cout << "Unable to write " << argv[6] << endl;
+                return 1;
+            }
+            cout << argv[6] << ": a depot and " << argv[7] << " deliveries" << endl;
+        }
+        return 0;
+    }
+
+      // Exact, from a sorted sample
+    double percentileOf(const vector<double>& sorted, double fraction)
+    {
+        if (sorted.empty())
+            return 0;
+        size_t rank = (size_t)ceil(fraction * sorted.size());
+        return sorted[rank == 0 ? 0 : rank - 1];
+    }
+
+    void writeDistribution(ostringstream& json, vector<double> values)
+    {
+        sort(values.begin(), values.end());
+        double sum = 0;
+        for (double v : values)
+            sum += v;
+        json << "{\"mean\": " << (values.empty() ? 0 : sum / values.size())
+             << ", \"p50\": " << percentileOf(values, 0.5) << ", \"p90\": " << percentileOf(values, 0.9)
+             << ", \"p99\": " << percentileOf(values, 0.99) << ", \"max\": " << (values.empty() ? 0 : values.back()) << "}";
+    }
+
+    int benchSuite(string mapFile, string resultsFile, unsigned int queries)
+    {
+        ostringstream json;
+        json.precision(9);
+        cout.setf(ios::fixed);
+        cout.precision(3);
+
+        //Load time, best of three, on the calling thread and on a pool
+        ThreadPool pool;
+        StreetMap sm;
+        double loadSeconds[2] = { 0, 0 };
+        for (int pooled = 0; pooled < 2; pooled++) {
+            StreetMap timed;
+            if (pooled)
+                timed.useThreadPool(&pool);
+            for (int run = 0; run < 3; run++) {
+                auto start = chrono::steady_clock::now();
+                if (!timed.load(mapFile) || timed.nodeCount() == 0) {
+                    cout << "Unable to load map data file " << mapFile << endl;
+                    return 1;
+                }
+                double seconds = secondsSince(start);
+                loadSeconds[pooled] = run == 0 ? seconds : min(loadSeconds[pooled], seconds);
+            }
+        }
+        sm.load(mapFile);
+        ifstream sized(mapFile, ios::binary | ios::ate);
+        json << "{\n  \"map\": {\"file\": \"" << mapFile << "\", \"bytes\": " << (long long)sized.tellg()
+             << ", \"nodes\": " << sm.nodeCount() << ", \"fingerprint\": \"" << hex << sm.graphFingerprint() << dec << "\"},\n"
+             << "  \"hardware_threads\": " << thread::hardware_concurrency() << ",\n"
+             << "  \"load\": {\"seconds\": " << loadSeconds[0] << ", \"pool_seconds\": " << loadSeconds[1]
+             << ", \"pool_threads\": " << pool.threadCount() << "},\n";
+        cout << sm.nodeCount() << " nodes  load " << loadSeconds[0] * 1e3 << " ms, on "
+             << pool.threadCount() << " threads " << loadSeconds[1] * 1e3 << " ms" << endl;
+
+        //Workloads are drawn from the nodes in coordinate order, not load order, so they
+        //stay the same for the same map whatever the loader does
+        vector<GeoCoord> nodes;
+        nodes.reserve(sm.nodeCount());
+        for (unsigned int n = 0; n < sm.nodeCount(); n++)
+            nodes.push_back(sm.nodeCoord(n));
+        sort(nodes.begin(), nodes.end(), [](const GeoCoord& a, const GeoCoord& b) {
+            return a.latitude != b.latitude ? a.latitude < b.latitude : a.longitude < b.longitude;
+        });
+        mt19937 rng(20240601);
+
+        //Point-to-point latency between random nodes anywhere on the map
+        PointToPointRouter router(&sm);
+        vector<double> latencies, expanded;
+        int unreachable = 0;
+        double routeMiles = 0;
+        for (unsigned int q = 0; q < queries; q++) {
+            const GeoCoord& from = nodes[rng() % nodes.size()];
+            const GeoCoord& to = nodes[rng() % nodes.size()];
+            list<StreetSegment> route;
+            double miles;
+            RouteMetrics metrics;
+            if (router.generatePointToPointRoute(from, to, route, miles, metrics) == DELIVERY_SUCCESS)
+                routeMiles += miles;
+            else
+                unreachable++;
+            latencies.push_back(metrics.seconds * 1e3);
+            expanded.push_back((double)metrics.nodesExpanded);
+        }
+        json << "  \"route\": {\"queries\": " << queries << ", \"unreachable\": " << unreachable
+             << ", \"miles\": " << routeMiles << ",\n    \"ms\": ";
+        writeDistribution(json, latencies);
+        json << ",\n    \"nodes_expanded\": ";
+        writeDistribution(json, expanded);
+        json << "},\n";
+        sort(latencies.begin(), latencies.end());
+        cout << queries << " routes  p50 " << percentileOf(latencies, 0.5) << " ms  p99 "
+             << percentileOf(latencies, 0.99) << " ms  (" << unreachable << " unreachable)" << endl;
+
+        //Stops for the optimizer and planner come from one neighbourhood, a couple of
+        //thousand nodes around a hub, so plans cost the same on any size of map
+        GeoCoord hub = nodes[rng() % nodes.size()];
+        size_t nearby = min(nodes.size(), (size_t)2000);
+        nth_element(nodes.begin(), nodes.begin() + (nearby - 1), nodes.end(), [&](const GeoCoord& a, const GeoCoord& b) {
+            return distanceEarthMiles(hub, a) < distanceEarthMiles(hub, b);
+        });
+        sort(nodes.begin(), nodes.begin() + nearby, [](const GeoCoord& a, const GeoCoord& b) {
+            return a.latitude != b.latitude ? a.latitude < b.latitude : a.longitude < b.longitude;
+        });
+        vector<DeliveryRequest> candidates, stops;
+        for (int i = 0; i < 80; i++)
+            candidates.push_back(DeliveryRequest("item " + to_string(i), nodes[rng() % nearby]));
+        vector<vector<double>> matrix;
+        router.computeDistanceMatrix(hub, candidates, matrix);
+        for (size_t i = 0; i < candidates.size(); i++)
+            if (matrix[0][i + 1] != numeric_limits<double>::infinity() && matrix[i + 1][0] != numeric_limits<double>::infinity())
+                stops.push_back(candidates[i]);
+        if (stops.size() < 20) {
+            cout << "No connected set of stops found" << endl;
+            return 1;
+        }
+
+        //Tour length against time for growing budgets, one seed, on one 50 stop matrix
+        vector<DeliveryRequest> tourStops(stops.begin() + 1, stops.begin() + min(stops.size(), (size_t)51));
+        router.computeDistanceMatrix(stops[0].location, tourStops, matrix);
+        DeliveryOptimizer optimizer(&sm);
+        json << "  \"optimizer\": {\"stops\": " << tourStops.size() << ", \"lower_bound\": " << TourSearch(matrix).lowerBound()
+             << ", \"runs\": [";
+        struct Budget { const char* name; unsigned long long iterations; double ms; };
+        const Budget budgets[] = { { "local search", 0, 0 }, { "10k moves", 10000, 0 }, { "100k moves", 100000, 0 },
+                                   { "1M moves", 1000000, 0 }, { "10 ms", 0, 10 }, { "100 ms", 0, 100 } };
+        for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+            OptimizerOptions options;
+            options.iterationBudget = budgets[b].iterations;
+            options.timeBudgetMs = budgets[b].ms;
+            options.seed = 7;
+            optimizer.setOptions(options);
+            vector<DeliveryRequest> order = tourStops;
+            double oldDistance, newDistance;
+            auto start = chrono::steady_clock::now();
+            optimizer.optimizeDeliveryOrder(stops[0].location, order, matrix, oldDistance, newDistance);
+            double seconds = secondsSince(start);
+            json << (b == 0 ? "\n" : ",\n") << "    {\"budget\": \"" << budgets[b].name << "\", \"miles\": " << newDistance
+                 << ", \"seconds\": " << seconds << "}";
+            cout << budgets[b].name << "  " << newDistance << " miles in " << seconds * 1e3 << " ms" << endl;
+        }
+        json << "]},\n";
+
+        //End to end: a depot among the first few stops and 5 to 15 of the rest, planned
+        //with a planner each the way main.cpp does, and as one batch
+        vector<DeliveryJob> jobs;
+        const size_t depots = 4;
+        for (int j = 0; j < 100; j++) {
+            vector<DeliveryRequest> deliveries;
+            int count = 5 + rng() % 11;
+            for (int i = 0; i < count; i++)
+                deliveries.push_back(stops[depots + rng() % (stops.size() - depots)]);
+            jobs.push_back(DeliveryJob(stops[rng() % depots].location, deliveries));
+        }
+        int failed = 0;
+        double planMiles = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t j = 0; j < jobs.size(); j++) {
+            DeliveryPlanner planner(&sm);
+            vector<DeliveryCommand> commands;
+            double miles;
+            failed += planner.generateDeliveryPlan(jobs[j].depot, jobs[j].deliveries, commands, miles) != DELIVERY_SUCCESS;
+            planMiles += miles;
+        }
+        double perPlan = jobs.size() / secondsSince(start);
+        DeliveryPlanner planner(&sm);
+        planner.useThreadPool(&pool);
+        vector<DeliveryPlanResult> results;
+        start = chrono::steady_clock::now();
+        planner.generateDeliveryPlans(jobs, results);
+        double batch = jobs.size() / secondsSince(start);
+        for (size_t j = 0; j < results.size(); j++)
+            failed += results[j].result != DELIVERY_SUCCESS;
+        json << "  \"plans\": {\"jobs\": " << jobs.size() << ", \"failed\": " << failed << ", \"miles\": " << planMiles
+             << ", \"per_second\": " << perPlan << ", \"batch_per_second\": " << batch << "}\n}\n";
+        cout << jobs.size() << " plans  " << perPlan << " plans/s one at a time, " << batch << " plans/s batched  ("
+             << failed << " failed)" << endl;
+
+        ofstream outfile(resultsFile, ios::trunc);
+        outfile << json.str();
+        if (!outfile) {
+            cout << "Unable to write " << resultsFile << endl;
+            return 1;
+        }
+        return failed == 0 ? 0 : 1;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 3 && string(argv[1]) == "hashmap")
+        return benchHashMaps(argv[2]);
+    if (argc == 3 && string(argv[1]) == "router")
+        return benchRouter(argv[2]);
+    if (argc == 3 && string(argv[1]) == "ch")
+        return benchHierarchy(argv[2]);
+    if (argc == 3 && string(argv[1]) == "alt")
+        return benchLandmarks(argv[2]);
+    if (argc == 3 && string(argv[1]) == "matrix")
+        return benchMatrix(argv[2]);
+    if (argc == 3 && string(argv[1]) == "threads")
+        return benchThreads(argv[2]);
+    if (argc == 3 && string(argv[1]) == "optimizer")
+        return benchOptimizer(argv[2]);
+    if (argc == 3 && string(argv[1]) == "plans")
+        return benchPlans(argv[2]);
+    if (argc == 3 && string(argv[1]) == "fleet")
+        return benchFleet(argv[2]);
+    if (argc == 3 && string(argv[1]) == "load")
+        return benchLoad(argv[2]);
+    if (argc == 3 && string(argv[1]) == "snapshot")
+        return benchSnapshot(argv[2]);
+    if (argc == 3 && string(argv[1]) == "metrics")
+        return benchMetrics(argv[2]);
+    if (argc == 3 && string(argv[1]) == "haversine")
+        return benchHaversine(argv[2]);
+    if ((argc == 6 || argc == 9) && string(argv[1]) == "generate")
+        return benchGenerate(argc, argv);
+    if ((argc == 4 || argc == 5) && string(argv[1]) == "suite")
+        return benchSuite(argv[2], argv[3], argc == 5 ? stoul(argv[4]) : 200);
+    cout << "Usage: " << argv[0] << " hashmap|router|ch|alt|matrix|threads|optimizer|plans|fleet|load|snapshot|metrics|haversine mapdata.txt" << endl
+         << "       " << argv[0] << " generate grid|streets segments seed map.txt [deliveries.txt count radius]" << endl
+         << "       " << argv[0] << " suite map.txt results.json [queries]" << endl;
+    return 1;
+}
@@ -1,9 +1,11 @@
 #include "provided.h"
+#include "Logger.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <cstdlib>
 using namespace std;
 
 bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v);
@@ -17,6 +19,12 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    //LOG_LEVEL=debug, say, shows what the planner is doing on stderr
+    const char* logSetting = getenv("LOG_LEVEL");
+    LogLevel level;
+    if (logSetting != nullptr && parseLogLevel(logSetting, level))
+        setLogLevel(level);
+
     StreetMap sm;
         
     if (!sm.load(argv[1]))
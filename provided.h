@@ -1,17 +1,22 @@
 #ifndef PROVIDED_INCLUDED
 #define PROVIDED_INCLUDED
 
-// YOU MUST MAKE NO CHANGES TO THIS FILE!
+// The program's public interface: the coordinate, segment and delivery types,
+// and the map, preprocessing, router, optimizer and planner classes, each a
+// thin wrapper over an Impl class in its own .cpp file.  Once fixed by the
+// assignment, it now grows with the program; helpers used by only a few files
+// have headers of their own instead.
 
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <list>
+#include <limits>
 
 enum DeliveryResult
 {
-    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD
+    DELIVERY_SUCCESS, NO_ROUTE, BAD_COORD, OVER_CAPACITY
 };
 
 struct GeoCoord
@@ -71,15 +76,62 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
     return lhs.start == rhs.start  &&  lhs.end == rhs.end;
 }
 
+  // One directed edge of the street graph, as stored inside StreetMap.
+  // Nodes are the distinct coordinates, numbered 0 .. StreetMap::nodeCount()-1.
+struct StreetEdge
+{
+    unsigned int target;    // node the edge leads to
+    unsigned int nameId;    // street name, see StreetMap::streetName
+    double       length;    // miles
+};
+
+  // The outgoing edges of one node, usable in a range-based for loop
+struct StreetEdgeRange
+{
+    const StreetEdge* first;
+    const StreetEdge* last;
+    const StreetEdge* begin() const { return first; }
+    const StreetEdge* end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
 class StreetMapImpl;
+class ThreadPool;
+struct RadianCoords;
 
+  // Once loaded, a StreetMap is only read, and its const members may be called
+  // from any number of threads at once.  load() and loadSnapshot() must not run
+  // while other threads are using the map.
 class StreetMap
 {
 public:
     StreetMap();
     ~StreetMap();
+      // reports malformed lines by line number, skipping to the next street record
     bool load(std::string mapFile);
+      // parses the map file on the pool's threads when set
+    void useThreadPool(ThreadPool* pool);
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // binary graph snapshot; loadSnapshot maps the file and answers queries from it directly,
+      // checking only the header and layout unless verify is set, which checksums every byte
+    bool saveSnapshot(std::string snapshotFile) const;
+    bool loadSnapshot(std::string snapshotFile, bool verify = false);
+      // node-ID view of the graph; edges are returned in place, nothing is copied
+    bool findNode(const GeoCoord& gc, unsigned int& node) const;
+    unsigned int nodeCount() const;
+    StreetEdgeRange edgesFrom(unsigned int node) const;
+    GeoCoord nodeCoord(unsigned int node) const;
+    double nodeLatitude(unsigned int node) const;
+    double nodeLongitude(unsigned int node) const;
+      // every node's coordinates in radians with its latitude's cosine, for Haversine.h; built
+      // on the first call after each load
+    const RadianCoords& nodeRadians() const;
+    const char* streetName(unsigned int nameId) const;
+    StreetSegment segmentFor(unsigned int node, const StreetEdge& edge) const;
+      // changes whenever the nodes or edges do; identifies the graph precomputed tables belong to
+    unsigned long long graphFingerprint() const;
+      // changes on every load, and differs between StreetMap objects; cheap to check per query
+    unsigned long long generation() const;
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -87,8 +139,146 @@ private:
     StreetMapImpl* m_impl;
 };
 
+class ContractionHierarchyImpl;
+
+  // Preprocessed shortcut hierarchy over a StreetMap's graph for fast exact
+  // shortest-path queries.  build() is slow and meant to run offline; save()
+  // and load() persist the result next to the map it was built from.
+class ContractionHierarchy
+{
+public:
+    ContractionHierarchy(const StreetMap* sm);
+    ~ContractionHierarchy();
+    void build();
+    bool save(std::string chFile) const;
+    bool load(std::string chFile);
+    bool isReady() const;   // built or loaded for the map as it is now
+      // shortest path as the street edges taken, edges[i] leaving nodes[i]
+    bool findPath(unsigned int source, unsigned int target,
+        std::vector<unsigned int>& nodes, std::vector<const StreetEdge*>& edges,
+        double& distance, unsigned int& nodesSettled) const;
+      // We prevent a ContractionHierarchy object from being copied or assigned.
+    ContractionHierarchy(const ContractionHierarchy&) = delete;
+    ContractionHierarchy& operator=(const ContractionHierarchy&) = delete;
+private:
+    ContractionHierarchyImpl* m_impl;
+};
+
+class LandmarkTableImpl;
+
+  // Road distances between every node and a few landmark nodes, giving the
+  // router a tighter A* lower bound than straight-line distance.  build() runs
+  // a forward and a backward Dijkstra per landmark; save() and load() persist
+  // the table next to the map it was built from.
+class LandmarkTable
+{
+public:
+    LandmarkTable(const StreetMap* sm);
+    ~LandmarkTable();
+    void build(unsigned int landmarkCount);
+    bool save(std::string altFile) const;
+    bool load(std::string altFile);
+    bool isReady() const;   // built or loaded for the map as it is now
+    unsigned int landmarkCount() const;
+      // lower bound in miles on the road distance from node to target
+    double lowerBound(unsigned int node, unsigned int target) const;
+      // We prevent a LandmarkTable object from being copied or assigned.
+    LandmarkTable(const LandmarkTable&) = delete;
+    LandmarkTable& operator=(const LandmarkTable&) = delete;
+private:
+    LandmarkTableImpl* m_impl;
+};
+
+  // Times are minutes after the vehicle leaves the depot
+struct DeliveryRequest
+{
+    DeliveryRequest(std::string it, const GeoCoord& loc, double w = 0)
+     : item(it), location(loc), weight(w),
+       earliest(0), latest(std::numeric_limits<double>::infinity()), serviceMinutes(0)
+    {}
+    DeliveryRequest(std::string it, const GeoCoord& loc, double w, double from, double until, double service)
+     : item(it), location(loc), weight(w), earliest(from), latest(until), serviceMinutes(service)
+    {}
+    bool hasWindow() const { return earliest > 0 || latest != std::numeric_limits<double>::infinity(); }
+    std::string item;
+    GeoCoord location;
+    double weight;
+    double earliest;            // delivery may not start before this
+    double latest;              // nor after this
+    double serviceMinutes;      // time spent at the stop
+};
+
+  // What one vehicle can carry on a trip from the depot; each delivery is one item
+struct Vehicle
+{
+    Vehicle(unsigned int items, double weight)
+     : maxItems(items), maxWeight(weight)
+    {}
+    unsigned int maxItems;
+    double maxWeight;
+};
+
+class LegCacheImpl;
+
+  // Bounded least-recently-used cache of shortest paths between node pairs, to
+  // be shared by any number of routers and threads, on any number of maps.  Paths
+  // are kept as node IDs and edge positions rather than StreetSegments.  Reloading
+  // a map invalidates its entries at once; they are evicted as newer ones arrive.
+class LegCache
+{
+public:
+    LegCache(size_t maxBytes = 64 * 1024 * 1024);
+    ~LegCache();
+    void setMaxBytes(size_t maxBytes);   // evicts down to the new limit
+    void clear();
+    size_t bytesUsed() const;
+    unsigned long long hits() const;
+    unsigned long long misses() const;
+      // the path from source to target on sm, as in ContractionHierarchy::findPath, if cached
+    bool find(const StreetMap* sm, unsigned int source, unsigned int target,
+        std::vector<unsigned int>& nodes, std::vector<const StreetEdge*>& edges, double& distance) const;
+    void store(const StreetMap* sm, unsigned int source, unsigned int target,
+        const std::vector<unsigned int>& nodes, const std::vector<const StreetEdge*>& edges, double distance);
+      // We prevent a LegCache object from being copied or assigned.
+    LegCache(const LegCache&) = delete;
+    LegCache& operator=(const LegCache&) = delete;
+private:
+    LegCacheImpl* m_impl;
+};
+
+  // What routing did and how long it took, for one route, one distance matrix,
+  // or everything one plan routed.  Counters are added to, not set, so one
+  // RouteMetrics can gather several calls.
+struct RouteMetrics
+{
+    RouteMetrics()
+     : searches(0), nodesExpanded(0), heapPushes(0), nodeLookups(0), cacheHits(0), cacheMisses(0), seconds(0)
+    {}
+    unsigned long long searches;        // A*, Dijkstra or hierarchy searches run
+    unsigned long long nodesExpanded;
+    unsigned long long heapPushes;      // open-set inserts and decrease-keys; hierarchy searches count none
+    unsigned long long nodeLookups;     // coordinates looked up in the map's node index
+    unsigned long long cacheHits;       // routes answered by the leg cache without a search
+    unsigned long long cacheMisses;
+    double seconds;                     // wall time, summed over calls
+    void add(const RouteMetrics& other)
+    {
+        searches += other.searches;
+        nodesExpanded += other.nodesExpanded;
+        heapPushes += other.heapPushes;
+        nodeLookups += other.nodeLookups;
+        cacheHits += other.cacheHits;
+        cacheMisses += other.cacheMisses;
+        seconds += other.seconds;
+    }
+};
+
 class PointToPointRouterImpl;
 
+  // Routing keeps its scratch state per thread, so one router may be used from
+  // several threads at once, as may the ContractionHierarchy and LandmarkTable
+  // behind it once built or loaded.  The use... setters are not synchronized and
+  // belong with setup, before queries start.
 class PointToPointRouter
 {
 public:
@@ -99,6 +289,35 @@ public:
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+      // same, adding what the search did to metrics
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        std::list<StreetSegment>& route,
+        double& totalDistanceTravelled,
+        RouteMetrics& metrics) const;
+      // road miles between every pair of stops, row i holding the distances from stop i;
+      // stop 0 is the depot and stop i + 1 is deliveries[i].  Unreachable pairs are left
+      // infinite and make the result NO_ROUTE.
+    DeliveryResult computeDistanceMatrix(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<std::vector<double>>& matrix) const;
+    DeliveryResult computeDistanceMatrix(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<std::vector<double>>& matrix,
+        RouteMetrics& metrics) const;
+      // nodes expanded by the last route or matrix row generated on the calling thread
+    unsigned int nodesExpanded() const;
+      // answer queries with a bidirectional hierarchy search instead of A* (nullptr to stop)
+    void useContractionHierarchy(const ContractionHierarchy* ch);
+      // guide A* with landmark lower bounds instead of straight-line distance (nullptr to stop)
+    void useLandmarks(const LandmarkTable* landmarks);
+      // look routes up in, and add them to, this cache (nullptr for none)
+    void useLegCache(LegCache* cache);
+      // compute matrix rows on this pool's threads (nullptr for the calling thread only)
+    void useThreadPool(ThreadPool* pool);
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -106,13 +325,41 @@ private:
     PointToPointRouterImpl* m_impl;
 };
 
-struct DeliveryRequest
+  // How hard DeliveryOptimizer searches.  With no budget it only runs local
+  // search to the nearest local optimum.  With a budget it first anneals:
+  // random moves are accepted when they shorten the tour, or with a chance that
+  // falls as the temperature cools, and local search then polishes the best tour
+  // seen.  Runs with the same seed and an iteration budget alone repeat exactly.
+  // With several starts, each searches from its own shuffled order with its own
+  // seed, all under the one time budget, and the shortest tour found wins.
+  // Batches of up to exactStops deliveries skip all of that and are solved
+  // exactly, if the table that takes fits in exactMaxBytes.  Batches in which
+  // any delivery has a time window skip it too: stops are inserted where they
+  // can be on time and then moved about only where they stay on time, driving
+  // at speedMph throughout.
+struct OptimizerOptions
 {
-    DeliveryRequest(std::string it, const GeoCoord& loc)
-     : item(it), location(loc)
+    enum CoolingSchedule { COOL_GEOMETRIC, COOL_LINEAR };
+    enum MoveSet { MOVE_TWO_OPT = 1, MOVE_OR_OPT = 2, MOVE_RELOCATE = 4, MOVE_ALL = 7 };
+
+    OptimizerOptions()
+     : timeBudgetMs(0), iterationBudget(0), cooling(COOL_GEOMETRIC),
+       initialTemperature(0), finalTemperature(0), seed(1), moves(MOVE_ALL),
+       starts(1), targetGap(0), exactStops(12), exactMaxBytes(64 * 1024 * 1024), speedMph(25)
     {}
-    std::string item;
-    GeoCoord location;
+    double             timeBudgetMs;        // stop annealing after this long, 0 for no limit
+    unsigned long long iterationBudget;     // stop annealing after this many moves tried, 0 for no limit
+    CoolingSchedule    cooling;             // temperature from initial to final over the budget
+    double             initialTemperature;  // miles; 0 picks one from the starting tour's edges
+    double             finalTemperature;    // miles; 0 for a thousandth of the initial one
+    unsigned int       seed;
+    unsigned int       moves;               // MoveSet bits used by annealing and local search
+    unsigned int       starts;              // independent searches, run on the optimizer's thread pool
+    double             targetGap;           // stop every search once one is within this fraction of a
+                                            // lower bound on the tour length, 0 to use the whole budget
+    unsigned int       exactStops;          // deliveries at or below which the shortest tour is found exactly
+    size_t             exactMaxBytes;       // memory the exact solver may use; it needs 8 * 2^n * n bytes
+    double             speedMph;            // average over the roads, for time windows and ETAs
 };
 
 class DeliveryOptimizerImpl;
@@ -127,6 +374,28 @@ public:
         std::vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+      // same, but ordering by a PointToPointRouter::computeDistanceMatrix matrix for
+      // these deliveries, with the distances before and after taken from it
+    void optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        std::vector<DeliveryRequest>& deliveries,
+        const std::vector<std::vector<double>>& distances,
+        double& oldDistance,
+        double& newDistance) const;
+      // split the deliveries among the vehicles within their limits and order each one's share,
+      // trips[v] for vehicles[v] (possibly empty), using a matrix as above; totalDistance is
+      // the sum of the trips.  False, with trips cleared, if the deliveries cannot all fit.
+    bool optimizeFleetOrder(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        const std::vector<std::vector<double>>& distances,
+        const std::vector<Vehicle>& vehicles,
+        std::vector<std::vector<DeliveryRequest>>& trips,
+        double& totalDistance) const;
+    void setOptions(const OptimizerOptions& options);
+    OptimizerOptions options() const;
+      // run the starts on this pool's threads (nullptr for the calling thread only)
+    void useThreadPool(ThreadPool* pool);
       // We prevent a DeliveryOptimizer object from being copied or assigned.
     DeliveryOptimizer(const DeliveryOptimizer&) = delete;
     DeliveryOptimizer& operator=(const DeliveryOptimizer&) = delete;
@@ -208,6 +477,68 @@ private:
     double       m_distance;    // 1.92 (in miles)
 };
 
+  // When a delivery will be made, in minutes after leaving the depot
+struct DeliveryEta
+{
+    DeliveryEta(std::string it, double arrive, double begin, bool isLate)
+     : item(it), arrival(arrive), start(begin), late(isLate)
+    {}
+    std::string item;
+    double arrival;         // reaching the stop
+    double start;           // starting the delivery, after waiting for its window to open
+    bool late;              // start is after the window closes
+};
+
+  // Where the time making one delivery plan went.  The phases are measured on
+  // the calling thread; routing counts searches on every thread that helped.
+struct PlanMetrics
+{
+    PlanMetrics()
+     : legs(0), matrixSeconds(0), optimizeSeconds(0), routeSeconds(0), commandSeconds(0), totalSeconds(0)
+    {}
+    RouteMetrics routing;       // the distance matrix and every leg
+    unsigned int legs;
+    double matrixSeconds;
+    double optimizeSeconds;
+    double routeSeconds;        // routing the legs in the optimized order
+    double commandSeconds;      // turning legs into commands and ETAs
+    double totalSeconds;
+};
+
+  // One plan for DeliveryPlanner::generateDeliveryPlans to make
+struct DeliveryJob
+{
+    DeliveryJob(const GeoCoord& dep, const std::vector<DeliveryRequest>& dels)
+     : depot(dep), deliveries(dels)
+    {}
+    GeoCoord depot;
+    std::vector<DeliveryRequest> deliveries;
+};
+
+  // What generateDeliveryPlan would have returned for one DeliveryJob
+struct DeliveryPlanResult
+{
+    DeliveryPlanResult()
+     : result(NO_ROUTE), totalDistanceTravelled(0)
+    {}
+    DeliveryResult result;
+    std::vector<DeliveryCommand> commands;
+    std::vector<DeliveryEta> etas;
+    double totalDistanceTravelled;
+};
+
+  // One vehicle's trip in a DeliveryPlanner::generateFleetPlan plan
+struct VehiclePlan
+{
+    VehiclePlan()
+     : totalDistanceTravelled(0)
+    {}
+    std::vector<DeliveryRequest> deliveries;    // in the order made
+    std::vector<DeliveryCommand> commands;      // empty for a vehicle that stays at the depot
+    std::vector<DeliveryEta> etas;              // one per delivery, in the order made
+    double totalDistanceTravelled;
+};
+
 class DeliveryPlannerImpl;
 
 class DeliveryPlanner
@@ -220,6 +551,40 @@ public:
         const std::vector<DeliveryRequest>& deliveries,
         std::vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+      // same, with etas[i] for the i-th Deliver command, at the optimizer options' speed
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        std::vector<DeliveryEta>& etas,
+        double& totalDistanceTravelled) const;
+      // same, also timing each phase and counting what routing did
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        std::vector<DeliveryEta>& etas,
+        double& totalDistanceTravelled,
+        PlanMetrics& metrics) const;
+      // plans every job with one shared router and optimizer, results[i] for jobs[i]
+    void generateDeliveryPlans(
+        const std::vector<DeliveryJob>& jobs,
+        std::vector<DeliveryPlanResult>& results) const;
+      // splits the deliveries among the vehicles, each making one trip from the depot within its
+      // limits, plans[v] for vehicles[v]; OVER_CAPACITY if they cannot all be fitted in
+    DeliveryResult generateFleetPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        const std::vector<Vehicle>& vehicles,
+        std::vector<VehiclePlan>& plans,
+        double& totalDistanceTravelled) const;
+    void setOptimizerOptions(const OptimizerOptions& options);
+      // share this leg cache between every plan the planner makes (nullptr for none)
+    void useLegCache(LegCache* cache);
+      // route the jobs of a batch, the legs of a plan and the rows of its distance matrix, and run the
+      // optimizer's starts, on this pool's threads (nullptr for the calling thread only); plans come
+      // out the same either way unless the optimizer's options stop on time or a target gap
+    void useThreadPool(ThreadPool* pool);
       // We prevent a DeliveryPlanner object from being copied or assigned.
     DeliveryPlanner(const DeliveryPlanner&) = delete;
     DeliveryPlanner& operator=(const DeliveryPlanner&) = delete;
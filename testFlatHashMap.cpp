@@ -0,0 +1,176 @@
+#include "FlatHashMap.h"
+#include <unordered_map>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <iostream>
+using namespace std;
+
+// Checks FlatHashMap against std::unordered_map under random inserts, erases
+// and clears, with keys hashed well and keys hashed into a few long probe runs,
+// so erase's backward shifts are exercised; then the generation wrap in clear()
+// and the regrow when a probe distance no longer fits its metadata byte.  Built
+// like testHashMap.cpp, on its own.
+
+  // Keys with a hash picked by the test, so probe runs can be made as long as wanted
+struct TestKey
+{
+    uint32_t id;
+    uint32_t hash;
+};
+
+bool operator==(const TestKey& lhs, const TestKey& rhs)
+{
+    return lhs.id == rhs.id;
+}
+
+unsigned int hasher(const TestKey& key)
+{
+    return key.hash;
+}
+
+  // The same contents, and every key of the model found with its value
+bool sameContents(FlatHashMap<TestKey, int>& map, const unordered_map<uint32_t, int>& model,
+    const vector<TestKey>& keys)
+{
+    if (map.size() != (int)model.size())
+        return false;
+    for (const TestKey& key : keys) {
+        auto expected = model.find(key.id);
+        const int* found = map.find(key);
+        if (expected == model.end() ? found != nullptr : found == nullptr || *found != expected->second)
+            return false;
+    }
+    size_t visited = 0;
+    for (auto& entry : map) {
+        auto expected = model.find(entry.key().id);
+        if (expected == model.end() || expected->second != entry.value())
+            return false;
+        visited++;
+    }
+    return visited == model.size();
+}
+
+  // Random operations on keys drawn from keys, checked against unordered_map as they go
+int randomOperations(const vector<TestKey>& keys, double loadFactor, int operations, mt19937& rng, const char* what)
+{
+    FlatHashMap<TestKey, int> map(loadFactor);
+    unordered_map<uint32_t, int> model;
+    uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+    uniform_int_distribution<int> action(0, 99);
+    for (int op = 0; op < operations; op++) {
+        const TestKey& key = keys[pick(rng)];
+        int a = action(rng);
+        if (a < 55) {
+            map.associate(key, op);
+            model[key.id] = op;
+        }
+        else if (a < 95) {
+            bool erased = map.erase(key);
+            if (erased != (model.erase(key.id) == 1)) {
+                cout << what << ": erase of " << key.id << " returned " << erased << endl;
+                return 1;
+            }
+        }
+        else if (a < 99) {
+            int* value = map.find(key);
+            auto expected = model.find(key.id);
+            if ((value == nullptr) != (expected == model.end())) {
+                cout << what << ": find of " << key.id << " disagrees" << endl;
+                return 1;
+            }
+            if (value != nullptr)
+                *value = expected->second = -op;
+        }
+        else {
+            if (op % 3 == 0)
+                map.reset();
+            else
+                map.clear();
+            model.clear();
+        }
+        if (op % 97 == 0 && !sameContents(map, model, keys)) {
+            cout << what << ": contents differ after operation " << op << endl;
+            return 1;
+        }
+    }
+    if (!sameContents(map, model, keys)) {
+        cout << what << ": contents differ at the end" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    mt19937 rng(2020);
+    int failures = 0;
+
+    //Well spread hashes, and hashes crowded into eight values so runs are long and
+    //nearly every erase shifts entries back
+    vector<TestKey> spread, crowded;
+    for (uint32_t i = 0; i < 2000; i++) {
+        spread.push_back({ i, (uint32_t)rng() });
+        crowded.push_back({ i, (uint32_t)(rng() % 8) * 0x10000001u });
+    }
+    failures += randomOperations(spread, 0.5, 200000, rng, "spread keys");
+    failures += randomOperations(spread, 0.9, 200000, rng, "spread keys, load factor 0.9");
+    failures += randomOperations(crowded, 0.5, 100000, rng, "crowded keys");
+
+    //Generations are 24 bits; a wrap must not bring the old entries back
+    {
+        FlatHashMap<TestKey, int> map;
+        vector<TestKey> keys(spread.begin(), spread.begin() + 3);
+        for (size_t i = 0; i < keys.size(); i++)
+            map.associate(keys[i], (int)i);
+        bool reappeared = false;
+        for (uint32_t i = 0; i < (1u << 24) + 2 && !reappeared; i++) {
+            map.clear();
+            reappeared = map.find(keys[0]) != nullptr || map.find(keys[1]) != nullptr || map.find(keys[2]) != nullptr;
+        }
+        if (reappeared || map.size() != 0 || map.begin() != map.end()) {
+            cout << "Entries came back after the generation wrapped" << endl;
+            failures++;
+        }
+        unordered_map<uint32_t, int> model;
+        for (size_t i = 0; i < keys.size(); i++) {
+            map.associate(keys[i], 10 + (int)i);
+            model[keys[i].id] = 10 + (int)i;
+        }
+        if (!sameContents(map, model, spread)) {
+            cout << "Inserts after the generation wrapped went wrong" << endl;
+            failures++;
+        }
+    }
+
+    //More than 255 keys sharing a home slot until the table reaches 4096 slots, so
+    //the probe distance overflows and the table must grow past its load factor
+    {
+        vector<TestKey> keys;
+        for (uint32_t h = 0; keys.size() < 400; h++)
+            if ((uint32_t)(h * 2654435769u) >> 20 == 0x5a5)
+                keys.push_back({ (uint32_t)keys.size(), h });
+        FlatHashMap<TestKey, int> map;
+        unordered_map<uint32_t, int> model;
+        for (const TestKey& key : keys) {
+            map.associate(key, (int)key.id * 3);
+            model[key.id] = (int)key.id * 3;
+        }
+        if (!sameContents(map, model, keys)) {
+            cout << "Contents differ after growing for probe distance" << endl;
+            failures++;
+        }
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            map.erase(keys[i]);
+            model.erase(keys[i].id);
+        }
+        if (!sameContents(map, model, keys)) {
+            cout << "Contents differ after erasing from long probe runs" << endl;
+            failures++;
+        }
+    }
+
+    if (failures == 0)
+        cout << "All tests passed" << endl;
+    return failures == 0 ? 0 : 1;
+}
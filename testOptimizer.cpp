@@ -0,0 +1,236 @@
+#include "provided.h"
+#include "HeldKarp.h"
+#include "TourSearch.h"
+#include "ScheduleSearch.h"
+#include "Haversine.h"
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <iostream>
+using namespace std;
+
+// Checks the exact solver against every ordering of small random batches, then
+// uses it as the oracle for how far the heuristic search falls short, and
+// checks that time-window schedules keep their promises and that batch
+// great-circle distances match distanceEarthMiles.  Built like testHashMap.cpp,
+// with HeldKarp.cpp, TourSearch.cpp, ScheduleSearch.cpp and Haversine.cpp.
+
+double tourLength(const vector<int>& tour, const vector<vector<double>>& distances)
+{
+    double length = 0;
+    for (size_t i = 0; i < tour.size(); i++)
+        length += distances[tour[i]][tour[(i + 1) % tour.size()]];
+    return length;
+}
+
+  // Points in a square, with one-way detours so the distances are not symmetric
+vector<vector<double>> randomMatrix(int stops, mt19937& rng)
+{
+    uniform_real_distribution<> coord(0, 10), detour(1, 1.5);
+    vector<double> x(stops), y(stops);
+    for (int i = 0; i < stops; i++) {
+        x[i] = coord(rng);
+        y[i] = coord(rng);
+    }
+    vector<vector<double>> distances(stops, vector<double>(stops, 0));
+    for (int i = 0; i < stops; i++)
+        for (int j = 0; j < stops; j++)
+            if (i != j)
+                distances[i][j] = hypot(x[i] - x[j], y[i] - y[j]) * detour(rng);
+    return distances;
+}
+
+  // How many doubles apart two values are
+double ulpsApart(double a, double b)
+{
+    if (a == b)
+        return 0;
+    return abs(a - b) / (nextafter(abs(b), INFINITY) - abs(b));
+}
+
+int main()
+{
+    mt19937 rng(2020);
+    int failures = 0;
+
+    //Exact against brute force
+    for (int stops = 1; stops <= 9; stops++) {
+        for (int trial = 0; trial < 20; trial++) {
+            vector<vector<double>> distances = randomMatrix(stops, rng);
+            vector<int> tour;
+            double length;
+            if (!solveHeldKarp(distances, 1 << 20, tour, length)) {
+                cout << "Exact solver refused " << stops << " stops" << endl;
+                failures++;
+                continue;
+            }
+            vector<int> order(stops);
+            for (int i = 0; i < stops; i++)
+                order[i] = i;
+            double shortest = tourLength(order, distances);
+            while (next_permutation(order.begin() + 1, order.end()))
+                shortest = min(shortest, tourLength(order, distances));
+            vector<int> sorted = tour;
+            sort(sorted.begin(), sorted.end());
+            bool visitsAll = tour.size() == (size_t)stops && tour[0] == 0;
+            for (int i = 0; visitsAll && i < stops; i++)
+                visitsAll = sorted[i] == i;
+            if (!visitsAll || abs(length - shortest) > 1e-9 || abs(tourLength(tour, distances) - length) > 1e-9) {
+                cout << stops << " stops: exact " << length << ", brute force " << shortest << endl;
+                failures++;
+            }
+        }
+    }
+
+    //The memory cap is honoured
+    vector<int> tour;
+    double length;
+    if (solveHeldKarp(randomMatrix(13, rng), heldKarpBytes(13) - 1, tour, length)) {
+        cout << "Exact solver ignored its memory cap" << endl;
+        failures++;
+    }
+
+    //Refusing, over the cap or with a stop no road reaches, leaves the caller's tour and length alone
+    {
+        mt19937 refusalRng(7); //its own, so the draws below stay as they were
+        vector<vector<double>> unreachable = randomMatrix(6, refusalRng);
+        for (int i = 0; i < 6; i++)
+            if (i != 3)
+                unreachable[i][3] = INFINITY;
+        vector<int> kept(1, 42);
+        double keptLength = 42;
+        bool over = solveHeldKarp(randomMatrix(13, refusalRng), heldKarpBytes(13) - 1, kept, keptLength);
+        bool stuck = solveHeldKarp(unreachable, 64 << 20, kept, keptLength);
+        if (over || stuck || kept != vector<int>(1, 42) || keptLength != 42) {
+            cout << "Exact solver changed tour or length when refusing" << endl;
+            failures++;
+        }
+    }
+
+    //Heuristic against the oracle; never shorter, and its gap reported
+    double worstGap = 0, totalGap = 0;
+    int batches = 0;
+    for (int stops = 5; stops <= 13; stops++) {
+        for (int trial = 0; trial < 50; trial++) {
+            vector<vector<double>> distances = randomMatrix(stops, rng);
+            solveHeldKarp(distances, 64 << 20, tour, length);
+            TourSearch search(distances);
+            double heuristic = search.improve();
+            if (heuristic < length - 1e-9) {
+                cout << stops << " stops: heuristic " << heuristic << " beat exact " << length << endl;
+                failures++;
+            }
+            double gap = heuristic / length - 1;
+            worstGap = max(worstGap, gap);
+            totalGap += gap;
+            batches++;
+        }
+    }
+    cout << "Local search is on average " << 100 * totalGap / batches << "% and at worst "
+         << 100 * worstGap << "% longer than the shortest tour" << endl;
+
+    //Time windows: each batch has windows around a random tour, so some order is on time.
+    //Stops not reported late must really be on time, and most batches should have none late
+    int feasible = 0, windowBatches = 0;
+    const double SPEED = 30, MINUTES_PER_MILE = 60 / SPEED;
+    for (int stops = 3; stops <= 40; stops++) {
+        for (int trial = 0; trial < 20; trial++) {
+            vector<vector<double>> distances = randomMatrix(stops, rng);
+            vector<int> order(stops);
+            for (int i = 0; i < stops; i++)
+                order[i] = i;
+            shuffle(order.begin() + 1, order.end(), rng);
+            vector<double> earliest(stops, 0), latest(stops, 0), service(stops, 0);
+            uniform_real_distribution<> slack(0, 30), work(0, 10);
+            double clock = 0;
+            for (int p = 1; p < stops; p++) {
+                int stop = order[p];
+                clock += distances[order[p - 1]][stop] * MINUTES_PER_MILE;
+                earliest[stop] = max(0.0, clock - slack(rng));
+                latest[stop] = clock + slack(rng);
+                service[stop] = work(rng);
+                clock += service[stop];
+            }
+            ScheduleSearch schedule(distances, earliest, latest, service, SPEED);
+            schedule.insertAll();
+            double scheduled = schedule.improve();
+            vector<int> tour = schedule.tour();
+            vector<char> givenUp(stops, 0);
+            for (int stop : schedule.late())
+                givenUp[stop] = 1;
+            clock = 0;
+            for (int p = 1; p < stops; p++) {
+                int stop = tour[p];
+                clock = max(clock + distances[tour[p - 1]][stop] * MINUTES_PER_MILE, earliest[stop]);
+                if (clock > latest[stop] + 1e-9 && !givenUp[stop]) {
+                    cout << stops << " stops: stop " << stop << " late but not reported" << endl;
+                    failures++;
+                }
+                clock += service[stop];
+            }
+            if (abs(scheduled - tourLength(tour, distances)) > 1e-9) {
+                cout << stops << " stops: scheduled tour length is off" << endl;
+                failures++;
+            }
+            feasible += schedule.late().empty();
+            windowBatches++;
+        }
+    }
+    cout << feasible << " of " << windowBatches << " time-window batches scheduled with nobody late" << endl;
+
+    //Batch distances on every kernel this processor has: points anywhere, in one city, and on
+    //both sides of the antimeridian, within HAVERSINE_MAX_ULPS of the scalar function under
+    //10,000 miles and close beyond, whatever their place in a run
+    vector<GeoCoord> points;
+    uniform_real_distribution<> anyLat(-90, 90), anyLon(-180, 180), nearby(-0.05, 0.05);
+    for (int i = 0; i < 900; i++) {
+        GeoCoord gc;
+        gc.latitude = i < 600 ? anyLat(rng) : i < 800 ? 34.05 + nearby(rng) : 10 * nearby(rng);
+        gc.longitude = i < 600 ? anyLon(rng) : i < 800 ? -118.45 + nearby(rng) : (i % 2 ? 179.98 : -179.98) + nearby(rng) / 10;
+        points.push_back(gc);
+    }
+    RadianCoords radians;
+    for (const GeoCoord& gc : points)
+        radians.add(gc.latitude, gc.longitude);
+    HaversineKernel original = haversineKernel();
+    const HaversineKernel kernels[] = { HAVERSINE_SCALAR, HAVERSINE_SSE2, HAVERSINE_AVX2 };
+    for (HaversineKernel kernel : kernels) {
+        if (!useHaversineKernel(kernel))
+            continue;
+        vector<vector<double>> all;
+        haversineManyToMany(radians, radians, all);
+        double worstUlps = 0;
+        for (size_t i = 0; i < points.size(); i++) {
+            vector<double> row(points.size());
+            haversineOneToMany(radians, i, radians, row.data());
+            for (size_t j = 0; j < points.size(); j++) {
+                double expected = distanceEarthMiles(points[i], points[j]);
+                double ulps = ulpsApart(row[j], expected);
+                bool close = expected < 10000 ? ulps <= HAVERSINE_MAX_ULPS : abs(row[j] - expected) <= 1e-11 * expected;
+                if (!close || row[j] != all[i][j]) {
+                    cout << haversineKernelName(kernel) << ": " << points[i].latitude << "," << points[i].longitude << " to "
+                         << points[j].latitude << "," << points[j].longitude << " is " << row[j] << ", not " << expected << endl;
+                    failures++;
+                }
+                if (expected < 10000)
+                    worstUlps = max(worstUlps, ulps);
+            }
+            //Short runs end in a padded vector and must agree with the long one
+            size_t count = i % 9 + 1;
+            vector<double> start(count);
+            haversineOneToMany(radians.lat[i], radians.lon[i], radians.cosLat[i], radians.lat.data() + i / 2,
+                radians.lon.data() + i / 2, radians.cosLat.data() + i / 2, count, start.data());
+            for (size_t j = 0; j < count && i / 2 + j < points.size(); j++)
+                if (start[j] != row[i / 2 + j]) {
+                    cout << haversineKernelName(kernel) << ": a run of " << count << " differs from a full row" << endl;
+                    failures++;
+                }
+        }
+        cout << haversineKernelName(kernel) << " distances at most " << worstUlps << " ulps from distanceEarthMiles" << endl;
+    }
+    useHaversineKernel(original);
+
+    cout << (failures == 0 ? "All tests passed" : "Some tests failed") << endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+#include "provided.h"
+#include "Logger.h"
+#include <string>
+#include <vector>
+#include <list>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+using namespace std;
+
+// Checks the router's faster modes against plain A* on mapdata.txt: every
+// route must come out exactly as long as A*'s, preprocessed tables must be
+// dropped when the map is reloaded and refused when they belong to another
+// map, and they must survive a save and load.  A leg cache must keep the
+// entries of maps that share it apart, and drop a map's entries when it is
+// reloaded.  Built like testHashMap.cpp,
+// with StreetMap.cpp, MappedFile.cpp, MapParser.cpp, ThreadPool.cpp,
+// Logger.cpp, Metrics.cpp, Haversine.cpp, PointToPointRouter.cpp,
+// ContractionHierarchy.cpp, LandmarkTable.cpp and LegCache.cpp; run from the
+// directory holding mapdata.txt and testmapdata.txt.
+
+  // A path in the system's temporary directory, removed when this goes out of scope
+class TempFile
+{
+public:
+    TempFile(string name) : m_path((filesystem::temp_directory_path() / name).string()) {}
+    ~TempFile() { remove(m_path.c_str()); }
+    const string& path() const { return m_path; }
+private:
+    string m_path;
+};
+
+  // A route A* found, to hold the other modes to
+struct Expected
+{
+    GeoCoord start;
+    GeoCoord end;
+    DeliveryResult result;
+    double miles;
+};
+
+vector<Expected> astarRoutes(const StreetMap& sm, int count)
+{
+    PointToPointRouter router(&sm);
+    mt19937 rng(12345); //fixed seed, same pairs every run
+    vector<Expected> routes;
+    for (int i = 0; i < count; i++) {
+        Expected e;
+        e.start = sm.nodeCoord(rng() % sm.nodeCount());
+        e.end = sm.nodeCoord(rng() % sm.nodeCount());
+        list<StreetSegment> route;
+        e.result = router.generatePointToPointRoute(e.start, e.end, route, e.miles);
+        routes.push_back(e);
+    }
+    return routes;
+}
+
+  // Routes that differ from A*'s in result or length, or that do not run from start to end
+int differences(const PointToPointRouter& router, const vector<Expected>& expected)
+{
+    int differ = 0;
+    for (const Expected& e : expected) {
+        list<StreetSegment> route;
+        double miles;
+        DeliveryResult result = router.generatePointToPointRoute(e.start, e.end, route, miles);
+        bool connected = true;
+        GeoCoord at = e.start;
+        for (const StreetSegment& seg : route) {
+            connected = connected && seg.start == at;
+            at = seg.end;
+        }
+        if (result == DELIVERY_SUCCESS)
+            connected = connected && at == e.end;
+        if (result != e.result || (result == DELIVERY_SUCCESS && (miles != e.miles || !connected)))
+            differ++;
+    }
+    return differ;
+}
+
+bool truncatedCopy(const string& from, const string& to)
+{
+    ifstream infile(from, ios::binary);
+    string bytes((istreambuf_iterator<char>(infile)), istreambuf_iterator<char>());
+    if (bytes.size() < 16)
+        return false;
+    ofstream outfile(to, ios::binary | ios::trunc);
+    outfile.write(bytes.data(), bytes.size() - 8);
+    return (bool)outfile;
+}
+
+int checkHierarchy(StreetMap& sm, const vector<Expected>& expected)
+{
+    int failures = 0;
+    ContractionHierarchy ch(&sm);
+    ch.build();
+    PointToPointRouter router(&sm);
+    router.useContractionHierarchy(&ch);
+    int differ = differences(router, expected);
+    if (!ch.isReady() || differ != 0) {
+        cout << "Hierarchy: " << differ << " routes differ from A*" << endl;
+        failures++;
+    }
+
+    TempFile chFile("testRouter.ch");
+    ContractionHierarchy loaded(&sm);
+    if (!ch.save(chFile.path()) || !loaded.load(chFile.path()) || !loaded.isReady()) {
+        cout << "Hierarchy: save and load failed" << endl;
+        failures++;
+    }
+    PointToPointRouter loadedRouter(&sm);
+    loadedRouter.useContractionHierarchy(&loaded);
+    differ = differences(loadedRouter, expected);
+    if (differ != 0) {
+        cout << "Hierarchy: " << differ << " routes differ from A* after a save and load" << endl;
+        failures++;
+    }
+
+    //The same map loaded again has new storage, so the hierarchy must stand aside until
+    //reloaded, with routes falling back to A*
+    if (!sm.load("mapdata.txt")) {
+        cout << "Unable to reload mapdata.txt" << endl;
+        return failures + 1;
+    }
+    if (ch.isReady() || loaded.isReady()) {
+        cout << "Hierarchy: still ready after the map was reloaded" << endl;
+        failures++;
+    }
+    differ = differences(router, expected);
+    if (differ != 0) {
+        cout << "Hierarchy: " << differ << " routes differ from A* while stale" << endl;
+        failures++;
+    }
+    if (!loaded.load(chFile.path()) || !loaded.isReady() || differences(loadedRouter, expected) != 0) {
+        cout << "Hierarchy: reloading it for the reloaded map failed" << endl;
+        failures++;
+    }
+
+    //Files for another map, or cut short, are refused
+    setLogLevel(LOG_OFF);   //each refusal logs an error, expected here
+    StreetMap other;
+    ContractionHierarchy wrongMap(&other);
+    if (!other.load("testmapdata.txt") || wrongMap.load(chFile.path()) || wrongMap.isReady()) {
+        cout << "Hierarchy: a file for another map was accepted" << endl;
+        failures++;
+    }
+    TempFile cut("testRouter.cut.ch");
+    ContractionHierarchy truncated(&sm);
+    if (!truncatedCopy(chFile.path(), cut.path()) || truncated.load(cut.path()) || truncated.isReady()) {
+        cout << "Hierarchy: a truncated file was accepted" << endl;
+        failures++;
+    }
+    setLogLevel(LOG_INFO);
+    return failures;
+}
+
+int checkLandmarks(StreetMap& sm, const vector<Expected>& expected)
+{
+    int failures = 0;
+    const unsigned int counts[] = { 1, 4, 16 };
+    for (unsigned int k : counts) {
+        LandmarkTable landmarks(&sm);
+        landmarks.build(k);
+        PointToPointRouter router(&sm);
+        router.useLandmarks(&landmarks);
+        int differ = differences(router, expected);
+        if (!landmarks.isReady() || differ != 0) {
+            cout << "Landmarks: " << differ << " routes differ from A* with " << k << " landmarks" << endl;
+            failures++;
+        }
+    }
+
+    LandmarkTable landmarks(&sm);
+    landmarks.build(8);
+    TempFile altFile("testRouter.alt");
+    LandmarkTable loaded(&sm);
+    if (!landmarks.save(altFile.path()) || !loaded.load(altFile.path()) || !loaded.isReady()) {
+        cout << "Landmarks: save and load failed" << endl;
+        failures++;
+    }
+    PointToPointRouter router(&sm);
+    router.useLandmarks(&landmarks);
+    PointToPointRouter loadedRouter(&sm);
+    loadedRouter.useLandmarks(&loaded);
+    int differ = differences(loadedRouter, expected);
+    if (differ != 0) {
+        cout << "Landmarks: " << differ << " routes differ from A* after a save and load" << endl;
+        failures++;
+    }
+
+    if (!sm.load("mapdata.txt")) {
+        cout << "Unable to reload mapdata.txt" << endl;
+        return failures + 1;
+    }
+    if (landmarks.isReady() || loaded.isReady()) {
+        cout << "Landmarks: still ready after the map was reloaded" << endl;
+        failures++;
+    }
+    differ = differences(router, expected);
+    if (differ != 0) {
+        cout << "Landmarks: " << differ << " routes differ from A* while stale" << endl;
+        failures++;
+    }
+    if (!loaded.load(altFile.path()) || !loaded.isReady() || differences(loadedRouter, expected) != 0) {
+        cout << "Landmarks: reloading them for the reloaded map failed" << endl;
+        failures++;
+    }
+
+    setLogLevel(LOG_OFF);   //each refusal logs an error, expected here
+    StreetMap other;
+    LandmarkTable wrongMap(&other);
+    if (!other.load("testmapdata.txt") || wrongMap.load(altFile.path()) || wrongMap.isReady()) {
+        cout << "Landmarks: a file for another map was accepted" << endl;
+        failures++;
+    }
+    TempFile cut("testRouter.cut.alt");
+    LandmarkTable truncated(&sm);
+    if (!truncatedCopy(altFile.path(), cut.path()) || truncated.load(cut.path()) || truncated.isReady()) {
+        cout << "Landmarks: a truncated file was accepted" << endl;
+        failures++;
+    }
+    setLogLevel(LOG_INFO);
+    return failures;
+}
+
+  // Hits from routing the expected pairs once more with router
+unsigned long long hitsFromPass(const PointToPointRouter& router, const LegCache& cache,
+    const vector<Expected>& expected, int& differ)
+{
+    unsigned long long before = cache.hits();
+    differ += differences(router, expected);
+    return cache.hits() - before;
+}
+
+int checkLegCache(StreetMap& sm, const vector<Expected>& expected)
+{
+    int failures = 0;
+    int differ = 0;
+    LegCache cache;
+    PointToPointRouter router(&sm);
+    router.useLegCache(&cache);
+    hitsFromPass(router, cache, expected, differ);
+    unsigned long long hits = hitsFromPass(router, cache, expected, differ);
+    if (hits == 0 || differ != 0) {
+        cout << "Leg cache: " << hits << " hits on a second pass, " << differ << " routes differ from A*" << endl;
+        failures++;
+    }
+
+    //Another map with the same node numbering, routed through the same cache in between,
+    //must neither evict this map's entries nor be handed them
+    StreetMap other;
+    if (!other.load("mapdata.txt")) {
+        cout << "Unable to load mapdata.txt" << endl;
+        return failures + 1;
+    }
+    PointToPointRouter otherRouter(&other);
+    otherRouter.useLegCache(&cache);
+    unsigned long long otherHits = hitsFromPass(otherRouter, cache, expected, differ);
+    unsigned long long againHits = hitsFromPass(router, cache, expected, differ);
+    if (otherHits != 0 || againHits != hits || differ != 0) {
+        cout << "Leg cache: sharing it between maps gave " << otherHits << " hits on the new map and "
+             << againHits << " of " << hits << " on the first, " << differ << " routes differ from A*" << endl;
+        failures++;
+    }
+
+    //Reloading a map leaves none of its entries to be found, while the other map keeps its own
+    if (!sm.load("mapdata.txt")) {
+        cout << "Unable to reload mapdata.txt" << endl;
+        return failures + 1;
+    }
+    unsigned long long staleHits = hitsFromPass(router, cache, expected, differ);
+    unsigned long long refilledHits = hitsFromPass(router, cache, expected, differ);
+    otherHits = hitsFromPass(otherRouter, cache, expected, differ);
+    if (staleHits != 0 || refilledHits != hits || otherHits != hits || differ != 0) {
+        cout << "Leg cache: after a reload " << staleHits << " stale hits, then " << refilledHits << " of " << hits
+             << ", other map " << otherHits << " of " << hits << ", " << differ << " routes differ from A*" << endl;
+        failures++;
+    }
+    return failures;
+}
+
+int main()
+{
+    StreetMap sm;
+    if (!sm.load("mapdata.txt") || sm.nodeCount() == 0) {
+        cout << "Unable to load mapdata.txt" << endl;
+        return 1;
+    }
+    vector<Expected> expected = astarRoutes(sm, 300);
+    int failures = 0;
+    failures += checkHierarchy(sm, expected);
+    failures += checkLandmarks(sm, expected);
+    failures += checkLegCache(sm, expected);
+
+    if (failures == 0)
+        cout << "All tests passed" << endl;
+    return failures == 0 ? 0 : 1;
+}
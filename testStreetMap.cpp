@@ -0,0 +1,150 @@
+#include "provided.h"
+#include "Logger.h"
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+using namespace std;
+
+// Checks that a StreetMap saved as a snapshot and loaded back gives the same
+// segments as the map file it came from, and that damaged snapshots are
+// refused.  Built like testHashMap.cpp, with StreetMap.cpp, MappedFile.cpp,
+// MapParser.cpp, ThreadPool.cpp, Logger.cpp and Haversine.cpp; run from the
+// directory holding mapdata.txt.
+
+  // A path in the system's temporary directory, removed when this goes out of scope
+class TempFile
+{
+public:
+    TempFile(string name) : m_path((filesystem::temp_directory_path() / name).string()) {}
+    ~TempFile() { remove(m_path.c_str()); }
+    const string& path() const { return m_path; }
+private:
+    string m_path;
+};
+
+bool readBytes(const string& path, string& bytes)
+{
+    ifstream infile(path, ios::binary);
+    bytes.assign(istreambuf_iterator<char>(infile), istreambuf_iterator<char>());
+    return (bool)infile || infile.eof();
+}
+
+bool writeBytes(const string& path, const string& bytes)
+{
+    ofstream outfile(path, ios::binary | ios::trunc);
+    outfile.write(bytes.data(), bytes.size());
+    return (bool)outfile;
+}
+
+  // Every node's segments in both maps, compared by coordinates and street name
+bool sameSegments(const StreetMap& expected, const StreetMap& actual)
+{
+    if (expected.nodeCount() != actual.nodeCount() || expected.graphFingerprint() != actual.graphFingerprint())
+        return false;
+    for (unsigned int n = 0; n < expected.nodeCount(); n++) {
+        GeoCoord gc = expected.nodeCoord(n);
+        vector<StreetSegment> want, got;
+        if (!expected.getSegmentsThatStartWith(gc, want) || !actual.getSegmentsThatStartWith(gc, got))
+            return false;
+        if (want.size() != got.size())
+            return false;
+        for (size_t i = 0; i < want.size(); i++)
+            if (!(want[i] == got[i]) || want[i].name != got[i].name)
+                return false;
+    }
+    return true;
+}
+
+int main()
+{
+    int failures = 0;
+    StreetMap parsed;
+    if (!parsed.load("mapdata.txt") || parsed.nodeCount() == 0) {
+        cout << "Unable to load mapdata.txt" << endl;
+        return 1;
+    }
+    TempFile snapshot("testStreetMap.snap");
+    if (!parsed.saveSnapshot(snapshot.path())) {
+        cout << "Unable to save " << snapshot.path() << endl;
+        return 1;
+    }
+
+    //Round trip, mapped as is and verified
+    const bool verify[] = { false, true };
+    for (bool checked : verify) {
+        StreetMap loaded;
+        if (!loaded.loadSnapshot(snapshot.path(), checked) || !sameSegments(parsed, loaded)) {
+            cout << "Snapshot " << (checked ? "verified" : "mapped") << " does not match the map file" << endl;
+            failures++;
+        }
+    }
+
+    //A snapshot over a loaded one, and a map file over a snapshot, replace it whole
+    StreetMap reused;
+    if (!reused.loadSnapshot(snapshot.path()) || !reused.loadSnapshot(snapshot.path())
+        || !sameSegments(parsed, reused) || !reused.load("mapdata.txt") || !sameSegments(parsed, reused)) {
+        cout << "Reloading over a snapshot changed the map" << endl;
+        failures++;
+    }
+
+    string good;
+    if (!readBytes(snapshot.path(), good) || good.size() < 64 + 8) {
+        cout << "Unable to read " << snapshot.path() << endl;
+        return 1;
+    }
+    struct Damage { const char* what; string bytes; bool onlyWhenVerified; };
+    vector<Damage> damaged;
+    damaged.push_back({ "empty", "", false });
+    damaged.push_back({ "header only, cut short", good.substr(0, 40), false });
+    damaged.push_back({ "truncated", good.substr(0, good.size() - 8), false });
+    damaged.push_back({ "extended", good + string(8, '\0'), false });
+    string magic = good;
+    magic[0] ^= 0x20;
+    damaged.push_back({ "wrong magic", magic, false });
+    string version = good;
+    uint32_t wrongVersion;
+    memcpy(&wrongVersion, &version[12], sizeof(wrongVersion));
+    wrongVersion++;
+    memcpy(&version[12], &wrongVersion, sizeof(wrongVersion));
+    damaged.push_back({ "wrong version", version, false });
+    string byteOrder = good;
+    swap(byteOrder[8], byteOrder[11]);
+    damaged.push_back({ "other byte order", byteOrder, false });
+    //A flipped bit in the last section only shows up in the checksum
+    string corrupt = good;
+    corrupt[corrupt.size() - 5] ^= 0x01;
+    damaged.push_back({ "corrupted", corrupt, true });
+
+    TempFile bad("testStreetMap.bad.snap");
+    setLogLevel(LOG_OFF);   //each refusal logs an error, expected here
+    for (const Damage& d : damaged) {
+        if (!writeBytes(bad.path(), d.bytes)) {
+            cout << "Unable to write " << bad.path() << endl;
+            return 1;
+        }
+        for (bool checked : verify) {
+            if (d.onlyWhenVerified && !checked)
+                continue;
+            StreetMap sm;
+            if (sm.loadSnapshot(bad.path(), checked)) {
+                cout << d.what << " snapshot was accepted" << (checked ? " when verified" : "") << endl;
+                failures++;
+            }
+            else if (sm.nodeCount() != 0) {
+                cout << d.what << " snapshot left nodes behind" << endl;
+                failures++;
+            }
+        }
+    }
+    setLogLevel(LOG_INFO);
+
+    if (failures == 0)
+        cout << "All tests passed" << endl;
+    return failures == 0 ? 0 : 1;
+}